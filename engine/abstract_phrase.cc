@@ -0,0 +1,1057 @@
+//
+// C++ Implementation: abstract_phrase
+//
+// Description:
+// 请参见头文件描述.
+//
+// Author: Jally <jallyx@163.com>, (C) 2009, 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#include "abstract_phrase.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "thread_pool.h"
+
+/* 长度节点的词语数量达到其两倍才分块并行扫描，也是每块的最小词语数量 */
+#define SCAN_CHUNK_LENGTH 8192
+/* 分块的最大数量 */
+#define MAX_SCAN_CHUNK 8
+/* 每扫描多少个词语检查一次是否可以放弃本块(2的幂) */
+#define SCAN_ABORT_INTERVAL 256
+/* 查询改写后精确键值前缀的部件数量上限 */
+#define MAX_PROBE_PART 32
+/* 查询改写后变体数量的上限 */
+#define MAX_QUERY_VARIANT 64
+/* 各变体在精确索引中对应的词语总数上限 */
+#define MAX_PROBE_ENTRY 1024
+/* 位掩码匹配策略所能处理的最大长度 */
+#define MAX_MASK_LENGTH 16
+
+/**
+ * 比较两个汉字代理数组的前若干个部件.
+ * 部件依次为第一个汉字代理的主、副索引值，第二个汉字代理的主、副索引值... \n
+ * @param chars1 前者
+ * @param chars2 后者
+ * @param parts 部件数量
+ * @return 前者小于、等于、大于后者时分别为负数、0、正数
+ */
+static int CompareCharsProxy(const CharsProxy *chars1,
+                             const CharsProxy *chars2, int parts) {
+  int count = 0;
+  for (; count < parts / 2; ++count) {
+    if ((chars1 + count)->major_index_ != (chars2 + count)->major_index_)
+      return (chars1 + count)->major_index_ < (chars2 + count)->major_index_ ?
+                 -1 : 1;
+    if ((chars1 + count)->minor_index_ != (chars2 + count)->minor_index_)
+      return (chars1 + count)->minor_index_ < (chars2 + count)->minor_index_ ?
+                 -1 : 1;
+  }
+  if (parts % 2 == 1 &&
+      (chars1 + count)->major_index_ != (chars2 + count)->major_index_)
+    return (chars1 + count)->major_index_ < (chars2 + count)->major_index_ ?
+               -1 : 1;
+  return 0;
+}
+
+/**
+ * 新汉字代理是否细化了旧汉字代理.
+ * 主部件相同，且旧汉字代理未给出副部件或二者的副部件相同时，
+ * 与新汉字代理相匹配的词语必定也与旧汉字代理相匹配. \n
+ * @param proxy 新汉字代理
+ * @param origin 旧汉字代理
+ * @return BOOL
+ */
+static bool IsRefinedCharsProxy(const CharsProxy *proxy,
+                                const CharsProxy *origin) {
+  return proxy->major_index_ == origin->major_index_ &&
+         (origin->minor_index_ == -1 ||
+          proxy->minor_index_ == origin->minor_index_);
+}
+
+/**
+ * 精确索引的排序比较器.
+ * 按汉字代理数组的各部件依次比较，相同时序号较小者在前. \n
+ */
+class ExactIndexCmp {
+ public:
+  ExactIndexCmp(const CharsProxy *entry, int length)
+      : entry_(entry), length_(length) {}
+
+  bool operator()(uint number1, uint number2) const {
+    int result = CompareCharsProxy(entry_ + length_ * number1,
+                                   entry_ + length_ * number2, length_ * 2);
+    return result != 0 ? result < 0 : number1 < number2;
+  }
+
+ private:
+  const CharsProxy *entry_;  ///< 长度节点的汉字代理数组
+  int length_;  ///< 长度
+};
+
+/**
+ * 精确匹配策略.
+ * 未启用模糊拼音且每个汉字代理都给出了副部件时，逐字节比较即可. \n
+ */
+class ExactMatchPolicy {
+ public:
+  ExactMatchPolicy(const CharsProxy *chars_proxy, int length)
+      : chars_proxy_(chars_proxy), size_(sizeof(CharsProxy) * length) {}
+
+  bool operator()(const CharsProxy *entry) const {
+    return memcmp(entry, chars_proxy_, size_) == 0;
+  }
+
+ private:
+  const CharsProxy *chars_proxy_;  ///< 待查询的汉字代理数组
+  size_t size_;  ///< 比较的字节数
+};
+
+/**
+ * 部分韵母匹配策略.
+ * 未启用模糊拼音，但某些汉字代理只给出了主部件(如"zhong'g"中的"g"). \n
+ */
+class PartialFinalMatchPolicy {
+ public:
+  PartialFinalMatchPolicy(const CharsProxy *chars_proxy, int length)
+      : chars_proxy_(chars_proxy), length_(length) {}
+
+  bool operator()(const CharsProxy *entry) const {
+    for (int count = 0; count < length_; ++count) {
+      const CharsProxy *proxy = chars_proxy_ + count;
+      if ((entry + count)->major_index_ != proxy->major_index_ ||
+          (proxy->minor_index_ != -1 &&
+           (entry + count)->minor_index_ != proxy->minor_index_))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  const CharsProxy *chars_proxy_;  ///< 待查询的汉字代理数组
+  int length_;  ///< 长度
+};
+
+/**
+ * 模糊掩码匹配策略.
+ * 预先把每个位置上可接受的主、副部件取为位掩码(整体左移一位，
+ * 第0位表示没有该部件)，比较时每个部件只需一次移位和测试. \n
+ */
+class MaskFuzzyMatchPolicy {
+ public:
+  MaskFuzzyMatchPolicy(const FuzzyProfile *profile,
+                       const CharsProxy *chars_proxy, int length)
+      : length_(length) {
+    for (int count = 0; count < length; ++count) {
+      const CharsProxy *proxy = chars_proxy + count;
+      major_mask_[count] = profile->GetFuzzyMask(proxy->major_index_) << 1;
+      minor_mask_[count] = proxy->minor_index_ == -1 ? ~(uint64_t)0 :
+                               profile->GetFuzzyMask(proxy->minor_index_) << 1;
+    }
+  }
+
+  bool operator()(const CharsProxy *entry) const {
+    for (int count = 0; count < length_; ++count) {
+      if (!((major_mask_[count] >> ((entry + count)->major_index_ + 1)) & 1) ||
+          !((minor_mask_[count] >> ((entry + count)->minor_index_ + 1)) & 1))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  uint64_t major_mask_[MAX_MASK_LENGTH];  ///< 各位置可接受的主部件
+  uint64_t minor_mask_[MAX_MASK_LENGTH];  ///< 各位置可接受的副部件
+  int length_;  ///< 长度
+};
+
+/**
+ * 配置匹配策略.
+ * 长度超出模糊掩码策略的容量时，每次比较直接读取模糊拼音配置的掩码. \n
+ */
+class ProfileMatchPolicy {
+ public:
+  ProfileMatchPolicy(const FuzzyProfile *profile,
+                     const CharsProxy *chars_proxy, int length)
+      : profile_(profile), chars_proxy_(chars_proxy), length_(length) {}
+
+  bool operator()(const CharsProxy *entry) const {
+    for (int count = 0; count < length_; ++count) {
+      const CharsProxy *proxy = chars_proxy_ + count;
+      /* 主部件 */
+      uint64_t mask = profile_->GetFuzzyMask(proxy->major_index_);
+      if (!((mask >> (entry + count)->major_index_) & 1))
+        return false;
+      /* 副部件 */
+      if (proxy->minor_index_ == -1)
+        continue;
+      int8_t minor_index = (entry + count)->minor_index_;
+      mask = profile_->GetFuzzyMask(proxy->minor_index_);
+      if (minor_index == -1 || !((mask >> minor_index) & 1))
+        return false;
+    }
+    return true;
+  }
+
+ private:
+  const FuzzyProfile *profile_;  ///< 模糊拼音配置
+  const CharsProxy *chars_proxy_;  ///< 待查询的汉字代理数组
+  int length_;  ///< 长度
+};
+
+/**
+ * 分块扫描任务.
+ * 块按词语序号由高到低编号，块号越小越靠前. 某块找到匹配项后，
+ * 块号更大的块已不可能给出结果，它们会尽早放弃扫描. \n
+ */
+template <typename Policy>
+class PhraseScanTask : public ThreadTask {
+ public:
+  PhraseScanTask()
+      : policy_(NULL), entry_(NULL), length_(0), begin_(0), number_(0),
+        chunk_(0), found_chunk_(NULL), found_(false) {}
+  virtual ~PhraseScanTask() {}
+
+  /**
+   * 自块尾向块首扫描，直到找到第一个匹配项.
+   */
+  virtual void Run() {
+    while (number_ > begin_) {
+      if ((number_ & (SCAN_ABORT_INTERVAL - 1)) == 0) {
+        int found_chunk = __atomic_load_n(found_chunk_, __ATOMIC_ACQUIRE);
+        if (found_chunk != -1 && found_chunk < chunk_)
+          return;
+      }
+      uint number = --number_;
+      if ((*policy_)(entry_ + length_ * number)) {
+        found_ = true;
+        /* 记录已找到匹配项的最小块号 */
+        int expect = -1;
+        while (true) {
+          int found_chunk =
+              __sync_val_compare_and_swap(found_chunk_, expect, chunk_);
+          if (found_chunk == expect ||
+              (found_chunk != -1 && found_chunk < chunk_))
+            break;
+          expect = found_chunk;
+        }
+        return;
+      }
+    }
+  }
+
+  const Policy *policy_;  ///< 匹配策略
+  const CharsProxy *entry_;  ///< 长度节点的汉字代理数组
+  int length_;  ///< 长度
+  uint begin_;  ///< 块首的词语序号
+  uint number_;  ///< 块内尚未检查的词语的上界，找到后为匹配项的序号
+  int chunk_;  ///< 块号
+  int *found_chunk_;  ///< 已找到匹配项的最小块号(尚未找到为-1)
+  bool found_;  ///< 是否找到
+};
+
+/**
+ * 创建词语数据，汉字代理数组及原始数据的空间一并分配.
+ * @param arena 临时内存区(NULL 由堆分配)
+ * @param chars_proxy_length 汉字代理数组的长度
+ * @param raw_data_length 原始数据的长度
+ * @return 词语数据
+ */
+PhraseDatum *PhraseDatum::Create(PhraseArena *arena, int chars_proxy_length,
+                                 int raw_data_length) {
+  PhraseDatum *phrase_datum = new (arena) PhraseDatum;
+  phrase_datum->chars_proxy_ =
+      PhraseArena::NewArray<CharsProxy>(arena, chars_proxy_length);
+  phrase_datum->chars_proxy_length_ = chars_proxy_length;
+  phrase_datum->raw_data_ =
+      arena ? arena->Alloc(raw_data_length) : malloc(raw_data_length);
+  phrase_datum->raw_data_length_ = raw_data_length;
+  return phrase_datum;
+}
+
+/**
+ * 复制词语数据.
+ * @param arena 临时内存区(NULL 由堆分配)
+ * @return 新词语数据，汉字代理数组及原始数据均为自有的副本
+ */
+PhraseDatum *PhraseDatum::Clone(PhraseArena *arena) const {
+  PhraseDatum *phrase_datum = Create(arena, chars_proxy_length_,
+                                     raw_data_length_);
+  memcpy(phrase_datum->chars_proxy_, chars_proxy_,
+         sizeof(CharsProxy) * chars_proxy_length_);
+  memcpy(phrase_datum->raw_data_, raw_data_, raw_data_length_);
+  phrase_datum->phrase_data_offset_ = phrase_data_offset_;
+  return phrase_datum;
+}
+
+/* 下一个模糊拼音配置的序号 */
+static uint profile_serial = 0;
+
+/**
+ * 类构造函数.
+ * 新配置不含任何模糊拼音对，每个部件只与自身相匹配. \n
+ */
+FuzzyProfile::FuzzyProfile()
+    : serial_(__sync_add_and_fetch(&profile_serial, 1)), fuzzy_(false),
+      reference_(1) {
+  PinyinParser pinyin_parser;
+  int8_t amount = pinyin_parser.GetPinyinUnitPartsAmount();
+  memset(fuzzy_mask_, 0, sizeof(fuzzy_mask_));
+  for (int8_t count = 0; count < amount; ++count)
+    *(fuzzy_mask_ + count) = (uint64_t)1 << count;
+}
+
+/**
+ * 类复制构造函数.
+ * 新配置的序号与源配置不同. \n
+ * @param profile 源配置
+ */
+FuzzyProfile::FuzzyProfile(const FuzzyProfile &profile)
+    : serial_(__sync_add_and_fetch(&profile_serial, 1)),
+      fuzzy_(profile.fuzzy_), reference_(1) {
+  memcpy(fuzzy_mask_, profile.fuzzy_mask_, sizeof(fuzzy_mask_));
+}
+
+/**
+ * 创建在本配置的基础上增加一个模糊拼音对的新配置.
+ * 本配置保持不变. \n
+ * @param unit1 拼音单元部件1
+ * @param unit2 拼音单元部件2
+ * @return 新配置，部件无效时为NULL
+ */
+FuzzyProfile *FuzzyProfile::AppendFuzzyPair(const char *unit1,
+                                            const char *unit2) const {
+  /* 获取索引值 */
+  PinyinParser pinyin_parser;
+  int8_t index1 = pinyin_parser.GetPinyinUnitPartsIndex(unit1);
+  int8_t index2 = pinyin_parser.GetPinyinUnitPartsIndex(unit2);
+  if (index1 == -1 || index2 == -1)
+    return NULL;
+
+  /* 模糊关系总是对称的 */
+  FuzzyProfile *profile = new FuzzyProfile(*this);
+  *(profile->fuzzy_mask_ + index1) |= (uint64_t)1 << index2;
+  *(profile->fuzzy_mask_ + index2) |= (uint64_t)1 << index1;
+  if (index1 != index2)
+    profile->fuzzy_ = true;
+  return profile;
+}
+
+/**
+ * 获取可与某部件相匹配的所有部件.
+ * 部件自身总是排在第一位，其余按索引值由小到大排列. \n
+ * @param index 部件的索引值
+ * @param index_list 索引值表(以-1结束)，至少能容纳MAX_PINYIN_PARTS+1项
+ * @return 部件数量
+ */
+int FuzzyProfile::GetFuzzyIndex(int8_t index, int8_t *index_list) const {
+  int amount = 0;
+  *(index_list + amount++) = index;
+  uint64_t mask = *(fuzzy_mask_ + index) & ~((uint64_t)1 << index);
+  for (; mask != 0; mask &= mask - 1)
+    *(index_list + amount++) = __builtin_ctzll(mask);
+  *(index_list + amount) = -1;
+  return amount;
+}
+
+/**
+ * 判断两个配置的模糊关系是否完全相同.
+ * 序号不参与比较. \n
+ * @param profile 另一个配置
+ * @return BOOL
+ */
+bool FuzzyProfile::IsSameFuzzy(const FuzzyProfile *profile) const {
+  return memcmp(fuzzy_mask_, profile->fuzzy_mask_, sizeof(fuzzy_mask_)) == 0;
+}
+
+/**
+ * 类构造函数.
+ * 每个分支都会预先扫描到第一个匹配项. \n
+ * @param phrase 词语类
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param arena 分配本游标的临时内存区(NULL 由堆分配)
+ */
+PhraseCursor::PhraseCursor(AbstractPhrase *phrase, const FuzzyProfile *profile,
+                           const CharsProxy *chars_proxy,
+                           int chars_proxy_length, PhraseArena *arena)
+    : arena_(arena), phrase_(phrase), profile_(profile), chars_proxy_(NULL),
+      chars_proxy_length_(chars_proxy_length), branch_(NULL),
+      branch_amount_(0), limit_table_(NULL), heap_(arena), tick_(0) {
+  profile_->Ref();
+  chars_proxy_ = PhraseArena::NewArray<CharsProxy>(arena_, chars_proxy_length);
+  memcpy(chars_proxy_, chars_proxy, sizeof(CharsProxy) * chars_proxy_length);
+
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  branch_amount_ = profile_->GetFuzzyIndex(chars_proxy->major_index_,
+                                           index_list);
+  limit_table_ = PhraseArena::NewArray<uint>(
+                     arena_, branch_amount_ * chars_proxy_length_);
+  memset(limit_table_, 0xff,
+         sizeof(uint) * branch_amount_ * chars_proxy_length_);
+  OpenBranches(index_list);
+}
+
+/**
+ * 类析构函数.
+ */
+PhraseCursor::~PhraseCursor() {
+  PhraseArena::DeleteArray(arena_, chars_proxy_);
+  PhraseArena::DeleteArray(arena_, branch_);
+  PhraseArena::DeleteArray(arena_, limit_table_);
+  profile_->Unref();
+}
+
+/**
+ * 复制游标.
+ * 新游标与本游标的扫描进度完全相同，此后二者互不影响. \n
+ * @param arena 分配新游标的临时内存区(NULL 由堆分配)
+ * @return 新游标
+ */
+PhraseCursor *PhraseCursor::Clone(PhraseArena *arena) const {
+  return new (arena) PhraseCursor(*this, arena);
+}
+
+/**
+ * 由本游标派生新查询的游标.
+ * 新查询的前若干个汉字代理细化了本游标的查询时，这些长度下本游标打开时
+ * 已排除的词语对新查询同样不匹配，新游标直接从本游标到达的位置开始扫描；
+ * 更长的长度则重新扫描. 本游标此后被取走了多少词语不影响结果. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 新查询的汉字代理数组
+ * @param chars_proxy_length 新查询的汉字代理数组的有效长度
+ * @param arena 分配新游标的临时内存区(NULL 由堆分配)
+ * @return 新游标，模糊拼音配置不同或第一个汉字代理未被细化时为NULL
+ */
+PhraseCursor *PhraseCursor::Refine(const FuzzyProfile *profile,
+                                   const CharsProxy *chars_proxy,
+                                   int chars_proxy_length,
+                                   PhraseArena *arena) const {
+  if (profile != profile_)
+    return NULL;
+  int length = chars_proxy_length < chars_proxy_length_ ?
+                   chars_proxy_length : chars_proxy_length_;
+  int refined_length = 0;
+  while (refined_length < length &&
+         IsRefinedCharsProxy(chars_proxy + refined_length,
+                             chars_proxy_ + refined_length))
+    ++refined_length;
+  if (refined_length == 0)
+    return NULL;
+  return new (arena) PhraseCursor(*this, chars_proxy, chars_proxy_length,
+                                  refined_length, arena);
+}
+
+/**
+ * 释放游标.
+ * 由临时内存区分配的游标只析构，内存随内存区回卷. \n
+ */
+void PhraseCursor::Release() {
+  if (arena_)
+    this->~PhraseCursor();
+  else
+    delete this;
+}
+
+/**
+ * 类复制构造函数.
+ * @param cursor 源游标
+ * @param arena 分配本游标的临时内存区(NULL 由堆分配)
+ */
+PhraseCursor::PhraseCursor(const PhraseCursor &cursor, PhraseArena *arena)
+    : arena_(arena), phrase_(cursor.phrase_), profile_(cursor.profile_),
+      chars_proxy_(NULL), chars_proxy_length_(cursor.chars_proxy_length_),
+      branch_(NULL), branch_amount_(cursor.branch_amount_),
+      limit_table_(NULL), heap_(arena), tick_(cursor.tick_) {
+  profile_->Ref();
+  chars_proxy_ = PhraseArena::NewArray<CharsProxy>(arena_,
+                                                   chars_proxy_length_);
+  memcpy(chars_proxy_, cursor.chars_proxy_,
+         sizeof(CharsProxy) * chars_proxy_length_);
+  limit_table_ = PhraseArena::NewArray<uint>(
+                     arena_, branch_amount_ * chars_proxy_length_);
+  memcpy(limit_table_, cursor.limit_table_,
+         sizeof(uint) * branch_amount_ * chars_proxy_length_);
+  branch_ = PhraseArena::NewArray<PhraseCursorBranch>(arena_,
+                                                      branch_amount_);
+  for (int count = 0; count < branch_amount_; ++count) {
+    *(branch_ + count) = *(cursor.branch_ + count);
+    (branch_ + count)->limit_ = limit_table_ + chars_proxy_length_ * count;
+  }
+  heap_.Assign(cursor.heap_, cursor.branch_, branch_);
+}
+
+/**
+ * 类构造函数，由源游标派生.
+ * 新查询与源查询的第一个汉字代理主部件相同，因此分支也完全相同. \n
+ * @param origin 源游标
+ * @param chars_proxy 新查询的汉字代理数组
+ * @param chars_proxy_length 新查询的汉字代理数组的有效长度
+ * @param refined_length 被细化的汉字代理数量
+ * @param arena 分配本游标的临时内存区(NULL 由堆分配)
+ */
+PhraseCursor::PhraseCursor(const PhraseCursor &origin,
+                           const CharsProxy *chars_proxy,
+                           int chars_proxy_length, int refined_length,
+                           PhraseArena *arena)
+    : arena_(arena), phrase_(origin.phrase_), profile_(origin.profile_),
+      chars_proxy_(NULL), chars_proxy_length_(chars_proxy_length),
+      branch_(NULL), branch_amount_(origin.branch_amount_),
+      limit_table_(NULL), heap_(arena), tick_(0) {
+  profile_->Ref();
+  chars_proxy_ = PhraseArena::NewArray<CharsProxy>(arena_, chars_proxy_length);
+  memcpy(chars_proxy_, chars_proxy, sizeof(CharsProxy) * chars_proxy_length);
+
+  /* 被细化的长度沿用源游标的上限，其余长度不限制 */
+  limit_table_ = PhraseArena::NewArray<uint>(
+                     arena_, branch_amount_ * chars_proxy_length_);
+  memset(limit_table_, 0xff,
+         sizeof(uint) * branch_amount_ * chars_proxy_length_);
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  for (int count = 0; count < branch_amount_; ++count) {
+    index_list[count] = (origin.branch_ + count)->index_;
+    memcpy(limit_table_ + chars_proxy_length_ * count,
+           origin.limit_table_ + origin.chars_proxy_length_ * count,
+           sizeof(uint) * refined_length);
+  }
+  index_list[branch_amount_] = -1;
+  OpenBranches(index_list);
+}
+
+/**
+ * 打开各分支，并记下各分支打开时在各长度下扫描到的位置.
+ * 找到第一个匹配项之前扫描过的长度已被完全排除，匹配项本身仍需检查. \n
+ * @param index_list 各分支的索引值
+ */
+void PhraseCursor::OpenBranches(const int8_t *index_list) {
+  branch_ = PhraseArena::NewArray<PhraseCursorBranch>(arena_,
+                                                      branch_amount_);
+  heap_.Reserve(branch_amount_);
+  for (; tick_ < (uint)branch_amount_; ++tick_) {
+    PhraseCursorBranch *branch = branch_ + tick_;
+    uint *limit = limit_table_ + chars_proxy_length_ * tick_;
+    branch->index_ = *(index_list + tick_);
+    branch->limit_ = limit;
+    branch->valid_ = phrase_->SearchNextPhrase(profile_, chars_proxy_,
+                                               chars_proxy_length_,
+                                               branch, &branch->front_);
+    int length = branch->valid_ ? branch->length_ : 0;
+    for (int count = length; count < chars_proxy_length_; ++count)
+      *(limit + count) = 0;
+    if (branch->valid_) {
+      *(limit + length - 1) = branch->number_ + 1;
+      heap_.Push(branch, tick_);
+    }
+  }
+}
+
+/**
+ * 获取下一个词语数据代理.
+ * 匹配长度越长越优先，其次频率越高越优先；二者都相同时，
+ * 最久未被选中的分支优先，各分支因此轮流给出词语. \n
+ * @param phrase_proxy 词语数据代理
+ * @return 是否还有词语
+ */
+bool PhraseCursor::Next(PhraseProxy *phrase_proxy) {
+  PhraseCursorBranch *branch = heap_.Top();
+  if (!branch)
+    return false;
+
+  /* 取出词语，并将本分支推进到下一个匹配项 */
+  *phrase_proxy = branch->front_;
+  branch->valid_ = phrase_->SearchNextPhrase(profile_, chars_proxy_,
+                                             chars_proxy_length_, branch,
+                                             &branch->front_);
+  if (branch->valid_)
+    heap_.UpdateTop(tick_++);
+  else
+    heap_.Pop();
+
+  return true;
+}
+
+/**
+ * 设置扫描线程池.
+ * @param scan_pool 线程池，NULL表示始终在调用线程中扫描
+ */
+void AbstractPhrase::SetScanPool(ThreadPool *scan_pool) {
+  scan_pool_ = scan_pool;
+}
+
+/**
+ * 在长度节点中由高到低查找下一个匹配项.
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 待查询的汉字代理数组
+ * @param entry 长度节点的汉字代理数组
+ * @param length 长度
+ * @param number 尚未检查的词语数量，找到后为匹配项的序号，否则为0
+ * @return 是否找到
+ */
+bool AbstractPhrase::SearchMatchEntry(const FuzzyProfile *profile,
+                                      const CharsProxy *chars_proxy,
+                                      const CharsProxy *entry, int length,
+                                      uint *number) {
+  return SearchMatchEntry(profile, chars_proxy, entry, NULL, 0, length,
+                          number);
+}
+
+/**
+ * 在长度节点中由高到低查找下一个匹配项，若有精确索引则先尝试改写查询.
+ * 匹配策略依据模糊拼音配置及查询是否给出了全部副部件而定，
+ * 各策略的查询过程都是单独实例化的. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 待查询的汉字代理数组
+ * @param entry 长度节点的汉字代理数组
+ * @param exact_index 精确索引(没有为NULL)
+ * @param amount 长度节点的词语数量
+ * @param length 长度
+ * @param number 尚未检查的词语数量，找到后为匹配项的序号，否则为0
+ * @return 是否找到
+ */
+bool AbstractPhrase::SearchMatchEntry(const FuzzyProfile *profile,
+                                      const CharsProxy *chars_proxy,
+                                      const CharsProxy *entry,
+                                      const uint *exact_index, uint amount,
+                                      int length, uint *number) {
+  if (profile->IsFuzzy()) {
+    if (length <= MAX_MASK_LENGTH) {
+      MaskFuzzyMatchPolicy policy(profile, chars_proxy, length);
+      return MatchEntry(policy, profile, chars_proxy, entry, exact_index,
+                        amount, length, number);
+    }
+    ProfileMatchPolicy policy(profile, chars_proxy, length);
+    return MatchEntry(policy, profile, chars_proxy, entry, exact_index,
+                      amount, length, number);
+  }
+
+  int count = 0;
+  for (; count < length; ++count) {
+    if ((chars_proxy + count)->minor_index_ == -1)
+      break;
+  }
+  if (count == length) {
+    ExactMatchPolicy policy(chars_proxy, length);
+    return MatchEntry(policy, profile, chars_proxy, entry, exact_index,
+                      amount, length, number);
+  }
+  PartialFinalMatchPolicy policy(chars_proxy, length);
+  return MatchEntry(policy, profile, chars_proxy, entry, exact_index, amount,
+                    length, number);
+}
+
+/**
+ * 统计长度节点中与汉字代理数组相匹配的词语数量.
+ * 有精确索引时只需检查改写所得的区间，区间的键值已完全给定时无需逐个检查. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 待查询的汉字代理数组
+ * @param entry 长度节点的汉字代理数组
+ * @param exact_index 精确索引(没有为NULL)
+ * @param amount 长度节点的词语数量
+ * @param length 长度
+ * @return 词语数量
+ */
+uint AbstractPhrase::CountMatchEntry(const FuzzyProfile *profile,
+                                     const CharsProxy *chars_proxy,
+                                     const CharsProxy *entry,
+                                     const uint *exact_index, uint amount,
+                                     int length) {
+  if (profile->IsFuzzy()) {
+    if (length <= MAX_MASK_LENGTH) {
+      MaskFuzzyMatchPolicy policy(profile, chars_proxy, length);
+      return CountEntry(policy, profile, chars_proxy, entry, exact_index,
+                        amount, length);
+    }
+    ProfileMatchPolicy policy(profile, chars_proxy, length);
+    return CountEntry(policy, profile, chars_proxy, entry, exact_index,
+                      amount, length);
+  }
+
+  int count = 0;
+  for (; count < length; ++count) {
+    if ((chars_proxy + count)->minor_index_ == -1)
+      break;
+  }
+  if (count == length) {
+    ExactMatchPolicy policy(chars_proxy, length);
+    return CountEntry(policy, profile, chars_proxy, entry, exact_index,
+                      amount, length);
+  }
+  PartialFinalMatchPolicy policy(chars_proxy, length);
+  return CountEntry(policy, profile, chars_proxy, entry, exact_index, amount,
+                    length);
+}
+
+/**
+ * 将词语数据代理按频率插入某长度下的候选数组.
+ * 数组按频率降序排列，空位(长度为0)在后；频率相同时先插入者在前. \n
+ * @param span 候选数组
+ * @param width 候选数组的容量
+ * @param phrase_proxy 词语数据代理
+ * @return 是否被插入
+ */
+bool AbstractPhrase::InsertPreferSpan(PhraseProxy *span, int width,
+                                      const PhraseProxy *phrase_proxy) {
+  int position = 0;
+  while (position < width && (span + position)->chars_proxy_length_ != 0 &&
+         (span + position)->frequency_ >= phrase_proxy->frequency_)
+    ++position;
+  if (position == width)
+    return false;
+  for (int count = width - 1; count > position; --count)
+    *(span + count) = *(span + count - 1);
+  *(span + position) = *phrase_proxy;
+  return true;
+}
+
+/**
+ * 建立长度节点的精确索引.
+ * @param entry 长度节点的汉字代理数组
+ * @param amount 词语数量
+ * @param length 长度
+ * @return 按(汉字代理数组,序号)排好序的词语序号数组
+ */
+uint *AbstractPhrase::BuildExactIndex(const CharsProxy *entry, uint amount,
+                                      int length) {
+  uint *exact_index = new uint[amount];
+  for (uint count = 0; count < amount; ++count)
+    *(exact_index + count) = count;
+  std::sort(exact_index, exact_index + amount, ExactIndexCmp(entry, length));
+  return exact_index;
+}
+
+/**
+ * 按匹配策略查找下一个匹配项.
+ * @param policy 匹配策略
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 待查询的汉字代理数组
+ * @param entry 长度节点的汉字代理数组
+ * @param exact_index 精确索引(没有为NULL)
+ * @param amount 长度节点的词语数量
+ * @param length 长度
+ * @param number 尚未检查的词语数量，找到后为匹配项的序号，否则为0
+ * @return 是否找到
+ */
+template <typename Policy>
+bool AbstractPhrase::MatchEntry(const Policy &policy,
+                                const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                const CharsProxy *entry,
+                                const uint *exact_index, uint amount,
+                                int length, uint *number) {
+  if (exact_index && *number != 0) {
+    int result = ProbeMatchEntry(policy, profile, chars_proxy, entry,
+                                 exact_index, amount, length, number);
+    if (result != -1)
+      return result == 1;
+  }
+  return ScanMatchEntry(policy, entry, length, number);
+}
+
+/**
+ * 按匹配策略统计相匹配的词语数量.
+ * @param policy 匹配策略
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 待查询的汉字代理数组
+ * @param entry 长度节点的汉字代理数组
+ * @param exact_index 精确索引(没有为NULL)
+ * @param amount 长度节点的词语数量
+ * @param length 长度
+ * @return 词语数量
+ */
+template <typename Policy>
+uint AbstractPhrase::CountEntry(const Policy &policy,
+                                const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                const CharsProxy *entry,
+                                const uint *exact_index, uint amount,
+                                int length) {
+  if (amount == 0)
+    return 0;
+
+  /* 借助精确索引统计 */
+  if (exact_index) {
+    uint range_begin[MAX_QUERY_VARIANT], range_end[MAX_QUERY_VARIANT];
+    uint ranges = 0;
+    int parts = LocateMatchRange(profile, chars_proxy, entry, exact_index,
+                                 amount, length, amount, range_begin,
+                                 range_end, &ranges);
+    if (parts != -1) {
+      uint total = 0;
+      for (uint count = 0; count < ranges; ++count) {
+        if (parts == length * 2) {
+          total += range_end[count] - range_begin[count];
+          continue;
+        }
+        for (uint position = range_begin[count]; position < range_end[count];
+             ++position) {
+          if (policy(entry + length * *(exact_index + position)))
+            ++total;
+        }
+      }
+      return total;
+    }
+  }
+
+  /* 逐个检查 */
+  uint total = 0;
+  for (uint number = 0; number < amount; ++number) {
+    if (policy(entry + length * number))
+      ++total;
+  }
+  return total;
+}
+
+/**
+ * 由高到低扫描长度节点.
+ * 先在调用线程中扫描最靠前的一块，匹配项通常就在其中；
+ * 若仍未找到且剩余词语足够多，则其余部分分块交给扫描线程池. \n
+ * @param policy 匹配策略
+ * @param entry 长度节点的汉字代理数组
+ * @param length 长度
+ * @param number 尚未检查的词语数量，找到后为匹配项的序号，否则为0
+ * @return 是否找到
+ */
+template <typename Policy>
+bool AbstractPhrase::ScanMatchEntry(const Policy &policy,
+                                    const CharsProxy *entry, int length,
+                                    uint *number) {
+  uint limit = 0;
+  if (scan_pool_ && *number >= SCAN_CHUNK_LENGTH * 2)
+    limit = *number - SCAN_CHUNK_LENGTH;
+  while (*number > limit) {
+    uint current = --*number;
+    if (policy(entry + length * current))
+      return true;
+  }
+  if (*number == 0)
+    return false;
+  return ScanMatchEntryChunks(policy, entry, length, number);
+}
+
+/**
+ * 将剩余词语分块并行扫描.
+ * 结果总是整体上序号最高的匹配项，与顺序扫描完全一致；
+ * 各块的结果直接存放在栈上的任务对象中，合并时不分配内存. \n
+ * @param policy 匹配策略
+ * @param entry 长度节点的汉字代理数组
+ * @param length 长度
+ * @param number 尚未检查的词语数量，找到后为匹配项的序号，否则为0
+ * @return 是否找到
+ */
+template <typename Policy>
+bool AbstractPhrase::ScanMatchEntryChunks(const Policy &policy,
+                                          const CharsProxy *entry,
+                                          int length, uint *number) {
+  /* 计算分块数量 */
+  uint amount = *number;
+  int chunks = amount / SCAN_CHUNK_LENGTH;
+  if (chunks > MAX_SCAN_CHUNK)
+    chunks = MAX_SCAN_CHUNK;
+  if (chunks > scan_pool_->GetMaxThread() + 1)
+    chunks = scan_pool_->GetMaxThread() + 1;
+  if (chunks < 1)
+    chunks = 1;
+
+  /* 划分并执行扫描任务 */
+  PhraseScanTask<Policy> tasks[MAX_SCAN_CHUNK];
+  ThreadTask *task_array[MAX_SCAN_CHUNK];
+  int found_chunk = -1;
+  uint step = amount / chunks;
+  for (int count = 0; count < chunks; ++count) {
+    PhraseScanTask<Policy> *task = tasks + count;
+    task->policy_ = &policy;
+    task->entry_ = entry;
+    task->length_ = length;
+    task->number_ = amount - step * count;
+    task->begin_ = count == chunks - 1 ? 0 : task->number_ - step;
+    task->chunk_ = count;
+    task->found_chunk_ = &found_chunk;
+    task_array[count] = task;
+  }
+  scan_pool_->RunTasks(task_array, chunks);
+
+  /* 块号最小的结果即为序号最高的匹配项 */
+  for (int count = 0; count < chunks; ++count) {
+    if ((tasks + count)->found_) {
+      *number = (tasks + count)->number_;
+      return true;
+    }
+  }
+  *number = 0;
+  return false;
+}
+
+/**
+ * 将查询改写为若干精确的键值前缀，并定位各前缀在精确索引中的区间.
+ * 第一个未给出副部件的汉字代理之前的各部件都展开为精确的取值，
+ * 每种组合(变体)在精确索引中对应一个连续区间. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 待查询的汉字代理数组
+ * @param entry 长度节点的汉字代理数组
+ * @param exact_index 精确索引
+ * @param amount 长度节点的词语数量
+ * @param length 长度
+ * @param max_entry 各区间的词语总数上限
+ * @param range_begin 区间的起始位置数组，至少能容纳MAX_QUERY_VARIANT项
+ * @param range_end 区间的结束位置数组，至少能容纳MAX_QUERY_VARIANT项
+ * @param ranges 非空区间的数量
+ * @return 展开的部件数量，变体过多或词语总数超出上限时为-1
+ */
+int AbstractPhrase::LocateMatchRange(const FuzzyProfile *profile,
+                                     const CharsProxy *chars_proxy,
+                                     const CharsProxy *entry,
+                                     const uint *exact_index, uint amount,
+                                     int length, uint max_entry,
+                                     uint *range_begin, uint *range_end,
+                                     uint *ranges) {
+  /* 确定需要展开的部件及其取值表 */
+  int parts = 0;
+  while (parts / 2 < length) {
+    if (parts % 2 == 1 && (chars_proxy + parts / 2)->minor_index_ == -1)
+      break;
+    ++parts;
+  }
+  if (parts > MAX_PROBE_PART)
+    return -1;
+  int8_t part_list[MAX_PROBE_PART][MAX_PINYIN_PARTS + 1];
+  uint variants = 1;
+  for (int count = 0; count < parts; ++count) {
+    const CharsProxy *proxy = chars_proxy + count / 2;
+    uint size = 1;
+    if (count == 0) {  // 本节点的首个主部件
+      part_list[count][0] = entry->major_index_;
+      part_list[count][1] = -1;
+    } else if (count % 2 == 0) {
+      size = profile->GetFuzzyIndex(proxy->major_index_, part_list[count]);
+    } else {
+      size = profile->GetFuzzyIndex(proxy->minor_index_, part_list[count]);
+    }
+    variants *= size;
+    if (variants > MAX_QUERY_VARIANT)
+      return -1;
+  }
+
+  /* 定位各变体在精确索引中的区间 */
+  uint total = 0;
+  *ranges = 0;
+  int position[MAX_PROBE_PART];
+  CharsProxy key[MAX_PROBE_PART / 2 + 1];
+  memset(position, 0, sizeof(position));
+  for (uint count = 0; count < variants; ++count) {
+    for (int part = 0; part < parts; ++part) {
+      int8_t value = *(part_list[part] + position[part]);
+      if (part % 2 == 0)
+        key[part / 2].major_index_ = value;
+      else
+        key[part / 2].minor_index_ = value;
+    }
+    uint begin = 0, end = amount;
+    while (begin < end) {  // 下界
+      uint middle = begin + (end - begin) / 2;
+      if (CompareCharsProxy(entry + length * *(exact_index + middle), key,
+                            parts) < 0)
+        begin = middle + 1;
+      else
+        end = middle;
+    }
+    *(range_begin + *ranges) = begin;
+    end = amount;
+    while (begin < end) {  // 上界
+      uint middle = begin + (end - begin) / 2;
+      if (CompareCharsProxy(entry + length * *(exact_index + middle), key,
+                            parts) <= 0)
+        begin = middle + 1;
+      else
+        end = middle;
+    }
+    *(range_end + *ranges) = begin;
+    total += *(range_end + *ranges) - *(range_begin + *ranges);
+    if (total > max_entry)
+      return -1;
+    if (*(range_end + *ranges) > *(range_begin + *ranges))
+      ++*ranges;
+    /* 下一个变体 */
+    for (int part = parts - 1; part >= 0; --part) {
+      if (*(part_list[part] + ++position[part]) != -1)
+        break;
+      position[part] = 0;
+    }
+  }
+
+  return parts;
+}
+
+/**
+ * 改写查询并借助精确索引查找下一个匹配项.
+ * 改写所得的各区间内键值相同的词语序号递增，因此每组只需一次二分查找. 模糊关系总是对称的，
+ * 所以展开的变体恰好覆盖所有可能匹配的词语，结果与顺序扫描完全一致. \n
+ * @param policy 匹配策略
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 待查询的汉字代理数组
+ * @param entry 长度节点的汉字代理数组
+ * @param exact_index 精确索引
+ * @param amount 长度节点的词语数量
+ * @param length 长度
+ * @param number 尚未检查的词语数量，找到后为匹配项的序号，否则为0
+ * @return 1 找到,0 没有匹配项,-1 变体过多，需要退回扫描
+ */
+template <typename Policy>
+int AbstractPhrase::ProbeMatchEntry(const Policy &policy,
+                                    const FuzzyProfile *profile,
+                                    const CharsProxy *chars_proxy,
+                                    const CharsProxy *entry,
+                                    const uint *exact_index, uint amount,
+                                    int length, uint *number) {
+  uint range_begin[MAX_QUERY_VARIANT], range_end[MAX_QUERY_VARIANT];
+  uint ranges = 0;
+  if (LocateMatchRange(profile, chars_proxy, entry, exact_index, amount,
+                       length, MAX_PROBE_ENTRY, range_begin, range_end,
+                       &ranges) == -1)
+    return -1;
+
+  /* 在各区间中逐组查找序号小于上界的最大匹配项 */
+  uint limit = *number;
+  bool found = false;
+  for (uint count = 0; count < ranges; ++count) {
+    uint group = range_begin[count];
+    while (group < range_end[count]) {
+      const CharsProxy *group_key = entry + length * *(exact_index + group);
+      uint begin = group + 1, end = range_end[count];
+      while (begin < end) {  // 本组的结束位置
+        uint middle = begin + (end - begin) / 2;
+        if (CompareCharsProxy(entry + length * *(exact_index + middle),
+                              group_key, length * 2) == 0)
+          begin = middle + 1;
+        else
+          end = middle;
+      }
+      uint group_end = begin;
+      if (policy(group_key)) {
+        begin = group;
+        end = group_end;
+        while (begin < end) {  // 第一个序号不小于上界的位置
+          uint middle = begin + (end - begin) / 2;
+          if (*(exact_index + middle) < limit)
+            begin = middle + 1;
+          else
+            end = middle;
+        }
+        if (begin > group) {
+          uint candidate = *(exact_index + begin - 1);
+          if (!found || candidate > *number) {
+            *number = candidate;
+            found = true;
+          }
+        }
+      }
+      group = group_end;
+    }
+  }
+  if (!found)
+    *number = 0;
+
+  return found ? 1 : 0;
+}
@@ -13,8 +13,11 @@
 #define PYE_ENGINE_ABSTRACT_PHRASE_H_
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <list>
+#include "merge_heap.h"
+#include "phrase_arena.h"
 #include "pinyin_parser.h"
 
 /**
@@ -30,7 +33,7 @@ class PhraseProxy {
   const CharsProxy *chars_proxy_;  ///< 词语的汉字代理数组 *
   int chars_proxy_length_;  ///< 词语的汉字代理数组的长度
   int phrase_data_offset_;  ///< 词语数据的偏移量
-  int frequency_;  ///< 词语的使用频率
+  int frequency_;  ///< 词语的使用频率(系统词语为量化频率)
 };
 
 /* 偏移量的特殊含义 */
@@ -41,6 +44,8 @@ class PhraseProxy {
 #define UserPhrasePoint 1
 /**
  * 词语数据资料.
+ * 由临时内存区创建的词语数据随内存区回卷而失效，不能delete；
+ * 其汉字代理数组及原始数据可能直接引用码表，需要长期保留时应先复制. \n
  */
 class PhraseDatum {
  public:
@@ -53,6 +58,10 @@ class PhraseDatum {
     free(raw_data_);
   }
 
+  static PhraseDatum *Create(PhraseArena *arena, int chars_proxy_length,
+                             int raw_data_length);
+  PhraseDatum *Clone(PhraseArena *arena) const;
+
   CharsProxy *chars_proxy_;  ///< 词语的汉字代理数组 *
   int chars_proxy_length_;  ///< 词语的汉字代理数组的长度
   void *raw_data_;  ///< 词语的原始数据 *
@@ -60,63 +69,250 @@ class PhraseDatum {
   int phrase_data_offset_;  ///< 词语数据的偏移量(特殊含义)
 };
 
+/* 拼音单元部件数量的上限，模糊掩码的每一位对应一个部件 */
+#define MAX_PINYIN_PARTS 64
+
+/**
+ * 模糊拼音配置.
+ * 每个拼音单元部件对应一个位掩码，第n位表示可与索引值为n的部件相互模糊，
+ * 各掩码连续存放. 配置一经创建便不再修改，由各编辑器、游标以引用计数的
+ * 方式共享，查询时既不复制也不加锁. \n
+ */
+class FuzzyProfile {
+ public:
+  FuzzyProfile();
+
+  FuzzyProfile *AppendFuzzyPair(const char *unit1, const char *unit2) const;
+  int GetFuzzyIndex(int8_t index, int8_t *index_list) const;
+  bool IsSameFuzzy(const FuzzyProfile *profile) const;
+
+  /**
+   * 增加引用计数.
+   */
+  void Ref() const {
+    __sync_add_and_fetch(&reference_, 1);
+  }
+  /**
+   * 减少引用计数，计数归零时销毁本配置.
+   */
+  void Unref() const {
+    if (__sync_sub_and_fetch(&reference_, 1) == 0)
+      delete this;
+  }
+  /**
+   * 是否存在模糊拼音对.
+   * @return BOOL
+   */
+  bool IsFuzzy() const {
+    return fuzzy_;
+  }
+  /**
+   * 获取部件的模糊掩码.
+   * @param index 部件的索引值
+   * @return 位掩码
+   */
+  uint64_t GetFuzzyMask(int8_t index) const {
+    return *(fuzzy_mask_ + index);
+  }
+  /**
+   * 获取配置的序号，每个配置的序号都不相同.
+   * @return 序号
+   */
+  uint GetSerial() const {
+    return serial_;
+  }
+
+ private:
+  FuzzyProfile(const FuzzyProfile &profile);
+  ~FuzzyProfile() {}
+
+  uint64_t fuzzy_mask_[MAX_PINYIN_PARTS];  ///< 各部件的模糊掩码
+  uint serial_;  ///< 序号
+  bool fuzzy_;  ///< 是否存在模糊拼音对
+  mutable int reference_;  ///< 引用计数
+};
+
+class AbstractPhrase;
+class ThreadPool;
+
+/**
+ * 词语游标的扫描分支.
+ * 每个分支对应一个(模糊)索引值，记录本索引值下的扫描进度. \n
+ */
+class PhraseCursorBranch {
+ public:
+  PhraseCursorBranch()
+      : index_(-1), length_(-1), number_(0), limit_(NULL), valid_(false) {}
+  ~PhraseCursorBranch() {}
+
+  /**
+   * 获取开始扫描某长度时尚未检查的词语数量.
+   * 序号不小于上限的词语已知不可能匹配，无需再检查. \n
+   * @param length 长度
+   * @param amount 本长度下的词语总数
+   * @return 词语数量
+   */
+  uint LimitNumber(int length, uint amount) const {
+    if (!limit_ || *(limit_ + length - 1) > amount)
+      return amount;
+    return *(limit_ + length - 1);
+  }
+
+  int8_t index_;  ///< 索引值
+  int length_;  ///< 正在扫描的长度(-1 尚未开始,0 扫描完毕)
+  uint number_;  ///< 本长度下尚未检查的词语数量(倒序扫描)
+  const uint *limit_;  ///< 各长度下尚未检查的词语数量的上限(NULL 不限制)
+  PhraseProxy front_;  ///< 本分支的下一个词语数据代理
+  bool valid_;  ///< front_是否有效
+};
+
+/**
+ * 扫描分支的比较器.
+ * 匹配长度越长越优先，其次频率越高越优先. \n
+ */
+class PhraseCursorBranchCmp {
+ public:
+  bool operator()(const PhraseCursorBranch *branch1,
+                  const PhraseCursorBranch *branch2) const {
+    if (branch1->front_.chars_proxy_length_ !=
+        branch2->front_.chars_proxy_length_)
+      return branch1->front_.chars_proxy_length_ >
+             branch2->front_.chars_proxy_length_;
+    return branch1->front_.frequency_ > branch2->front_.frequency_;
+  }
+};
+
+/**
+ * 词语游标.
+ * 按(匹配长度,词语频率,分支轮转)的次序逐个给出相匹配的词语数据代理，
+ * 每次调用只扫描到下一个匹配项为止，不为候选词语分配任何内存. \n
+ * 各分支以归并堆合并；长度与频率都相同时，最久未被选中的分支优先. \n
+ * 游标记下打开时各分支在各长度下扫描到的位置，新查询若只是细化了前若干个
+ * 汉字代理(如追加了拼音字符)，可由此游标派生，这些长度下已被排除的词语
+ * 不会再被检查. \n
+ * 游标及其各数组可由临时内存区分配，以Release()释放. \n
+ */
+class PhraseCursor {
+ public:
+  PhraseCursor(AbstractPhrase *phrase, const FuzzyProfile *profile,
+               const CharsProxy *chars_proxy, int chars_proxy_length,
+               PhraseArena *arena);
+  ~PhraseCursor();
+
+  PhraseCursor *Clone(PhraseArena *arena) const;
+  PhraseCursor *Refine(const FuzzyProfile *profile,
+                       const CharsProxy *chars_proxy, int chars_proxy_length,
+                       PhraseArena *arena) const;
+  bool Next(PhraseProxy *phrase_proxy);
+  void Release();
+
+ private:
+  PhraseCursor(const PhraseCursor &cursor, PhraseArena *arena);
+  PhraseCursor(const PhraseCursor &origin, const CharsProxy *chars_proxy,
+               int chars_proxy_length, int refined_length,
+               PhraseArena *arena);
+  void OpenBranches(const int8_t *index_list);
+
+  PhraseArena *arena_;  ///< 分配本游标的临时内存区(NULL 由堆分配)
+  AbstractPhrase *phrase_;  ///< 词语类
+  const FuzzyProfile *profile_;  ///< 模糊拼音配置(已被引用)
+  CharsProxy *chars_proxy_;  ///< 待查询的汉字代理数组 *
+  int chars_proxy_length_;  ///< 待查询的汉字代理数组的长度
+  PhraseCursorBranch *branch_;  ///< 扫描分支数组 *
+  int branch_amount_;  ///< 扫描分支数量
+  uint *limit_table_;  ///< 各分支在各长度下尚未检查的词语数量的上限 *
+  MergeHeap<PhraseCursorBranch, PhraseCursorBranchCmp> heap_;  ///< 归并堆
+  uint tick_;  ///< 选中计数，用作分支的轮转标记
+};
+
 /**
  * 抽象词语查询、管理者.
+ * 设置扫描线程池后，词语数量很多的长度节点会被分块并行扫描. \n
+ * 长度节点建有精确索引时，模糊查询先被改写为若干精确的键值前缀，
+ * 再借助精确索引直接定位；改写后的变体过多时仍退回扫描. 相匹配的词语数量
+ * 也可借此直接统计，无需逐个给出词语. \n
+ * 查询内核按匹配策略(精确、部分韵母、模糊掩码)分别实例化，
+ * 所用策略由每次查询给出的模糊拼音配置决定. \n
  */
 class AbstractPhrase {
  public:
-  AbstractPhrase() {}
+  AbstractPhrase() : scan_pool_(NULL) {}
   virtual ~AbstractPhrase() {}
 
-  virtual void BuildPhraseTree(const char *mbfile) = 0;
-  virtual void SetFuzzyPinyinTable(const int8_t **fuzzy_pair_table) = 0;
-  virtual std::list<PhraseProxy *> *SearchMatchablePhrase(
+  virtual bool BuildPhraseTree(const char *mbfile) = 0;
+  virtual PhraseCursor *OpenMatchCursor(const FuzzyProfile *profile,
                                         const CharsProxy *chars_proxy,
-                                        int chars_proxy_length) = 0;
-  virtual PhraseProxy *SearchPreferPhrase(const CharsProxy *chars_proxy,
+                                        int chars_proxy_length,
+                                        PhraseArena *arena) = 0;
+  virtual bool SearchNextPhrase(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length,
+                                PhraseCursorBranch *branch,
+                                PhraseProxy *phrase_proxy) = 0;
+  virtual PhraseProxy *SearchPreferPhrase(const FuzzyProfile *profile,
+                                          const CharsProxy *chars_proxy,
                                           int chars_proxy_length) = 0;
-  virtual PhraseDatum *AnalyzePhraseProxy(const PhraseProxy *phrase_proxy) = 0;
+  virtual void SearchPreferSpan(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length, int min_length,
+                                int width, PhraseProxy *span_array) = 0;
+  virtual uint SearchBigramWeight(const PhraseProxy *phrase_proxy1,
+                                  const PhraseProxy *phrase_proxy2) = 0;
+  virtual uint EstimateSearchCost(const FuzzyProfile *profile,
+                                  const CharsProxy *chars_proxy,
+                                  int chars_proxy_length) = 0;
+  virtual uint CountMatchPhrase(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length) = 0;
+  virtual PhraseDatum *AnalyzePhraseProxy(const PhraseProxy *phrase_proxy,
+                                          PhraseArena *arena) = 0;
+
+  void SetScanPool(ThreadPool *scan_pool);
 
  protected:
-  /**
-   * 检查两个汉字代理数组是否相匹配.
-   * @param table 对照表
-   * @param dst 目标
-   * @param src 源
-   * @param len 长度
-   * @return BOOL
-   */
-  bool CharsProxyCmp(const int8_t **table,
-                     const CharsProxy *dst,
-                     const CharsProxy *src,
-                     int len) {
-    int count = 0;
-    for (; count < len; ++count) {
-      /* 主部件 */
-      int8_t di = (dst + count)->major_index_;
-      const int8_t *sip = *(table + (src + count)->major_index_);
-      for (; *sip != -1; ++sip) {
-        if (*sip == di)
-          break;
-      }
-      if (*sip == -1)
-        break;
-      /* 副部件 */
-      if ((di = (dst + count)->minor_index_) == -1)
-        continue;
-      int8_t si = (src + count)->minor_index_;
-      if (si == -1)
-        break;
-      sip = *(table + si);
-      for (; *sip != -1; ++sip) {
-        if (*sip == di)
-          break;
-      }
-      if (*sip == -1)
-        break;
-    }
-    return count == len;
-  }
+  bool SearchMatchEntry(const FuzzyProfile *profile,
+                        const CharsProxy *chars_proxy,
+                        const CharsProxy *entry, int length, uint *number);
+  bool SearchMatchEntry(const FuzzyProfile *profile,
+                        const CharsProxy *chars_proxy,
+                        const CharsProxy *entry, const uint *exact_index,
+                        uint amount, int length, uint *number);
+  uint CountMatchEntry(const FuzzyProfile *profile,
+                       const CharsProxy *chars_proxy, const CharsProxy *entry,
+                       const uint *exact_index, uint amount, int length);
+  static uint *BuildExactIndex(const CharsProxy *entry, uint amount,
+                               int length);
+  static bool InsertPreferSpan(PhraseProxy *span, int width,
+                               const PhraseProxy *phrase_proxy);
+
+ private:
+  template <typename Policy>
+  bool MatchEntry(const Policy &policy, const FuzzyProfile *profile,
+                  const CharsProxy *chars_proxy, const CharsProxy *entry,
+                  const uint *exact_index, uint amount, int length,
+                  uint *number);
+  template <typename Policy>
+  bool ScanMatchEntry(const Policy &policy, const CharsProxy *entry,
+                      int length, uint *number);
+  template <typename Policy>
+  bool ScanMatchEntryChunks(const Policy &policy, const CharsProxy *entry,
+                            int length, uint *number);
+  template <typename Policy>
+  uint CountEntry(const Policy &policy, const FuzzyProfile *profile,
+                  const CharsProxy *chars_proxy, const CharsProxy *entry,
+                  const uint *exact_index, uint amount, int length);
+  int LocateMatchRange(const FuzzyProfile *profile,
+                       const CharsProxy *chars_proxy, const CharsProxy *entry,
+                       const uint *exact_index, uint amount, int length,
+                       uint max_entry, uint *range_begin, uint *range_end,
+                       uint *ranges);
+  template <typename Policy>
+  int ProbeMatchEntry(const Policy &policy, const FuzzyProfile *profile,
+                      const CharsProxy *chars_proxy, const CharsProxy *entry,
+                      const uint *exact_index, uint amount, int length,
+                      uint *number);
+
+  ThreadPool *scan_pool_;  ///< 分块扫描的线程池(未设置为NULL)
 };
 
 #endif  // PYE_ENGINE_ABSTRACT_PHRASE_H_
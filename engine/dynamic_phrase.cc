@@ -13,6 +13,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <time.h>
+#include <vector>
 #include "pinyin_parser.h"
 #include "pye_global.h"
 #include "pye_output.h"
@@ -162,7 +163,7 @@ PhraseDatum *DynamicPhrase::CreatePhraseDatum(const char *expression) const {
 
   /* 分解数据并替换动态部分 */
   size_t debris_data_length = 0;
-  std::list<char *> debris_list;
+  std::vector<char *> debris_list;
   char *data_expression = strdup(expression);
   const char *pptr = data_expression;
   for (char *ptr = data_expression; *ptr != '\0'; ++ptr) {
@@ -213,7 +214,7 @@ PhraseDatum *DynamicPhrase::CreatePhraseDatum(const char *expression) const {
                             &phrase_datum->chars_proxy_length_);
   phrase_datum->raw_data_ = malloc(debris_data_length + 1);
   char *ptr = (char *)phrase_datum->raw_data_;
-  for (std::list<char *>::iterator iterator = debris_list.begin();
+  for (std::vector<char *>::iterator iterator = debris_list.begin();
        iterator != debris_list.end();
        ++iterator) {
     strcpy(ptr, *iterator);
@@ -223,7 +224,7 @@ PhraseDatum *DynamicPhrase::CreatePhraseDatum(const char *expression) const {
   phrase_datum->phrase_data_offset_ = InvalidPhraseType;
 
   /* 释放数据 */
-  STL_FREE_DATA(debris_list, std::list<char *>);
+  STL_FREE_DATA(debris_list, std::vector<char *>);
 
   return phrase_datum;
 }
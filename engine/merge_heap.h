@@ -0,0 +1,209 @@
+//
+// C++ Interface: merge_heap
+//
+// Description:
+// 多路归并堆，用于合并多个已按优先次序排好的词语流.
+// 堆顶总是当前元素最优的流，取出元素后只需调整堆顶即可，
+// 因此每产出一个元素的代价为O(log k).
+//
+// Author: Jally <jallyx@163.com>, (C) 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef PYE_ENGINE_MERGE_HEAP_H_
+#define PYE_ENGINE_MERGE_HEAP_H_
+
+#include <sys/types.h>
+#include "phrase_arena.h"
+
+/**
+ * 多路归并堆.
+ * Compare(s1, s2)判定流s1的当前元素是否严格优先于s2的当前元素；
+ * 二者相同时，标记(tick)较小的流优先. 标记由调用者给出，
+ * 固定不变的标记得到稳定的次序，每次取出后递增的标记则得到轮转的次序. \n
+ */
+template <typename Stream, typename Compare>
+class MergeHeap {
+ public:
+  /**
+   * 类构造函数.
+   * @param arena 分配堆数组的临时内存区(NULL 由堆分配)
+   */
+  explicit MergeHeap(PhraseArena *arena = NULL)
+      : heap_(NULL), size_(0), capacity_(0), arena_(arena) {}
+  ~MergeHeap() {
+    PhraseArena::DeleteArray(arena_, heap_);
+  }
+
+  /**
+   * 预留空间.
+   * @param amount 流的数量
+   */
+  void Reserve(size_t amount) {
+    if (amount > capacity_)
+      Resize(amount);
+  }
+
+  /**
+   * 复制另一个堆.
+   * 流所在的数组被整体复制到别处时，以此得到指向新数组的相同的堆. \n
+   * @param heap 源堆
+   * @param base 源堆的流数组
+   * @param new_base 新的流数组
+   */
+  void Assign(const MergeHeap &heap, const Stream *base, Stream *new_base) {
+    Reserve(heap.size_);
+    size_ = heap.size_;
+    for (size_t count = 0; count < size_; ++count) {
+      heap_[count] = heap.heap_[count];
+      heap_[count].stream_ = new_base + (heap_[count].stream_ - base);
+    }
+  }
+
+  /**
+   * 清空堆.
+   */
+  void Clear() {
+    size_ = 0;
+  }
+
+  /**
+   * 堆是否为空.
+   * @return BOOL
+   */
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  /**
+   * 获取当前元素最优的流.
+   * @return 流，堆为空则返回NULL
+   */
+  Stream *Top() const {
+    return size_ == 0 ? NULL : heap_[0].stream_;
+  }
+
+  /**
+   * 加入一个流.
+   * @param stream 流
+   * @param tick 标记
+   */
+  void Push(Stream *stream, uint tick) {
+    HeapEntry entry;
+    entry.stream_ = stream;
+    entry.tick_ = tick;
+    if (size_ == capacity_)
+      Resize(capacity_ ? capacity_ << 1 : 1);
+    heap_[size_++] = entry;
+    SiftUp(size_ - 1);
+  }
+
+  /**
+   * 移除堆顶的流.
+   */
+  void Pop() {
+    heap_[0] = heap_[--size_];
+    if (size_ != 0)
+      SiftDown(0);
+  }
+
+  /**
+   * 堆顶流的当前元素已改变，重新调整其位置.
+   * @param tick 新的标记
+   */
+  void UpdateTop(uint tick) {
+    heap_[0].tick_ = tick;
+    SiftDown(0);
+  }
+
+  /**
+   * 堆顶流的当前元素已改变，保持原有标记重新调整其位置.
+   */
+  void UpdateTop() {
+    SiftDown(0);
+  }
+
+ private:
+  /**
+   * 堆节点.
+   */
+  struct HeapEntry {
+    Stream *stream_;  ///< 流
+    uint tick_;  ///< 标记
+  };
+
+  /**
+   * 比较两个节点的优先次序.
+   * @param entry1 前者
+   * @param entry2 后者
+   * @return 前者是否优先于后者
+   */
+  bool IsPrefer(const HeapEntry &entry1, const HeapEntry &entry2) const {
+    if (compare_(entry1.stream_, entry2.stream_))
+      return true;
+    if (compare_(entry2.stream_, entry1.stream_))
+      return false;
+    return entry1.tick_ < entry2.tick_;
+  }
+
+  /**
+   * 将节点向上调整.
+   * @param position 节点位置
+   */
+  void SiftUp(size_t position) {
+    HeapEntry entry = heap_[position];
+    while (position > 0) {
+      size_t parent = (position - 1) / 2;
+      if (!IsPrefer(entry, heap_[parent]))
+        break;
+      heap_[position] = heap_[parent];
+      position = parent;
+    }
+    heap_[position] = entry;
+  }
+
+  /**
+   * 将节点向下调整.
+   * @param position 节点位置
+   */
+  void SiftDown(size_t position) {
+    HeapEntry entry = heap_[position];
+    while (true) {
+      size_t child = position * 2 + 1;
+      if (child >= size_)
+        break;
+      if (child + 1 < size_ && IsPrefer(heap_[child + 1], heap_[child]))
+        ++child;
+      if (!IsPrefer(heap_[child], entry))
+        break;
+      heap_[position] = heap_[child];
+      position = child;
+    }
+    heap_[position] = entry;
+  }
+
+  /**
+   * 改变堆数组的容量.
+   * @param capacity 新容量
+   */
+  void Resize(size_t capacity) {
+    HeapEntry *heap = PhraseArena::NewArray<HeapEntry>(arena_, capacity);
+    for (size_t count = 0; count < size_; ++count)
+      heap[count] = heap_[count];
+    PhraseArena::DeleteArray(arena_, heap_);
+    heap_ = heap;
+    capacity_ = capacity;
+  }
+
+  HeapEntry *heap_;  ///< 堆数组 *
+  size_t size_;  ///< 堆中流的数量
+  size_t capacity_;  ///< 堆数组的容量
+  PhraseArena *arena_;  ///< 分配堆数组的临时内存区(NULL 由堆分配)
+  Compare compare_;  ///< 比较器
+
+  MergeHeap(const MergeHeap &heap);
+  MergeHeap &operator=(const MergeHeap &heap);
+};
+
+#endif  // PYE_ENGINE_MERGE_HEAP_H_
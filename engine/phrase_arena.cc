@@ -0,0 +1,74 @@
+//
+// C++ Implementation: phrase_arena
+//
+// Description:
+// 请参见头文件描述.
+//
+// Author: Jally <jallyx@163.com>, (C) 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#include "phrase_arena.h"
+#include <stdlib.h>
+
+/* 块头占用的长度，保证其后的空间依然对齐 */
+#define ARENA_CHUNK_HEADER \
+  ((sizeof(ArenaChunk) + PHRASE_ARENA_ALIGN - 1) & \
+   ~(size_t)(PHRASE_ARENA_ALIGN - 1))
+
+/**
+ * 类构造函数.
+ */
+PhraseArena::PhraseArena() : chunk_list_(NULL), chunk_(NULL), offset_(0) {
+}
+
+/**
+ * 类析构函数.
+ */
+PhraseArena::~PhraseArena() {
+  while (chunk_list_) {
+    ArenaChunk *chunk = chunk_list_;
+    chunk_list_ = chunk->next_;
+    free(chunk);
+  }
+}
+
+/**
+ * 回卷内存区.
+ * 此前分配的内存全部作废，内存块保留给此后的分配. \n
+ */
+void PhraseArena::Reset() {
+  chunk_ = chunk_list_;
+  offset_ = ARENA_CHUNK_HEADER;
+}
+
+/**
+ * 转到下一个足够容纳所需长度的内存块.
+ * 回卷后先依次沿用已有的内存块，放不下时才申请新块，新块插入在当前块之后，
+ * 下次回卷后即按同样的次序被沿用. \n
+ * @param size 所需长度(已对齐)
+ */
+void PhraseArena::NextChunk(size_t size) {
+  /* 沿用下一个已有的内存块 */
+  ArenaChunk *next = chunk_ ? chunk_->next_ : chunk_list_;
+  if (next && ARENA_CHUNK_HEADER + size <= next->size_) {
+    chunk_ = next;
+    offset_ = ARENA_CHUNK_HEADER;
+    return;
+  }
+
+  /* 申请新的内存块，长度逐块倍增 */
+  size_t length = chunk_ ? chunk_->size_ << 1 : PHRASE_ARENA_CHUNK;
+  if (length < ARENA_CHUNK_HEADER + size)
+    length = ARENA_CHUNK_HEADER + size;
+  ArenaChunk *chunk = (ArenaChunk *)malloc(length);
+  chunk->size_ = length;
+  chunk->next_ = next;
+  if (chunk_)
+    chunk_->next_ = chunk;
+  else
+    chunk_list_ = chunk;
+  chunk_ = chunk;
+  offset_ = ARENA_CHUNK_HEADER;
+}
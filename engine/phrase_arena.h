@@ -0,0 +1,118 @@
+//
+// C++ Interface: phrase_arena
+//
+// Description:
+// 临时内存区，单调增长，只能整体回卷.
+// 一次查询所需的临时对象(游标、储存点、词语数据等)都由此分配，各自无需释放；
+// 查询状态被清除时整个内存区一次回卷，已申请的内存块留待下次查询使用，
+// 因此稳定状态下每次按键几乎不再调用malloc()/free().
+// 内存区只能由一个线程使用.
+//
+// Author: Jally <jallyx@163.com>, (C) 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef PYE_ENGINE_PHRASE_ARENA_H_
+#define PYE_ENGINE_PHRASE_ARENA_H_
+
+#include <sys/types.h>
+#include <new>
+
+/* 内存块的最小长度 */
+#define PHRASE_ARENA_CHUNK 16384
+/* 每次分配的对齐长度 */
+#define PHRASE_ARENA_ALIGN 16
+
+/**
+ * 临时内存区.
+ * 由内存区分配的对象不会被逐个析构，只有析构函数没有副作用的类型才能直接
+ * 丢弃；其余类型需由持有者显式调用析构函数. \n
+ */
+class PhraseArena {
+ public:
+  PhraseArena();
+  ~PhraseArena();
+
+  /**
+   * 分配内存.
+   * @param size 长度
+   * @return 内存，按PHRASE_ARENA_ALIGN对齐
+   */
+  void *Alloc(size_t size) {
+    size = (size + PHRASE_ARENA_ALIGN - 1) & ~(size_t)(PHRASE_ARENA_ALIGN - 1);
+    if (!chunk_ || offset_ + size > chunk_->size_)
+      NextChunk(size);
+    void *ptr = (char *)chunk_ + offset_;
+    offset_ += size;
+    return ptr;
+  }
+  /**
+   * 分配并构造对象数组.
+   * @param amount 对象数量
+   * @return 对象数组
+   */
+  template <typename Type>
+  Type *NewArray(size_t amount) {
+    Type *array = (Type *)Alloc(sizeof(Type) * amount);
+    for (size_t count = 0; count < amount; ++count)
+      new (array + count) Type;
+    return array;
+  }
+  void Reset();
+
+  /**
+   * 由内存区(或堆)分配并构造对象数组.
+   * @param arena 内存区(NULL 由堆分配)
+   * @param amount 对象数量
+   * @return 对象数组
+   */
+  template <typename Type>
+  static Type *NewArray(PhraseArena *arena, size_t amount) {
+    return arena ? arena->NewArray<Type>(amount) : new Type[amount];
+  }
+  /**
+   * 释放由NewArray(arena, amount)得到的对象数组.
+   * @param arena 分配数组时所用的内存区(NULL 由堆分配)
+   * @param array 对象数组
+   */
+  template <typename Type>
+  static void DeleteArray(PhraseArena *arena, Type *array) {
+    if (!arena)
+      delete [] array;
+  }
+
+ private:
+  /**
+   * 内存块.
+   * 块头之后即为可分配的空间. \n
+   */
+  struct ArenaChunk {
+    ArenaChunk *next_;  ///< 下一个内存块
+    size_t size_;  ///< 内存块的总长度(含块头)
+  };
+
+  void NextChunk(size_t size);
+
+  ArenaChunk *chunk_list_;  ///< 内存块链表 *
+  ArenaChunk *chunk_;  ///< 正在分配的内存块
+  size_t offset_;  ///< 正在分配的内存块中已用的长度(含块头)
+
+  PhraseArena(const PhraseArena &arena);
+  PhraseArena &operator=(const PhraseArena &arena);
+};
+
+/**
+ * 由内存区(或堆)分配对象.
+ * e.g. new (arena) PhraseCursor(...)；arena为NULL时等同于普通的new. \n
+ * 由内存区分配的对象只能显式析构，不能delete. \n
+ */
+inline void *operator new(size_t size, PhraseArena *arena) {
+  return arena ? arena->Alloc(size) : ::operator new(size);
+}
+inline void operator delete(void *ptr, PhraseArena *arena) {
+  if (!arena)
+    ::operator delete(ptr);
+}
+
+#endif  // PYE_ENGINE_PHRASE_ARENA_H_
@@ -20,43 +20,355 @@
 #include "pye_output.h"
 #include "pye_wrapper.h"
 #include "system_phrase.h"
+#include "thread_pool.h"
 #include "user_phrase.h"
 
+/* 并行加载码表时的最少线程数 */
+#define MIN_LOAD_THREAD 4
+/* 查询代价(可能扫描的词语数量)达到此值才分派到线程池 */
+#define PARALLEL_SEARCH_COST 16384
+/* 查询缓存的条目数量上限 */
+#define QUERY_CACHE_CAPACITY 256
+
 /**
- * 创建系统词语数据代理集合.
- * @param config 系统码表配置文件
+ * 系统码表的重载任务.
  */
-void PhraseManager::CreateSystemPhraseProxySite(const char *config) {
-  /* 打开系统码表配置文件 */
-  FILE *stream = fopen(config, "r");
-  if (!stream) {
-    pwarning("Fopen file \"%s\" failed, %s", config, strerror(errno));
+class PhraseReloadTask {
+ public:
+  PhraseReloadTask()
+      : manager_(NULL), config_(NULL), filename_(NULL), ticket_(0) {}
+  ~PhraseReloadTask() {
+    free(config_);
+    free(filename_);
+  }
+
+  PhraseManager *manager_;  ///< 词语管理者
+  char *config_;  ///< 系统码表配置文件
+  char *filename_;  ///< 需要重载的码表文件名(NULL表示全部)
+  uint ticket_;  ///< 任务序号
+};
+
+/**
+ * 系统码表的加载任务.
+ */
+class PhraseLoadTask : public ThreadTask {
+ public:
+  PhraseLoadTask()
+      : manager_(NULL), mbfile_(NULL), priority_(0),
+        phrase_proxy_site_(NULL) {}
+  virtual ~PhraseLoadTask() {
+    free(mbfile_);
+  }
+
+  /**
+   * 创建词语数据代理集合.
+   */
+  virtual void Run() {
+    phrase_proxy_site_ =
+        manager_->CreatePhraseProxySite(mbfile_, priority_, SYSTEM_TYPE);
+  }
+
+  PhraseManager *manager_;  ///< 词语管理者
+  char *mbfile_;  ///< 码表文件
+  int priority_;  ///< 优先级
+  PhraseProxySite *phrase_proxy_site_;  ///< 创建的集合(失败为NULL)
+};
+
+/**
+ * 打开游标的查询任务.
+ */
+class PhraseMatchTask : public ThreadTask {
+ public:
+  PhraseMatchTask()
+      : phrase_proxy_storage_(NULL), origin_cursor_(NULL), profile_(NULL),
+        chars_proxy_(NULL), chars_proxy_length_(0), arena_(NULL) {}
+  virtual ~PhraseMatchTask() {}
+
+  /**
+   * 打开游标(尽量由上次查询的游标派生)并取出第一个词语数据代理.
+   */
+  virtual void Run() {
+    PhraseCursor *cursor = NULL;
+    if (origin_cursor_)
+      cursor = origin_cursor_->Refine(profile_, chars_proxy_,
+                                      chars_proxy_length_, arena_);
+    if (!cursor) {
+      AbstractPhrase *phrase =
+          phrase_proxy_storage_->phrase_proxy_site_->phrase_;
+      cursor = phrase->OpenMatchCursor(profile_, chars_proxy_,
+                                       chars_proxy_length_, arena_);
+    }
+    phrase_proxy_storage_->phrase_cursor_ = cursor;
+    phrase_proxy_storage_->FetchPhraseProxy();
+  }
+
+  PhraseProxyStorage *phrase_proxy_storage_;  ///< 储存点
+  const PhraseCursor *origin_cursor_;  ///< 上次查询的游标(可为NULL)
+  const FuzzyProfile *profile_;  ///< 模糊拼音配置
+  const CharsProxy *chars_proxy_;  ///< 汉字代理数组
+  int chars_proxy_length_;  ///< 汉字代理数组的有效长度
+  PhraseArena *arena_;  ///< 分配游标的临时内存区(在工作线程中执行时为NULL)
+};
+
+/**
+ * 查找最佳词语的查询任务.
+ */
+class PhrasePreferTask : public ThreadTask {
+ public:
+  PhrasePreferTask()
+      : phrase_proxy_site_(NULL), profile_(NULL), chars_proxy_(NULL),
+        chars_proxy_length_(0), phrase_proxy_(NULL) {}
+  virtual ~PhrasePreferTask() {
+    delete phrase_proxy_;
+  }
+
+  /**
+   * 查找本集合中的最佳词语.
+   */
+  virtual void Run() {
+    phrase_proxy_ = phrase_proxy_site_->phrase_->SearchPreferPhrase(
+                        profile_, chars_proxy_, chars_proxy_length_);
+  }
+
+  PhraseProxySite *phrase_proxy_site_;  ///< 集合
+  const FuzzyProfile *profile_;  ///< 模糊拼音配置
+  const CharsProxy *chars_proxy_;  ///< 汉字代理数组
+  int chars_proxy_length_;  ///< 汉字代理数组的有效长度
+  PhraseProxy *phrase_proxy_;  ///< 最佳词语(没有为NULL)
+};
+
+/**
+ * 查找各长度下最佳词语的查询任务.
+ */
+class PhraseSpanTask : public ThreadTask {
+ public:
+  PhraseSpanTask()
+      : phrase_proxy_site_(NULL), profile_(NULL), chars_proxy_(NULL),
+        chars_proxy_length_(0), min_length_(0), width_(0),
+        span_array_(NULL) {}
+  virtual ~PhraseSpanTask() {}
+
+  /**
+   * 查找本集合中各长度下的最佳词语.
+   */
+  virtual void Run() {
+    phrase_proxy_site_->phrase_->SearchPreferSpan(profile_, chars_proxy_,
+                                                  chars_proxy_length_,
+                                                  min_length_, width_,
+                                                  span_array_);
+  }
+
+  PhraseProxySite *phrase_proxy_site_;  ///< 集合
+  const FuzzyProfile *profile_;  ///< 模糊拼音配置
+  const CharsProxy *chars_proxy_;  ///< 汉字代理数组
+  int chars_proxy_length_;  ///< 汉字代理数组的有效长度
+  int min_length_;  ///< 需要查找的最小长度
+  int width_;  ///< 每个长度下最多保留的词语数量
+  PhraseProxy *span_array_;  ///< 各长度的候选词语
+};
+
+/**
+ * 类构造函数.
+ * @param capacity 条目数量上限
+ */
+PhraseQueryCache::PhraseQueryCache(size_t capacity)
+    : capacity_(capacity), generation_(0), hits_(0), misses_(0) {
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+/**
+ * 类析构函数.
+ */
+PhraseQueryCache::~PhraseQueryCache() {
+  STL_DELETE_DATA(entry_list_, EntryList);
+  pthread_mutex_destroy(&mutex_);
+}
+
+/**
+ * 查询缓存.
+ * @param key 键值
+ * @param arena 分配储存点副本的临时内存区(NULL 由堆分配)
+ * @param storage_list 命中时在此数组中加入结果储存点的副本
+ * @param generation 当前的版本号，供未命中时加入结果之用
+ * @return 是否命中
+ */
+bool PhraseQueryCache::Search(const std::string &key, PhraseArena *arena,
+                              std::vector<PhraseProxyStorage *> *storage_list,
+                              uint *generation) {
+  pthread_mutex_lock(&mutex_);
+  *generation = generation_;
+  bool hit = LookupEntry(key, arena, storage_list);
+  if (hit)
+    ++hits_;
+  else
+    ++misses_;
+  pthread_mutex_unlock(&mutex_);
+
+  return hit;
+}
+
+/**
+ * 查询缓存，但不计入命中统计.
+ * 用于辅助性的查询(如部分结果、预先查询前的检查). \n
+ * @param key 键值
+ * @param arena 分配储存点副本的临时内存区(NULL 由堆分配)
+ * @param storage_list 命中时在此数组中加入结果储存点的副本(NULL 只检查)
+ * @param generation 当前的版本号，供未命中时加入结果之用
+ * @return 是否命中
+ */
+bool PhraseQueryCache::Peek(const std::string &key, PhraseArena *arena,
+                            std::vector<PhraseProxyStorage *> *storage_list,
+                            uint *generation) {
+  pthread_mutex_lock(&mutex_);
+  *generation = generation_;
+  bool hit = LookupEntry(key, arena, storage_list);
+  pthread_mutex_unlock(&mutex_);
+
+  return hit;
+}
+
+/**
+ * 查找条目，命中时将其移至链表头部并复制结果.
+ * @note 调用者必须持有缓存锁.
+ * @param key 键值
+ * @param arena 分配储存点副本的临时内存区(NULL 由堆分配)
+ * @param storage_list 在此数组中加入结果储存点的副本(NULL 不复制)
+ * @return 是否命中
+ */
+bool PhraseQueryCache::LookupEntry(
+    const std::string &key, PhraseArena *arena,
+    std::vector<PhraseProxyStorage *> *storage_list) {
+  EntryMap::iterator iterator = entry_map_.find(key);
+  if (iterator == entry_map_.end())
+    return false;
+
+  entry_list_.splice(entry_list_.begin(), entry_list_, iterator->second);
+  if (!storage_list)
+    return true;
+  PhraseCacheEntry *entry = *iterator->second;
+  storage_list->reserve(storage_list->size() + entry->storage_list_.size());
+  for (std::vector<PhraseProxyStorage *>::iterator storage_iterator =
+           entry->storage_list_.begin();
+       storage_iterator != entry->storage_list_.end();
+       ++storage_iterator)
+    storage_list->push_back((*storage_iterator)->Clone(arena));
+  return true;
+}
+
+/**
+ * 加入查询结果.
+ * 若缓存在查询期间已经失效，则直接丢弃结果. \n
+ * @param key 键值
+ * @param index_mask 查询可能扫描到的索引值(首个汉字代理的主部件)的位掩码
+ * @param generation 查询开始时的版本号
+ * @param storage_list 结果储存点数组，其中的储存点将转交给缓存
+ */
+void PhraseQueryCache::Insert(const std::string &key, uint64_t index_mask,
+                              uint generation,
+                              std::vector<PhraseProxyStorage *> *storage_list) {
+  pthread_mutex_lock(&mutex_);
+  if (generation != generation_ || entry_map_.find(key) != entry_map_.end()) {
+    pthread_mutex_unlock(&mutex_);
+    STL_DELETE_DATA(*storage_list, std::vector<PhraseProxyStorage *>);
+    storage_list->clear();
     return;
   }
 
-  /* 获取路径 */
-  char *path = strdup(config);
-  const char *dir = dirname(path);
+  /* 加入新条目 */
+  PhraseCacheEntry *entry = new PhraseCacheEntry;
+  entry->key_ = key;
+  entry->index_mask_ = index_mask;
+  entry->storage_list_.swap(*storage_list);
+  entry_list_.push_front(entry);
+  entry_map_[key] = entry_list_.begin();
 
-  /* 读取文件数据、分析并创建词语集合添加到链表 */
-  char *lineptr = NULL;
-  size_t n = 0;
-  while (getline(&lineptr, &n, stream) != -1) {
-    const char *filename(NULL), *priority(NULL);
-    if (!BreakMbfileString(lineptr, &filename, &priority))
+  /* 淘汰最久未使用的条目 */
+  while (entry_list_.size() > capacity_) {
+    entry = entry_list_.back();
+    entry_map_.erase(entry->key_);
+    entry_list_.pop_back();
+    delete entry;
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 使缓存整体失效.
+ */
+void PhraseQueryCache::Flush() {
+  pthread_mutex_lock(&mutex_);
+  STL_DELETE_DATA(entry_list_, EntryList);
+  entry_list_.clear();
+  entry_map_.clear();
+  ++generation_;
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 使可能扫描到某索引值下的词语的条目失效.
+ * @param index 索引值
+ */
+void PhraseQueryCache::Flush(int8_t index) {
+  pthread_mutex_lock(&mutex_);
+  EntryList::iterator iterator = entry_list_.begin();
+  while (iterator != entry_list_.end()) {
+    PhraseCacheEntry *entry = *iterator;
+    if (!((entry->index_mask_ >> index) & 1)) {
+      ++iterator;
       continue;
-    char *mbfile = NULL;
-    asprintf(&mbfile, "%s/%s", dir, filename);
-    PhraseProxySite *phrase_proxy_site =
-        CreatePhraseProxySite(mbfile, atoi(priority), SYSTEM_TYPE);
-    phrase_proxy_site_list_.push_back(phrase_proxy_site);
-    free(mbfile);
+    }
+    entry_map_.erase(entry->key_);
+    iterator = entry_list_.erase(iterator);
+    delete entry;
   }
-  free(lineptr);
+  ++generation_;
+  pthread_mutex_unlock(&mutex_);
+}
 
-  /* 释放资源 */
-  free(path);
-  fclose(stream);
+/**
+ * 获取命中统计.
+ * @param hits 命中次数
+ * @param misses 未命中次数
+ */
+void PhraseQueryCache::GetStats(uint *hits, uint *misses) {
+  pthread_mutex_lock(&mutex_);
+  *hits = hits_;
+  *misses = misses_;
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 打包查询类型、模糊拼音配置的序号及汉字代理数组作为键值.
+ * @param type 查询类型
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param key 键值
+ */
+void PhraseQueryCache::PackKey(char type, const FuzzyProfile *profile,
+                               const CharsProxy *chars_proxy,
+                               int chars_proxy_length, std::string *key) {
+  uint serial = profile->GetSerial();
+  key->assign(1, type);
+  key->append((const char *)&serial, sizeof(serial));
+  for (int count = 0; count < chars_proxy_length; ++count) {
+    key->push_back((chars_proxy + count)->major_index_);
+    key->push_back((chars_proxy + count)->minor_index_);
+  }
+}
+
+/**
+ * 创建系统词语数据代理集合.
+ * 若本配置文件此前已被加载，则其原有的集合将被替换. \n
+ * @param config 系统码表配置文件
+ */
+void PhraseManager::CreateSystemPhraseProxySite(const char *config) {
+  std::vector<PhraseProxySite *> *site_list =
+      LoadSystemPhraseProxySite(config, NULL);
+  if (site_list) {
+    ReplaceSystemPhraseProxySite(config, NULL, site_list);
+    delete site_list;
+  }
 }
 
 /**
@@ -80,7 +392,54 @@ void PhraseManager::CreateUserPhraseProxySite(const char *mbfile) {
   /* 创建词语数据代理集合 */
   PhraseProxySite *phrase_proxy_site =
       CreatePhraseProxySite(backup_path_, INT32_MAX, USER_TYPE);
-  phrase_proxy_site_list_.push_back(phrase_proxy_site);
+
+  /* 发布新的集合快照 */
+  PhraseProxySiteSet *site_set = new PhraseProxySiteSet;
+  pthread_mutex_lock(&site_mutex_);
+  PhraseProxySiteSet *old_site_set = phrase_proxy_site_set_;
+  for (std::vector<PhraseProxySite *>::iterator iterator =
+           old_site_set->site_list_.begin();
+       iterator != old_site_set->site_list_.end();
+       ++iterator) {
+    (*iterator)->Ref();
+    site_set->site_list_.push_back(*iterator);
+  }
+  site_set->site_list_.push_back(phrase_proxy_site);
+  phrase_proxy_site_set_ = site_set;
+  pthread_mutex_unlock(&site_mutex_);
+  old_site_set->Unref();
+  FlushQueryCache();
+}
+
+/**
+ * 在后台重新加载系统码表配置文件中的全部码表.
+ * 加载完成前查询仍使用原有的集合，加载完成后新集合整体替换本配置文件的旧集合. \n
+ * @param config 系统码表配置文件(应与创建时所用的串相同)
+ */
+void PhraseManager::ReloadSystemPhraseProxySite(const char *config) {
+  StartPhraseProxySiteReload(config, NULL);
+}
+
+/**
+ * 在后台重新加载系统码表配置文件中的某一个码表.
+ * 配置文件将被重新分析，因此该码表优先级的变化也会生效. \n
+ * @param config 系统码表配置文件(应与创建时所用的串相同)
+ * @param filename 码表文件名(与配置文件中的写法相同)
+ */
+void PhraseManager::ReloadSystemPhraseProxySite(const char *config,
+                                                const char *filename) {
+  StartPhraseProxySiteReload(config, filename);
+}
+
+/**
+ * 等待此前发起的所有重载任务完成.
+ */
+void PhraseManager::WaitPhraseProxySiteReload() {
+  pthread_mutex_lock(&reload_mutex_);
+  uint ticket = reload_ticket_;
+  while (reload_serving_ != ticket)
+    pthread_cond_wait(&reload_cond_, &reload_mutex_);
+  pthread_mutex_unlock(&reload_mutex_);
 }
 
 /**
@@ -97,42 +456,15 @@ void PhraseManager::AppendMendPinyinPair(const char *raw, const char *mend) {
 
 /**
  * 添加模糊拼音对.
+ * 在默认配置的基础上发布含有本对的新配置，已选用其他配置的编辑器不受影响. \n
  * @param unit1 拼音单元
  * @param unit2 拼音单元
  */
 void PhraseManager::AppendFuzzyPinyinPair(const char *unit1,
                                           const char *unit2) {
-  /* 获取索引值 */
-  PinyinParser pinyin_parser;
-  int8_t index1 = pinyin_parser.GetPinyinUnitPartsIndex(unit1);
-  int8_t index2 = pinyin_parser.GetPinyinUnitPartsIndex(unit2);
-  if (index1 == -1 || index2 == -1)
-    return;
-
-  /* 更新第一个 */
-  size_t number = 0;
-  int8_t *indexptr = *(fuzzy_pair_table_ + index1);
-  for (; *(indexptr + number) != -1; ++number)
-    continue;
-  *(fuzzy_pair_table_ + index1) =
-      (int8_t *)malloc(sizeof(int8_t) * (number + 2));
-  memcpy(*(fuzzy_pair_table_ + index1), indexptr, sizeof(int8_t) * number);
-  free(indexptr);
-  indexptr = *(fuzzy_pair_table_ + index1);
-  *(indexptr + number) = index2;
-  *(indexptr + number + 1) = -1;
-
-  /* 更新第二个 */
-  indexptr = *(fuzzy_pair_table_ + index2);
-  for (number = 0; *(indexptr + number) != -1; ++number)
-    continue;
-  *(fuzzy_pair_table_ + index2) =
-      (int8_t *)malloc(sizeof(int8_t) * (number + 2));
-  memcpy(*(fuzzy_pair_table_ + index2), indexptr, sizeof(int8_t) * number);
-  free(indexptr);
-  indexptr = *(fuzzy_pair_table_ + index2);
-  *(indexptr + number) = index1;
-  *(indexptr + number + 1) = -1;
+  FuzzyProfile *profile = GetFuzzyProfile()->AppendFuzzyPair(unit1, unit2);
+  if (profile)
+    PublishFuzzyProfile(profile);
 }
 
 /**
@@ -145,12 +477,30 @@ void PhraseManager::ClearMendPinyinPair() {
 
 /**
  * 清空模糊拼音对.
+ * 发布不含任何模糊拼音对的新默认配置. \n
  */
 void PhraseManager::ClearFuzzyPinyinPair() {
-  PinyinParser pinyin_parser;
-  int8_t amount = pinyin_parser.GetPinyinUnitPartsAmount();
-  for (int8_t count = 0; count < amount; ++count)
-    *(*(fuzzy_pair_table_ + count) + 1) = -1;
+  PublishFuzzyProfile(new FuzzyProfile);
+}
+
+/**
+ * 设置全部模糊拼音对.
+ * 先在本地建好含有所有模糊拼音对的配置，再一次性发布，用于重新加载设置；
+ * 逐对添加会为每一对发布一个配置，而发布过的配置都要保留到本类销毁为止. \n
+ * @param units 拼音单元表，每相邻两项为一对
+ * @param amount 模糊拼音对的数量
+ */
+void PhraseManager::SetFuzzyPinyinPairs(const char *const *units, int amount) {
+  FuzzyProfile *profile = new FuzzyProfile;
+  for (int count = 0; count < amount; ++count) {
+    FuzzyProfile *next = profile->AppendFuzzyPair(*(units + count * 2),
+                                                  *(units + count * 2 + 1));
+    if (next) {
+      profile->Unref();
+      profile = next;
+    }
+  }
+  PublishFuzzyProfile(profile);
 }
 
 /**
@@ -158,22 +508,14 @@ void PhraseManager::ClearFuzzyPinyinPair() {
  */
 void PhraseManager::BackupUserPhrase() {
   /* 查询用户词语数据代理集合 */
-  PhraseProxySite *phrase_proxy_site = NULL;
-  for (std::list<PhraseProxySite *>::iterator iterator =
-           phrase_proxy_site_list_.begin();
-       iterator != phrase_proxy_site_list_.end();
-       ++iterator) {
-    if ((*iterator)->type_ == USER_TYPE) {
-      phrase_proxy_site = *iterator;
-      break;
-    }
-  }
+  PhraseProxySite *phrase_proxy_site = AcquireUserPhraseProxySite();
   if (!phrase_proxy_site)
     return;
 
   /* 写出内存数据 */
   UserPhrase *user_phrase = (UserPhrase *)phrase_proxy_site->phrase_;
   user_phrase->WritePhraseTree();
+  phrase_proxy_site->Unref();
 
   /* 更新用户词语文件(多绕圈可避免掉电错误) */
   char *path = NULL;
@@ -184,6 +526,146 @@ void PhraseManager::BackupUserPhrase() {
   free(path);
 }
 
+/**
+ * 启用系统词语的命中统计.
+ * 统计结果可以通过ExportPhraseHits()导出，供pye-create-mb布局热区使用. \n
+ */
+void PhraseManager::EnablePhraseHits() {
+  phrase_hits_ = true;
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator) {
+    if ((*iterator)->type_ == SYSTEM_TYPE)
+      ((SystemPhrase *)(*iterator)->phrase_)->EnablePhraseHits();
+  }
+  site_set->Unref();
+}
+
+/**
+ * 启用共享内存模式.
+ * 此后创建的系统词语集合将只读映射码表文件，而不是读入私有内存，
+ * 同一主机上的多个进程因此共享同一份码表数据. \n
+ * @note 应在CreateSystemPhraseProxySite()之前调用本函数.
+ */
+void PhraseManager::EnableShareMemory() {
+  share_memory_ = true;
+}
+
+/**
+ * 启用并行查询.
+ * 此后代价较大的查询会由常驻线程池中的线程与调用线程同时完成，
+ * 每个集合一个任务；代价较小的查询仍在调用线程中依次完成.
+ * 同一线程池还用于分块扫描词语数量很多的长度节点. \n
+ * @note 线程池的线程数为处理器数量减一(至少为一)，调用线程本身也参与查询.
+ * @note 应在查询开始之前调用本函数.
+ */
+void PhraseManager::EnableParallelSearch() {
+  if (search_pool_)
+    return;
+  int max_thread = ThreadPool::GetProcessorAmount() - 1;
+  search_pool_ = new ThreadPool(max_thread > 0 ? max_thread : 1);
+
+  /* 已加载的集合也使用此线程池扫描 */
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator)
+    (*iterator)->phrase_->SetScanPool(search_pool_);
+  site_set->Unref();
+}
+
+/**
+ * 启用查询缓存.
+ * 缓存以汉字代理数组为键值，拼音矫正在生成汉字代理数组之前已经完成，
+ * 因此矫正表的变化不影响缓存；模糊拼音或集合快照变化时缓存整体失效，
+ * 用户词语变化时只有可能扫描到该词语的条目失效. \n
+ */
+void PhraseManager::EnableQueryCache() {
+  if (!query_cache_)
+    query_cache_ = new PhraseQueryCache(QUERY_CACHE_CAPACITY);
+}
+
+/**
+ * 启用增量查询.
+ * 查询时若给出了上次查询的储存点，同一集合的新游标由上次的游标派生，
+ * 新查询细化了的那部分长度不再重新扫描已被排除的词语. 查询结果不受影响. \n
+ * @note 用户词语树随时可能被修改，其游标仍完整扫描.
+ */
+void PhraseManager::EnableIncrementalSearch() {
+  incremental_search_ = true;
+}
+
+/**
+ * 启用查询改写.
+ * 系统词语集合将为词语较多的长度节点建立精确索引，此后模糊查询先被展开为
+ * 若干精确的键值前缀再直接定位，变体过多时仍退回扫描. 查询结果不受影响. \n
+ * 索引在节点首次被查询时交给后台线程建立，建立完成之前该节点仍被扫描. \n
+ * 所有系统词语集合共用同一个单线程的线程池，索引任务以低优先级执行. \n
+ * @note 用户词语随时变化且数量通常不多，仍采用扫描的方式.
+ */
+void PhraseManager::EnableQueryPlanner() {
+  if (query_planner_)
+    return;
+  query_planner_ = true;
+  index_pool_ = new ThreadPool(1);
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator) {
+    if ((*iterator)->type_ == SYSTEM_TYPE)
+      ((SystemPhrase *)(*iterator)->phrase_)->EnableExactIndex(index_pool_);
+  }
+  site_set->Unref();
+}
+
+/**
+ * 导出系统词语的命中次数.
+ * 每个系统码表导出为目录下的一个文件，文件名为(码表文件名.hits). \n
+ * @param dir 输出目录
+ */
+void PhraseManager::ExportPhraseHits(const char *dir) const {
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator) {
+    PhraseProxySite *phrase_proxy_site = *iterator;
+    if (phrase_proxy_site->type_ != SYSTEM_TYPE)
+      continue;
+    char *path = strdup(phrase_proxy_site->mbfile_);
+    char *hitsfile = NULL;
+    asprintf(&hitsfile, "%s/%s.hits", dir, basename(path));
+    FILE *stream = fopen(hitsfile, "w");
+    if (stream) {
+      ((SystemPhrase *)phrase_proxy_site->phrase_)->ExportPhraseHits(stream);
+      fclose(stream);
+    } else {
+      pwarning("Fopen file \"%s\" failed, %s", hitsfile, strerror(errno));
+    }
+    free(hitsfile);
+    free(path);
+  }
+  site_set->Unref();
+}
+
+/**
+ * 获取查询缓存的命中统计.
+ * @param hits 命中次数
+ * @param misses 未命中次数
+ */
+void PhraseManager::GetQueryCacheStats(uint *hits, uint *misses) const {
+  if (query_cache_) {
+    query_cache_->GetStats(hits, misses);
+  } else {
+    *hits = 0;
+    *misses = 0;
+  }
+}
+
 /**
  * 删除词语数据.
  * @param phrase_datum 词语数据
@@ -194,22 +676,15 @@ void PhraseManager::DeletePhraseDatum(const PhraseDatum *phrase_datum) const {
     return;
 
   /* 查询用户词语数据代理集合 */
-  PhraseProxySite *phrase_proxy_site = NULL;
-  for (std::list<PhraseProxySite *>::const_iterator iterator =
-           phrase_proxy_site_list_.begin();
-       iterator != phrase_proxy_site_list_.end();
-       ++iterator) {
-    if ((*iterator)->type_ == USER_TYPE) {
-      phrase_proxy_site = *iterator;
-      break;
-    }
-  }
+  PhraseProxySite *phrase_proxy_site = AcquireUserPhraseProxySite();
   if (!phrase_proxy_site)
     return;
 
   /* 删除词语 */
   UserPhrase *user_phrase = (UserPhrase *)phrase_proxy_site->phrase_;
   user_phrase->DeletePhraseFromTree(phrase_datum);
+  phrase_proxy_site->Unref();
+  FlushQueryCache(phrase_datum);
 }
 
 /**
@@ -222,16 +697,7 @@ void PhraseManager::FeedbackPhraseDatum(const PhraseDatum *phrase_datum) const {
     return;
 
   /* 查询用户词语数据代理集合 */
-  PhraseProxySite *phrase_proxy_site = NULL;
-  for (std::list<PhraseProxySite *>::const_iterator iterator =
-           phrase_proxy_site_list_.begin();
-       iterator != phrase_proxy_site_list_.end();
-       ++iterator) {
-    if ((*iterator)->type_ == USER_TYPE) {
-      phrase_proxy_site = *iterator;
-      break;
-    }
-  }
+  PhraseProxySite *phrase_proxy_site = AcquireUserPhraseProxySite();
   if (!phrase_proxy_site)
     return;
 
@@ -241,89 +707,437 @@ void PhraseManager::FeedbackPhraseDatum(const PhraseDatum *phrase_datum) const {
     user_phrase->IncreasePhraseFrequency(phrase_datum);
   else
     user_phrase->InsertPhraseToTree(phrase_datum);
+  phrase_proxy_site->Unref();
+  FlushQueryCache(phrase_datum);
 }
 
 /**
  * 查找与汉字代理数组相匹配的词语数据代理.
+ * 启用增量查询时，各集合的新游标尽量由上次查询中同一集合的游标派生. \n
+ * 缓存中有预先查询的系统词语结果时，系统词语集合直接采用其副本，
+ * 只有用户词语集合需要扫描. \n
+ * 储存点、游标及返回的数组都由临时内存区分配；查询被分派到线程池时，
+ * 游标改由堆分配(工作线程不能使用临时内存区). \n
+ * @param profile 模糊拼音配置
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组的有效长度
- * @return 词语数据代理储存点链表
- */
-std::list<PhraseProxyStorage *> *PhraseManager::SearchMatchablePhrase(
-    const CharsProxy *chars_proxy, int chars_proxy_length) const {
-  std::list<PhraseProxyStorage *> *storage_list =
-      new std::list<PhraseProxyStorage *>;
-  for (std::list<PhraseProxySite *>::const_iterator iterator =
-           phrase_proxy_site_list_.begin();
-       iterator != phrase_proxy_site_list_.end();
-       ++iterator) {
-    AbstractPhrase *phrase = (*iterator)->phrase_;
-    std::list<PhraseProxy *> *phrase_proxy_list =
-        phrase->SearchMatchablePhrase(chars_proxy, chars_proxy_length);
-    if (phrase_proxy_list) {
-      PhraseProxyStorage *storage = new PhraseProxyStorage;
-      storage_list->push_back(storage);
-      storage->phrase_proxy_site_ = *iterator;
-      storage->phrase_proxy_list_ = phrase_proxy_list;
+ * @param origin_array 上次查询的储存点数组(以NULL结束，可为NULL)
+ * @param arena 临时内存区
+ * @return 词语数据代理储存点数组(以NULL结束)，由调用者以
+ * (PhraseProxyStorage::Release)释放各储存点；没有词语时为NULL
+ */
+PhraseProxyStorage **PhraseManager::SearchMatchablePhrase(
+    const FuzzyProfile *profile, const CharsProxy *chars_proxy,
+    int chars_proxy_length, PhraseProxyStorage *const *origin_array,
+    PhraseArena *arena) const {
+  if (chars_proxy_length <= 0)
+    return NULL;
+
+  /* 查询缓存 */
+  std::string key;
+  uint generation = 0;
+  std::vector<PhraseProxyStorage *> system_list;
+  bool system_cached = false;
+  if (query_cache_) {
+    PhraseQueryCache::PackKey('M', profile, chars_proxy, chars_proxy_length,
+                              &key);
+    std::vector<PhraseProxyStorage *> cache_list;
+    if (query_cache_->Search(key, arena, &cache_list, &generation)) {
+      if (cache_list.empty())
+        return NULL;
+      PhraseProxyStorage **storage_array =
+          arena->NewArray<PhraseProxyStorage *>(cache_list.size() + 1);
+      std::copy(cache_list.begin(), cache_list.end(), storage_array);
+      *(storage_array + cache_list.size()) = NULL;
+      return storage_array;
     }
+    std::string system_key;
+    uint system_generation;
+    PhraseQueryCache::PackKey('S', profile, chars_proxy, chars_proxy_length,
+                              &system_key);
+    system_cached = query_cache_->Peek(system_key, arena, &system_list,
+                                       &system_generation);
   }
-  if (storage_list->empty()) {
-    delete storage_list;
-    storage_list = NULL;
+
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+
+  /* 为每个集合创建储存点，需要扫描的集合另建查询任务 */
+  int amount = site_set->site_list_.size();
+  PhraseProxyStorage **slot_array =
+      arena->NewArray<PhraseProxyStorage *>(amount);
+  PhraseMatchTask *tasks = arena->NewArray<PhraseMatchTask>(amount);
+  ThreadTask **task_array = arena->NewArray<ThreadTask *>(amount);
+  uint cost = 0;
+  int task_amount = 0;
+  int count = 0;
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator, ++count) {
+    *(slot_array + count) = NULL;
+    if (system_cached && (*iterator)->type_ == SYSTEM_TYPE) {
+      for (std::vector<PhraseProxyStorage *>::iterator system_iterator =
+               system_list.begin();
+           system_iterator != system_list.end();
+           ++system_iterator) {
+        if ((*system_iterator)->phrase_proxy_site_ == *iterator) {
+          *(slot_array + count) = *system_iterator;
+          system_list.erase(system_iterator);
+          break;
+        }
+      }
+      continue;
+    }
+    PhraseMatchTask *task = tasks + task_amount;
+    PhraseProxyStorage *storage = new (arena) PhraseProxyStorage(arena);
+    (*iterator)->Ref();
+    storage->phrase_proxy_site_ = *iterator;
+    task->phrase_proxy_storage_ = storage;
+    if (incremental_search_ && origin_array) {
+      for (PhraseProxyStorage *const *origin = origin_array; *origin;
+           ++origin) {
+        if ((*origin)->phrase_proxy_site_ == *iterator) {
+          task->origin_cursor_ = (*origin)->phrase_cursor_;
+          break;
+        }
+      }
+    }
+    task->profile_ = profile;
+    task->chars_proxy_ = chars_proxy;
+    task->chars_proxy_length_ = chars_proxy_length;
+    *(task_array + task_amount) = task;
+    *(slot_array + count) = storage;
+    if (search_pool_)
+      cost += (*iterator)->phrase_->EstimateSearchCost(profile, chars_proxy,
+                                                       chars_proxy_length);
+    ++task_amount;
+  }
+  site_set->Unref();
+  /* 已不在当前快照中的集合的结果 */
+  for (std::vector<PhraseProxyStorage *>::iterator iterator =
+           system_list.begin();
+       iterator != system_list.end();
+       ++iterator)
+    (*iterator)->Release();
+  if (!IsParallelSearch(task_amount, cost)) {
+    for (count = 0; count < task_amount; ++count)
+      (tasks + count)->arena_ = arena;
+  }
+
+  /* 执行查询，并按集合次序收集结果 */
+  RunSearchTasks(task_array, task_amount, cost);
+  PhraseProxyStorage **storage_array =
+      arena->NewArray<PhraseProxyStorage *>(amount + 1);
+  int valid_amount = 0;
+  for (count = 0; count < amount; ++count) {
+    PhraseProxyStorage *storage = *(slot_array + count);
+    if (!storage)
+      continue;
+    if (storage->valid_)
+      *(storage_array + valid_amount++) = storage;
+    else
+      storage->Release();
   }
+  *(storage_array + valid_amount) = NULL;
 
-  return storage_list;
+  /* 加入缓存；全部取自系统词语结果时，该结果本身即可再次命中 */
+  if (query_cache_ && task_amount != 0) {
+    std::vector<PhraseProxyStorage *> cache_list;
+    cache_list.reserve(valid_amount);
+    for (count = 0; count < valid_amount; ++count)
+      cache_list.push_back((*(storage_array + count))->Clone(NULL));
+    query_cache_->Insert(key,
+                         profile->GetFuzzyMask(chars_proxy->major_index_),
+                         generation, &cache_list);
+  }
+
+  return valid_amount != 0 ? storage_array : NULL;
+}
+
+/**
+ * 预先查询系统词语，结果只加入查询缓存.
+ * 供后台线程(如拼音预测者)调用：只扫描加载后不再变化的系统词语集合，
+ * 不接触可能正被其他线程修改的用户词语，因此无需与修改者同步.
+ * 此后同一查询的完整查询只需再扫描用户词语. \n
+ * 各集合依次在调用者线程中扫描，不使用并行查询的线程池；
+ * 每个集合开始扫描前检查中止标志，中止后不加入任何结果. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param abort 中止标志(非0表示中止，可由其他线程设置)
+ * @param arena 临时内存区
+ */
+void PhraseManager::PrefetchSystemPhrase(const FuzzyProfile *profile,
+                                         const CharsProxy *chars_proxy,
+                                         int chars_proxy_length,
+                                         const int *abort,
+                                         PhraseArena *arena) const {
+  if (!query_cache_ || chars_proxy_length <= 0)
+    return;
+
+  /* 完整结果或系统词语结果已在缓存中则无需查询 */
+  std::string key;
+  uint generation;
+  PhraseQueryCache::PackKey('M', profile, chars_proxy, chars_proxy_length,
+                            &key);
+  if (query_cache_->Peek(key, NULL, NULL, &generation))
+    return;
+  PhraseQueryCache::PackKey('S', profile, chars_proxy, chars_proxy_length,
+                            &key);
+  if (query_cache_->Peek(key, NULL, NULL, &generation))
+    return;
+
+  /* 依次扫描各系统词语集合 */
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  std::vector<PhraseProxyStorage *> cache_list;
+  bool aborted = false;
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator) {
+    if ((*iterator)->type_ != SYSTEM_TYPE)
+      continue;
+    if (__atomic_load_n(abort, __ATOMIC_RELAXED)) {
+      aborted = true;
+      break;
+    }
+    PhraseMatchTask task;
+    PhraseProxyStorage *storage = new (arena) PhraseProxyStorage(arena);
+    (*iterator)->Ref();
+    storage->phrase_proxy_site_ = *iterator;
+    task.phrase_proxy_storage_ = storage;
+    task.profile_ = profile;
+    task.chars_proxy_ = chars_proxy;
+    task.chars_proxy_length_ = chars_proxy_length;
+    task.arena_ = arena;
+    task.Run();
+    if (storage->valid_)
+      cache_list.push_back(storage->Clone(NULL));
+    storage->Release();
+  }
+  site_set->Unref();
+
+  /* 加入缓存 */
+  if (aborted) {
+    STL_DELETE_DATA(cache_list, std::vector<PhraseProxyStorage *>);
+    return;
+  }
+  query_cache_->Insert(key, profile->GetFuzzyMask(chars_proxy->major_index_),
+                       generation, &cache_list);
 }
 
 /**
  * 查找与汉字代理数组最相匹配的词语数据代理.
+ * @param profile 模糊拼音配置
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组的有效长度
  * @return 词语数据代理储存点
  */
 PhraseProxyStorage *PhraseManager::SearchPreferPhrase(
+                                       const FuzzyProfile *profile,
                                        const CharsProxy *chars_proxy,
                                        int chars_proxy_length) const {
-  /* 查找最佳词语 */
-  PhraseProxySite *phrase_proxy_site = NULL;
-  PhraseProxy *phrase_proxy = NULL;
-  for (std::list<PhraseProxySite *>::const_iterator iterator =
-           phrase_proxy_site_list_.begin();
-       iterator != phrase_proxy_site_list_.end();
+  if (chars_proxy_length <= 0)
+    return NULL;
+
+  /* 查询缓存 */
+  std::string key;
+  uint generation = 0;
+  if (query_cache_) {
+    PhraseQueryCache::PackKey('P', profile, chars_proxy, chars_proxy_length,
+                              &key);
+    std::vector<PhraseProxyStorage *> cache_list;
+    if (query_cache_->Search(key, NULL, &cache_list, &generation))
+      return cache_list.empty() ? NULL : cache_list.front();
+  }
+
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+
+  /* 为每个集合创建查询任务 */
+  int amount = site_set->site_list_.size();
+  PhrasePreferTask *tasks = new PhrasePreferTask[amount];
+  ThreadTask **task_array = new ThreadTask *[amount];
+  uint cost = 0;
+  int count = 0;
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
        ++iterator) {
-    PhraseProxySite *local_phrase_proxy_site = *iterator;
-    AbstractPhrase *phrase = local_phrase_proxy_site->phrase_;
-    PhraseProxy *local_phrase_proxy =
-        phrase->SearchPreferPhrase(chars_proxy, chars_proxy_length);
-    if (!local_phrase_proxy)
+    PhrasePreferTask *task = tasks + count;
+    task->phrase_proxy_site_ = *iterator;
+    task->profile_ = profile;
+    task->chars_proxy_ = chars_proxy;
+    task->chars_proxy_length_ = chars_proxy_length;
+    *(task_array + count) = task;
+    if (search_pool_)
+      cost += (*iterator)->phrase_->EstimateSearchCost(profile, chars_proxy,
+                                                       chars_proxy_length);
+    ++count;
+  }
+
+  /* 执行查询，并按集合次序查找最佳词语 */
+  RunSearchTasks(task_array, amount, cost);
+  PhrasePreferTask *selected_task = NULL;
+  for (count = 0; count < amount; ++count) {
+    PhrasePreferTask *task = tasks + count;
+    if (!task->phrase_proxy_)
       continue;
-    if (!phrase_proxy ||
-        phrase_proxy->chars_proxy_length_ <
-            local_phrase_proxy->chars_proxy_length_ ||
-        (phrase_proxy->chars_proxy_length_ ==
-             local_phrase_proxy->chars_proxy_length_ &&
-         phrase_proxy_site->priority_ <
-             local_phrase_proxy_site->priority_)) {
-      delete phrase_proxy;
-      phrase_proxy_site = local_phrase_proxy_site;
-      phrase_proxy = local_phrase_proxy;
-    } else {
-      delete local_phrase_proxy;
-    }
+    if (!selected_task ||
+        IsPreferPhraseProxy(task->phrase_proxy_site_, task->phrase_proxy_,
+                            selected_task->phrase_proxy_site_,
+                            selected_task->phrase_proxy_))
+      selected_task = task;
   }
 
   /* 构建返回值 */
   PhraseProxyStorage *phrase_proxy_storage = NULL;
-  if (phrase_proxy) {
+  if (selected_task) {
     phrase_proxy_storage = new PhraseProxyStorage;
-    phrase_proxy_storage->phrase_proxy_site_ = phrase_proxy_site;
-    phrase_proxy_storage->phrase_proxy_list_ = new std::list<PhraseProxy *>;
-    phrase_proxy_storage->phrase_proxy_list_->push_back(phrase_proxy);
+    selected_task->phrase_proxy_site_->Ref();
+    phrase_proxy_storage->phrase_proxy_site_ =
+        selected_task->phrase_proxy_site_;
+    phrase_proxy_storage->phrase_proxy_ = *selected_task->phrase_proxy_;
+    phrase_proxy_storage->valid_ = true;
+  }
+  delete [] task_array;
+  delete [] tasks;
+  site_set->Unref();
+
+  /* 加入缓存 */
+  if (query_cache_) {
+    std::vector<PhraseProxyStorage *> cache_list;
+    if (phrase_proxy_storage)
+      cache_list.push_back(phrase_proxy_storage->Clone(NULL));
+    query_cache_->Insert(key,
+                         profile->GetFuzzyMask(chars_proxy->major_index_),
+                         generation, &cache_list);
   }
 
   return phrase_proxy_storage;
 }
 
+/**
+ * 查找以汉字代理数组开头的各长度下最相匹配的词语数据代理.
+ * 一次查询即给出某一起点的全部候选跨度，同一长度下按(PhraseManager::
+ * IsPreferPhraseProxy)的次序归并各集合的候选词语；结果不进入查询缓存，
+ * 由调用者自行保留. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param min_length 需要查找的最小长度
+ * @param width 每个长度下最多保留的词语数量
+ * @param storage_array 各长度的储存点(长度n的储存点始于下标(n-1)*width，
+ * 最佳者在前，没有则保持无效)，只写入不小于最小长度的元素，这些元素应为空
+ * @param arena 分配查询期间临时数据的临时内存区
+ */
+void PhraseManager::SearchPreferSpan(const FuzzyProfile *profile,
+                                     const CharsProxy *chars_proxy,
+                                     int chars_proxy_length, int min_length,
+                                     int width,
+                                     PhraseProxyStorage *storage_array,
+                                     PhraseArena *arena) const {
+  if (min_length < 1)
+    min_length = 1;
+  if (chars_proxy_length < min_length)
+    return;
+
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+
+  /* 为每个集合创建查询任务 */
+  int amount = site_set->site_list_.size();
+  PhraseSpanTask *tasks = arena->NewArray<PhraseSpanTask>(amount);
+  ThreadTask **task_array = arena->NewArray<ThreadTask *>(amount);
+  uint cost = 0;
+  int count = 0;
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator) {
+    PhraseSpanTask *task = tasks + count;
+    task->phrase_proxy_site_ = *iterator;
+    task->profile_ = profile;
+    task->chars_proxy_ = chars_proxy;
+    task->chars_proxy_length_ = chars_proxy_length;
+    task->min_length_ = min_length;
+    task->width_ = width;
+    task->span_array_ =
+        arena->NewArray<PhraseProxy>(chars_proxy_length * width);
+    *(task_array + count) = task;
+    if (search_pool_)
+      cost += (*iterator)->phrase_->EstimateSearchCost(profile, chars_proxy,
+                                                       chars_proxy_length);
+    ++count;
+  }
+
+  /* 执行查询，并按集合次序归并各长度下的候选词语 */
+  RunSearchTasks(task_array, amount, cost);
+  int *head = arena->NewArray<int>(amount);  // 各集合下一个候选词语的位置
+  for (int length = min_length; length <= chars_proxy_length; ++length) {
+    for (count = 0; count < amount; ++count)
+      *(head + count) = 0;
+    PhraseProxyStorage *storage = storage_array + (length - 1) * width;
+    for (int number = 0; number < width; ++number) {
+      PhraseSpanTask *selected_task = NULL;
+      const PhraseProxy *selected_proxy = NULL;
+      int selected_count = 0;
+      for (count = 0; count < amount; ++count) {
+        PhraseSpanTask *task = tasks + count;
+        if (*(head + count) == width)
+          continue;
+        const PhraseProxy *phrase_proxy =
+            task->span_array_ + (length - 1) * width + *(head + count);
+        if (phrase_proxy->chars_proxy_length_ == 0)
+          continue;
+        if (!selected_task ||
+            IsPreferPhraseProxy(task->phrase_proxy_site_, phrase_proxy,
+                                selected_task->phrase_proxy_site_,
+                                selected_proxy)) {
+          selected_task = task;
+          selected_proxy = phrase_proxy;
+          selected_count = count;
+        }
+      }
+      if (!selected_task)
+        break;
+      ++*(head + selected_count);
+      PhraseProxyStorage *phrase_proxy_storage = storage + number;
+      selected_task->phrase_proxy_site_->Ref();
+      phrase_proxy_storage->phrase_proxy_site_ =
+          selected_task->phrase_proxy_site_;
+      phrase_proxy_storage->phrase_proxy_ = *selected_proxy;
+      phrase_proxy_storage->valid_ = true;
+    }
+  }
+  site_set->Unref();
+}
+
+/**
+ * 统计与汉字代理数组相匹配的词语数据代理的总数.
+ * 各集合只统计匹配项的数量，不创建任何游标或词语数据. 不同集合中
+ * 内容相同的词语各计一次，因此这是去重后候选词语数量的上限. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @return 词语数据代理总数
+ */
+uint PhraseManager::CountMatchablePhrase(const FuzzyProfile *profile,
+                                         const CharsProxy *chars_proxy,
+                                         int chars_proxy_length) const {
+  if (chars_proxy_length <= 0)
+    return 0;
+
+  uint amount = 0;
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator)
+    amount += (*iterator)->phrase_->CountMatchPhrase(profile, chars_proxy,
+                                                     chars_proxy_length);
+  site_set->Unref();
+  return amount;
+}
+
 /**
  * 获取拼音矫正表.
  * @return 拼音矫正表
@@ -332,6 +1146,38 @@ const std::list<OuterMendPinyinPair *> *PhraseManager::GetMendPinyinTable() cons
   return &mend_pair_table_;
 }
 
+/**
+ * 获取默认的模糊拼音配置.
+ * @return 模糊拼音配置(在本类销毁之前始终有效)
+ */
+const FuzzyProfile *PhraseManager::GetFuzzyProfile() const {
+  return __atomic_load_n(&fuzzy_profile_, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * 比较两个词语数据代理的优先次序.
+ * 匹配长度越长越优先;长度相同时用户词语优先于系统词语; \n
+ * 其次比较词语的(量化)频率，最后才比较集合的优先级. \n
+ * @param site1 前者所属集合
+ * @param proxy1 前者
+ * @param site2 后者所属集合
+ * @param proxy2 后者
+ * @return 前者是否优先于后者
+ */
+bool PhraseManager::IsPreferPhraseProxy(const PhraseProxySite *site1,
+                                        const PhraseProxy *proxy1,
+                                        const PhraseProxySite *site2,
+                                        const PhraseProxy *proxy2) {
+  if (proxy1->chars_proxy_length_ != proxy2->chars_proxy_length_)
+    return proxy1->chars_proxy_length_ > proxy2->chars_proxy_length_;
+  if (site1->type_ != site2->type_)
+    return site1->type_ == USER_TYPE;
+  if (site1->type_ == SYSTEM_TYPE &&
+      proxy1->frequency_ != proxy2->frequency_)
+    return proxy1->frequency_ > proxy2->frequency_;
+  return site1->priority_ > site2->priority_;
+}
+
 /**
  * 获取实例对象.
  * @return 实例对象
@@ -345,38 +1191,51 @@ PhraseManager *PhraseManager::GetInstance() {
  * 类构造函数.
  */
 PhraseManager::PhraseManager()
-    : fuzzy_pair_table_(NULL), user_path_(NULL), backup_path_(NULL) {
-  PinyinParser pinyin_parser;
-  int8_t amount = pinyin_parser.GetPinyinUnitPartsAmount();
-  fuzzy_pair_table_ = (int8_t **)malloc(sizeof(int8_t *) * amount);
-  for (int8_t count = 0; count < amount; ++count) {
-    *(fuzzy_pair_table_ + count) = (int8_t *)malloc(sizeof(int8_t) * 2);
-    **(fuzzy_pair_table_ + count) = count;
-    *(*(fuzzy_pair_table_ + count) + 1) = -1;
-  }
+    : phrase_proxy_site_set_(NULL), reload_ticket_(0), reload_serving_(0),
+      fuzzy_profile_(NULL), phrase_hits_(false), share_memory_(false),
+      query_planner_(false), incremental_search_(false),
+      search_pool_(NULL), index_pool_(NULL), query_cache_(NULL),
+      user_path_(NULL),
+      backup_path_(NULL) {
+  phrase_proxy_site_set_ = new PhraseProxySiteSet;
+  pthread_mutex_init(&site_mutex_, NULL);
+  pthread_mutex_init(&reload_mutex_, NULL);
+  pthread_cond_init(&reload_cond_, NULL);
+  PublishFuzzyProfile(new FuzzyProfile);
 }
 
 /**
  * 类析构函数.
  */
 PhraseManager::~PhraseManager() {
+  /* 等待后台重载任务结束 */
+  WaitPhraseProxySiteReload();
+  /* 释放并行查询的线程池 */
+  delete search_pool_;
+  /* 释放查询缓存 */
+  delete query_cache_;
   /* 备份用户词语 */
   BackupUserPhrase();
-  /* 释放集合链表 */
-  STL_DELETE_DATA(phrase_proxy_site_list_, std::list<PhraseProxySite *>);
+  /* 释放集合快照 */
+  phrase_proxy_site_set_->Unref();
+  /* 释放建立索引的线程池，系统词语集合释放时需要用它撤销任务 */
+  delete index_pool_;
+  pthread_mutex_destroy(&site_mutex_);
+  pthread_mutex_destroy(&reload_mutex_);
+  pthread_cond_destroy(&reload_cond_);
   /* 释放拼音矫正表 */
   STL_DELETE_DATA(mend_pair_table_, std::list<OuterMendPinyinPair *>);
-  /* 释放模糊拼音对照表 */
-  PinyinParser pinyin_parser;
-  int8_t amount = pinyin_parser.GetPinyinUnitPartsAmount();
-  for (int8_t count = 0; count < amount; ++count)
-    free(*(fuzzy_pair_table_ + count));
-  free(fuzzy_pair_table_);
+  /* 释放模糊拼音配置 */
+  for (std::vector<const FuzzyProfile *>::iterator iterator =
+           profile_list_.begin();
+       iterator != profile_list_.end();
+       ++iterator)
+    (*iterator)->Unref();
   /* 释放码表路径 */
   free(user_path_);
   unlink(backup_path_);  // 移除备份文件
   free(backup_path_);
- }
+}
 
 /**
  * 分割码表文件信息串的各部分.
@@ -408,7 +1267,8 @@ bool PhraseManager::BreakMbfileString(char *string, const char **mbfile,
  * @param mbfile 码表文件
  * @param priority 优先级
  * @param type 集合类型
- * @return 词语数据代理的集合
+ * @return 词语数据代理的集合，码表加载失败则返回NULL
+ * @note 本函数可以在多个线程中同时执行.
  */
 PhraseProxySite *PhraseManager::CreatePhraseProxySite(
                                     const char *mbfile, int priority,
@@ -424,10 +1284,342 @@ PhraseProxySite *PhraseManager::CreatePhraseProxySite(
     default:
       assert(false);
   }
-  phrase_proxy_site->phrase_->BuildPhraseTree(mbfile);
-  phrase_proxy_site->phrase_->SetFuzzyPinyinTable(
-      (const int8_t **)fuzzy_pair_table_);
+  AbstractPhrase *phrase = phrase_proxy_site->phrase_;
+  bool success = false;
+  if (type == SYSTEM_TYPE && share_memory_)
+    success = ((SystemPhrase *)phrase)->MapPhraseTree(mbfile);
+  else
+    success = phrase->BuildPhraseTree(mbfile);
+  if (!success) {
+    phrase_proxy_site->Unref();
+    return NULL;
+  }
+  if (type == SYSTEM_TYPE && phrase_hits_)
+    ((SystemPhrase *)phrase_proxy_site->phrase_)->EnablePhraseHits();
+  if (type == SYSTEM_TYPE && query_planner_)
+    ((SystemPhrase *)phrase_proxy_site->phrase_)->EnableExactIndex(index_pool_);
+  phrase_proxy_site->mbfile_ = strdup(mbfile);
+  phrase_proxy_site->phrase_->SetScanPool(search_pool_);
   phrase_proxy_site->priority_ = priority;
   phrase_proxy_site->type_ = type;
   return phrase_proxy_site;
 }
+
+/**
+ * 按系统码表配置文件加载词语数据代理集合.
+ * 各码表由线程池并行加载，本函数可以在后台线程中执行. \n
+ * @param config 系统码表配置文件
+ * @param filename 需要加载的码表文件名(NULL表示全部)
+ * @return 新集合表(集合已被引用)，配置文件无法打开则返回NULL
+ */
+std::vector<PhraseProxySite *> *PhraseManager::LoadSystemPhraseProxySite(
+                                                 const char *config,
+                                                 const char *filename) {
+  /* 打开系统码表配置文件 */
+  FILE *stream = fopen(config, "r");
+  if (!stream) {
+    pwarning("Fopen file \"%s\" failed, %s", config, strerror(errno));
+    return NULL;
+  }
+
+  /* 获取路径 */
+  char *path = strdup(config);
+  const char *dir = dirname(path);
+
+  /* 读取文件数据、分析并为每个码表创建加载任务 */
+  std::vector<PhraseLoadTask *> task_list;
+  char *lineptr = NULL;
+  size_t n = 0;
+  while (getline(&lineptr, &n, stream) != -1) {
+    const char *local_filename(NULL), *priority(NULL);
+    if (!BreakMbfileString(lineptr, &local_filename, &priority))
+      continue;
+    if (filename && strcmp(filename, local_filename) != 0)
+      continue;
+    PhraseLoadTask *task = new PhraseLoadTask;
+    task->manager_ = this;
+    asprintf(&task->mbfile_, "%s/%s", dir, local_filename);
+    task->priority_ = atoi(priority);
+    task_list.push_back(task);
+  }
+  free(lineptr);
+
+  /* 并行加载各码表(加载以等待磁盘为主，线程数不少于MIN_LOAD_THREAD) */
+  if (!task_list.empty()) {
+    int max_thread = ThreadPool::GetProcessorAmount();
+    if (max_thread < MIN_LOAD_THREAD)
+      max_thread = MIN_LOAD_THREAD;
+    if ((size_t)max_thread > task_list.size())
+      max_thread = task_list.size();
+    ThreadPool thread_pool(max_thread);
+    for (std::vector<PhraseLoadTask *>::iterator iterator = task_list.begin();
+         iterator != task_list.end();
+         ++iterator)
+      thread_pool.PushTask(*iterator);
+    thread_pool.WaitTask();
+  }
+
+  /* 按配置次序收集集合，加载失败的码表沿用原有集合(若存在) */
+  std::vector<PhraseProxySite *> *site_list = new std::vector<PhraseProxySite *>;
+  for (std::vector<PhraseLoadTask *>::iterator iterator = task_list.begin();
+       iterator != task_list.end();
+       ++iterator) {
+    PhraseLoadTask *task = *iterator;
+    PhraseProxySite *phrase_proxy_site = task->phrase_proxy_site_;
+    if (phrase_proxy_site) {
+      phrase_proxy_site->config_ = strdup(config);
+    } else {
+      pwarning("Load system mb file \"%s\" failed", task->mbfile_);
+      phrase_proxy_site = AcquireSystemPhraseProxySite(config, task->mbfile_);
+    }
+    if (phrase_proxy_site)
+      site_list->push_back(phrase_proxy_site);
+  }
+  STL_DELETE_DATA(task_list, std::vector<PhraseLoadTask *>);
+
+  /* 释放资源 */
+  free(path);
+  fclose(stream);
+
+  return site_list;
+}
+
+/**
+ * 以新集合替换配置文件的旧集合，并发布新的快照.
+ * 新集合被放在第一个旧集合的位置上，若无旧集合则追加到末尾. \n
+ * @param config 系统码表配置文件
+ * @param filename 被替换的码表文件名(NULL表示全部)
+ * @param site_list 新集合表，其引用将转交给新快照
+ */
+void PhraseManager::ReplaceSystemPhraseProxySite(
+                        const char *config, const char *filename,
+                        std::vector<PhraseProxySite *> *site_list) {
+  /* 计算被替换码表的完整路径 */
+  char *mbfile = NULL;
+  if (filename) {
+    char *path = strdup(config);
+    asprintf(&mbfile, "%s/%s", dirname(path), filename);
+    free(path);
+  }
+
+  /* 构建新的集合快照 */
+  PhraseProxySiteSet *site_set = new PhraseProxySiteSet;
+  bool inserted = false;
+  pthread_mutex_lock(&site_mutex_);
+  PhraseProxySiteSet *old_site_set = phrase_proxy_site_set_;
+  for (std::vector<PhraseProxySite *>::iterator iterator =
+           old_site_set->site_list_.begin();
+       iterator != old_site_set->site_list_.end();
+       ++iterator) {
+    PhraseProxySite *phrase_proxy_site = *iterator;
+    if (phrase_proxy_site->type_ == SYSTEM_TYPE &&
+        strcmp(phrase_proxy_site->config_, config) == 0 &&
+        (!mbfile || strcmp(phrase_proxy_site->mbfile_, mbfile) == 0)) {
+      if (!inserted) {
+        site_set->site_list_.insert(site_set->site_list_.end(),
+                                    site_list->begin(), site_list->end());
+        inserted = true;
+      }
+      continue;
+    }
+    phrase_proxy_site->Ref();
+    site_set->site_list_.push_back(phrase_proxy_site);
+  }
+  if (!inserted) {
+    site_set->site_list_.insert(site_set->site_list_.end(),
+                                site_list->begin(), site_list->end());
+  }
+
+  /* 发布新快照，旧快照待查询者全部释放后自动销毁 */
+  phrase_proxy_site_set_ = site_set;
+  pthread_mutex_unlock(&site_mutex_);
+  old_site_set->Unref();
+  FlushQueryCache();
+  free(mbfile);
+}
+
+/**
+ * 发起一个后台重载任务.
+ * 重载任务按发起的先后次序依次执行. \n
+ * @param config 系统码表配置文件
+ * @param filename 需要重载的码表文件名(NULL表示全部)
+ */
+void PhraseManager::StartPhraseProxySiteReload(const char *config,
+                                               const char *filename) {
+  PhraseReloadTask *task = new PhraseReloadTask;
+  task->manager_ = this;
+  task->config_ = strdup(config);
+  task->filename_ = filename ? strdup(filename) : NULL;
+  pthread_mutex_lock(&reload_mutex_);
+  task->ticket_ = reload_ticket_++;
+  pthread_mutex_unlock(&reload_mutex_);
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int error = pthread_create(&thread, &attr, ReloadThread, task);
+  pthread_attr_destroy(&attr);
+  if (error != 0) {
+    pwarning("Create reload thread failed, %s", strerror(error));
+    ReloadThread(task);
+  }
+}
+
+/**
+ * 一组查询任务是否会被分派到线程池.
+ * @param amount 任务数量
+ * @param cost 查询代价
+ * @return BOOL
+ */
+bool PhraseManager::IsParallelSearch(int amount, uint cost) const {
+  return search_pool_ && amount > 1 && cost >= PARALLEL_SEARCH_COST;
+}
+
+/**
+ * 执行一组查询任务.
+ * 已启用并行查询且代价足够大时分派到线程池，否则在调用线程中依次执行. \n
+ * @param tasks 任务数组
+ * @param amount 任务数量
+ * @param cost 查询代价
+ */
+void PhraseManager::RunSearchTasks(ThreadTask *const *tasks, int amount,
+                                   uint cost) const {
+  if (IsParallelSearch(amount, cost)) {
+    search_pool_->RunTasks(tasks, amount);
+    return;
+  }
+  for (int count = 0; count < amount; ++count)
+    (*(tasks + count))->Run();
+}
+
+/**
+ * 发布新的默认模糊拼音配置.
+ * 曾经发布过的配置都保留到本类销毁为止，因此读取默认配置时无需加锁.
+ * 查询缓存的键值含有配置的序号，旧配置下的条目不会再被命中. \n
+ * 与默认配置的模糊关系相同时不再发布，重复应用同样的设置不会累积配置. \n
+ * @param profile 模糊拼音配置(其引用转交给本类)
+ */
+void PhraseManager::PublishFuzzyProfile(const FuzzyProfile *profile) {
+  const FuzzyProfile *current = GetFuzzyProfile();
+  if (current && current->IsSameFuzzy(profile)) {
+    profile->Unref();
+    return;
+  }
+  profile_list_.push_back(profile);
+  __atomic_store_n(&fuzzy_profile_, profile, __ATOMIC_RELEASE);
+}
+
+/**
+ * 使查询缓存整体失效.
+ */
+void PhraseManager::FlushQueryCache() const {
+  if (query_cache_)
+    query_cache_->Flush();
+}
+
+/**
+ * 使可能扫描到某用户词语的查询缓存条目失效.
+ * 用户词语树只有该词语所在的索引节点发生变化，
+ * 首个汉字代理与之模糊匹配的查询才会扫描此节点. \n
+ * @param phrase_datum 词语数据
+ */
+void PhraseManager::FlushQueryCache(const PhraseDatum *phrase_datum) const {
+  if (query_cache_) {
+    query_cache_->Flush(phrase_datum->chars_proxy_->major_index_);
+  }
+}
+
+/**
+ * 获取当前发布的集合快照.
+ * @return 集合快照(已被引用，用毕需调用Unref())
+ */
+const PhraseProxySiteSet *PhraseManager::AcquirePhraseProxySiteSet() const {
+  pthread_mutex_lock(&site_mutex_);
+  const PhraseProxySiteSet *site_set = phrase_proxy_site_set_;
+  site_set->Ref();
+  pthread_mutex_unlock(&site_mutex_);
+  return site_set;
+}
+
+/**
+ * 获取由配置文件加载的系统词语数据代理集合.
+ * @param config 系统码表配置文件
+ * @param mbfile 码表文件
+ * @return 系统集合(已被引用，用毕需调用Unref())，不存在则返回NULL
+ */
+PhraseProxySite *PhraseManager::AcquireSystemPhraseProxySite(
+                                    const char *config,
+                                    const char *mbfile) const {
+  PhraseProxySite *phrase_proxy_site = NULL;
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator) {
+    if ((*iterator)->type_ == SYSTEM_TYPE &&
+        strcmp((*iterator)->config_, config) == 0 &&
+        strcmp((*iterator)->mbfile_, mbfile) == 0) {
+      phrase_proxy_site = *iterator;
+      phrase_proxy_site->Ref();
+      break;
+    }
+  }
+  site_set->Unref();
+  return phrase_proxy_site;
+}
+
+/**
+ * 获取用户词语数据代理集合.
+ * @return 用户集合(已被引用，用毕需调用Unref())，不存在则返回NULL
+ */
+PhraseProxySite *PhraseManager::AcquireUserPhraseProxySite() const {
+  PhraseProxySite *phrase_proxy_site = NULL;
+  const PhraseProxySiteSet *site_set = AcquirePhraseProxySiteSet();
+  for (std::vector<PhraseProxySite *>::const_iterator iterator =
+           site_set->site_list_.begin();
+       iterator != site_set->site_list_.end();
+       ++iterator) {
+    if ((*iterator)->type_ == USER_TYPE) {
+      phrase_proxy_site = *iterator;
+      phrase_proxy_site->Ref();
+      break;
+    }
+  }
+  site_set->Unref();
+  return phrase_proxy_site;
+}
+
+/**
+ * 后台重载线程.
+ * @param arg 重载任务
+ * @return NULL
+ */
+void *PhraseManager::ReloadThread(void *arg) {
+  PhraseReloadTask *task = (PhraseReloadTask *)arg;
+  PhraseManager *manager = task->manager_;
+
+  /* 等待此前的任务完成 */
+  pthread_mutex_lock(&manager->reload_mutex_);
+  while (manager->reload_serving_ != task->ticket_)
+    pthread_cond_wait(&manager->reload_cond_, &manager->reload_mutex_);
+  pthread_mutex_unlock(&manager->reload_mutex_);
+
+  /* 加载并替换集合，此期间查询仍使用旧快照 */
+  std::vector<PhraseProxySite *> *site_list =
+      manager->LoadSystemPhraseProxySite(task->config_, task->filename_);
+  if (site_list) {
+    manager->ReplaceSystemPhraseProxySite(task->config_, task->filename_,
+                                          site_list);
+    delete site_list;
+  }
+
+  /* 通知后续任务 */
+  pthread_mutex_lock(&manager->reload_mutex_);
+  ++manager->reload_serving_;
+  pthread_cond_broadcast(&manager->reload_cond_);
+  pthread_mutex_unlock(&manager->reload_mutex_);
+  delete task;
+
+  return NULL;
+}
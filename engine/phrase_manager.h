@@ -7,6 +7,21 @@
 // e.g.: pinyin1.mb 18
 //       pinyin2.mb 12
 //       pinyin3.mb 50
+// 各集合的词语按(匹配长度,用户词语,词语频率,优先级)的次序合并.
+// 配置文件中的各码表由线程池并行加载，加载完成后按配置次序加入集合表.
+// 启用并行查询后，代价较大的查询会分派到常驻线程池中，各集合同时扫描.
+// 配置中没有模糊拼音对时，各集合改用精确匹配的查询内核.
+// 启用查询改写后，系统码表建立精确索引，模糊查询被展开为若干精确键值直接定位.
+// 启用增量查询后，新查询的游标由上次查询的游标派生，只细化了的部分不再重复扫描.
+// 模糊拼音以不可变的配置(FuzzyProfile)表示，每次查询都指明所用的配置，
+// 各编辑器因此可以采用不同的配置；设置模糊拼音对只是发布新的默认配置.
+// 启用查询缓存后，近期查询的结果(游标的扫描进度)按(模糊拼音配置,汉字代理数组)
+// 缓存，集合快照变化时缓存整体失效，用户词语变化时只有可能扫描到
+// 该词语的条目失效.
+// 系统码表可以在后台重新加载，加载完成后以新快照整体替换旧的集合表，
+// 查询者始终持有某一快照的引用，因此重载期间查询不会被阻塞.
+// 系统词语加载后不再变化，可由任意线程查询；用户词语没有锁保护，
+// 其查询与修改(反馈、删除)必须在同一线程中进行，后台线程只预先查询系统词语.
 //
 // Author: Jally <jallyx@163.com>, (C) 2009, 2010
 //
@@ -16,9 +31,17 @@
 #ifndef PYE_ENGINE_PHRASE_MANAGER_H_
 #define PYE_ENGINE_PHRASE_MANAGER_H_
 
+#include <pthread.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 #include "abstract_phrase.h"
 #include "pye_global.h"
 
+class ThreadPool;
+class ThreadTask;
+
 /**
  * 外部拼音纠错对.
  */
@@ -44,32 +67,204 @@ typedef enum {
 
 /**
  * 词语数据代理的集合.
+ * 集合采用引用计数管理，最后一个持有者释放引用时集合才被销毁. \n
  */
 class PhraseProxySite {
  public:
-  PhraseProxySite() : phrase_(NULL), type_(SYSTEM_TYPE), priority_(0) {}
-  ~PhraseProxySite() {
-    delete phrase_;
+  PhraseProxySite()
+      : mbfile_(NULL), config_(NULL), phrase_(NULL), type_(SYSTEM_TYPE),
+        priority_(0), reference_(1) {}
+
+  /**
+   * 增加引用计数.
+   */
+  void Ref() const {
+    __sync_add_and_fetch(&reference_, 1);
+  }
+  /**
+   * 减少引用计数，计数归零时销毁本集合.
+   */
+  void Unref() const {
+    if (__sync_sub_and_fetch(&reference_, 1) == 0)
+      delete this;
   }
 
+  char *mbfile_;  ///< 码表文件
+  char *config_;  ///< 所属的系统码表配置文件
   AbstractPhrase *phrase_;  ///< 词语类
   PhraseProxySiteType type_;  ///< 类型
   int priority_;  ///< 优先级
+
+ private:
+  ~PhraseProxySite() {
+    free(mbfile_);
+    free(config_);
+    delete phrase_;
+  }
+
+  mutable int reference_;  ///< 引用计数
+};
+
+/**
+ * 词语数据代理集合的快照.
+ * 快照一经发布便不再修改，查询者持有其引用期间，快照及其中的集合均不会被销毁. \n
+ */
+class PhraseProxySiteSet {
+ public:
+  PhraseProxySiteSet() : reference_(1) {}
+
+  /**
+   * 增加引用计数.
+   */
+  void Ref() const {
+    __sync_add_and_fetch(&reference_, 1);
+  }
+  /**
+   * 减少引用计数，计数归零时销毁本快照.
+   */
+  void Unref() const {
+    if (__sync_sub_and_fetch(&reference_, 1) == 0)
+      delete this;
+  }
+
+  std::vector<PhraseProxySite *> site_list_;  ///< 集合表(各集合已被引用)
+
+ private:
+  ~PhraseProxySiteSet() {
+    for (std::vector<PhraseProxySite *>::iterator iterator = site_list_.begin();
+         iterator != site_list_.end();
+         ++iterator)
+      (*iterator)->Unref();
+  }
+
+  mutable int reference_;  ///< 引用计数
 };
 
 /**
  * 词语数据代理的储存点.
+ * 储存点只保存游标给出的下一个词语数据代理，其余词语在需要时才被扫描. \n
+ * 由临时内存区分配的储存点以Release()释放. \n
  */
 class PhraseProxyStorage {
  public:
-  PhraseProxyStorage() : phrase_proxy_site_(NULL), phrase_proxy_list_(NULL) {}
+  explicit PhraseProxyStorage(PhraseArena *arena = NULL)
+      : phrase_proxy_site_(NULL), phrase_cursor_(NULL), valid_(false),
+        arena_(arena) {}
   ~PhraseProxyStorage() {
-    STL_DELETE_DATA(*phrase_proxy_list_, std::list<PhraseProxy *>);
-    delete phrase_proxy_list_;
+    if (phrase_cursor_)
+      phrase_cursor_->Release();
+    if (phrase_proxy_site_)
+      phrase_proxy_site_->Unref();
+  }
+
+  /**
+   * 释放储存点.
+   * 由临时内存区分配的储存点只析构，内存随内存区回卷. \n
+   */
+  void Release() {
+    if (arena_)
+      this->~PhraseProxyStorage();
+    else
+      delete this;
   }
 
-  const PhraseProxySite *phrase_proxy_site_;  ///< 词语数据代理的集合
-  std::list<PhraseProxy *> *phrase_proxy_list_;  ///< 词语数据代理的链表
+  /**
+   * 从游标取出下一个词语数据代理.
+   * @return 是否还有词语
+   */
+  bool FetchPhraseProxy() {
+    valid_ = phrase_cursor_ && phrase_cursor_->Next(&phrase_proxy_);
+    return valid_;
+  }
+  /**
+   * 复制储存点.
+   * @param arena 分配新储存点的临时内存区(NULL 由堆分配)
+   * @return 新储存点，其游标与本储存点的游标互不影响
+   */
+  PhraseProxyStorage *Clone(PhraseArena *arena) const {
+    PhraseProxyStorage *storage = new (arena) PhraseProxyStorage(arena);
+    phrase_proxy_site_->Ref();
+    storage->phrase_proxy_site_ = phrase_proxy_site_;
+    if (phrase_cursor_)
+      storage->phrase_cursor_ = phrase_cursor_->Clone(arena);
+    storage->phrase_proxy_ = phrase_proxy_;
+    storage->valid_ = valid_;
+    return storage;
+  }
+  /**
+   * 与另一个储存点交换内容.
+   * 二者各自的分配方式不变. \n
+   * @param storage 储存点
+   */
+  void Swap(PhraseProxyStorage *storage) {
+    std::swap(phrase_proxy_site_, storage->phrase_proxy_site_);
+    std::swap(phrase_cursor_, storage->phrase_cursor_);
+    std::swap(phrase_proxy_, storage->phrase_proxy_);
+    std::swap(valid_, storage->valid_);
+  }
+
+  const PhraseProxySite *phrase_proxy_site_;  ///< 词语数据代理的集合(已被引用)
+  PhraseCursor *phrase_cursor_;  ///< 词语游标(可为NULL)
+  PhraseProxy phrase_proxy_;  ///< 下一个词语数据代理
+  bool valid_;  ///< phrase_proxy_是否有效
+
+ private:
+  PhraseArena *arena_;  ///< 分配本储存点的临时内存区(NULL 由堆分配)
+};
+
+/**
+ * 查询缓存的条目.
+ */
+class PhraseCacheEntry {
+ public:
+  PhraseCacheEntry() : index_mask_(0) {}
+  ~PhraseCacheEntry() {
+    STL_DELETE_DATA(storage_list_, std::vector<PhraseProxyStorage *>);
+  }
+
+  std::string key_;  ///< 键值
+  uint64_t index_mask_;  ///< 查询可能扫描到的索引值的位掩码
+  std::vector<PhraseProxyStorage *> storage_list_;  ///< 查询结果的储存点(可为空)
+};
+
+/**
+ * 查询缓存.
+ * 以打包的汉字代理数组为键值，按最近最少使用的原则淘汰条目.
+ * 每次整体失效都会使版本号递增，失效前开始的查询的结果不会再被加入缓存. \n
+ */
+class PhraseQueryCache {
+ public:
+  explicit PhraseQueryCache(size_t capacity);
+  ~PhraseQueryCache();
+
+  bool Search(const std::string &key, PhraseArena *arena,
+              std::vector<PhraseProxyStorage *> *storage_list, uint *generation);
+  bool Peek(const std::string &key, PhraseArena *arena,
+            std::vector<PhraseProxyStorage *> *storage_list, uint *generation);
+  void Insert(const std::string &key, uint64_t index_mask, uint generation,
+              std::vector<PhraseProxyStorage *> *storage_list);
+  void Flush();
+  void Flush(int8_t index);
+  void GetStats(uint *hits, uint *misses);
+
+  static void PackKey(char type, const FuzzyProfile *profile,
+                      const CharsProxy *chars_proxy, int chars_proxy_length,
+                      std::string *key);
+
+ private:
+  typedef std::list<PhraseCacheEntry *> EntryList;
+  typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+  bool LookupEntry(const std::string &key, PhraseArena *arena,
+                   std::vector<PhraseProxyStorage *> *storage_list);
+
+  EntryList entry_list_;  ///< 条目链表(最近使用的在前)
+  EntryMap entry_map_;  ///< 键值到条目的映射
+  size_t capacity_;  ///< 条目数量上限
+  uint generation_;  ///< 版本号
+  uint hits_;  ///< 命中次数
+  uint misses_;  ///< 未命中次数
+  pthread_mutex_t mutex_;  ///< 缓存锁
 };
 
 /**
@@ -80,24 +275,57 @@ class PhraseManager {
   /* 外部接口 */
   void CreateSystemPhraseProxySite(const char *config);
   void CreateUserPhraseProxySite(const char *mbfile);
+  void ReloadSystemPhraseProxySite(const char *config);
+  void ReloadSystemPhraseProxySite(const char *config, const char *filename);
+  void WaitPhraseProxySiteReload();
   void AppendMendPinyinPair(const char *raw, const char *mend);
   void AppendFuzzyPinyinPair(const char *unit1, const char *unit2);
   void ClearMendPinyinPair();
   void ClearFuzzyPinyinPair();
+  void SetFuzzyPinyinPairs(const char *const *units, int amount);
   void BackupUserPhrase();
+  void EnablePhraseHits();
+  void EnableShareMemory();
+  void EnableParallelSearch();
+  void EnableQueryCache();
+  void EnableQueryPlanner();
+  void EnableIncrementalSearch();
+  void ExportPhraseHits(const char *dir) const;
+  void GetQueryCacheStats(uint *hits, uint *misses) const;
 
   void DeletePhraseDatum(const PhraseDatum *phrase_datum) const;
   void FeedbackPhraseDatum(const PhraseDatum *phrase_datum) const;
-  std::list<PhraseProxyStorage *> *SearchMatchablePhrase(
-                                       const CharsProxy *chars_proxy,
-                                       int chars_proxy_length) const;
-  PhraseProxyStorage *SearchPreferPhrase(const CharsProxy *chars_proxy,
+  PhraseProxyStorage **SearchMatchablePhrase(
+      const FuzzyProfile *profile, const CharsProxy *chars_proxy,
+      int chars_proxy_length, PhraseProxyStorage *const *origin_array,
+      PhraseArena *arena) const;
+  void PrefetchSystemPhrase(const FuzzyProfile *profile,
+                            const CharsProxy *chars_proxy,
+                            int chars_proxy_length, const int *abort,
+                            PhraseArena *arena) const;
+  PhraseProxyStorage *SearchPreferPhrase(const FuzzyProfile *profile,
+                                         const CharsProxy *chars_proxy,
                                          int chars_proxy_length) const;
+  void SearchPreferSpan(const FuzzyProfile *profile,
+                        const CharsProxy *chars_proxy, int chars_proxy_length,
+                        int min_length, int width,
+                        PhraseProxyStorage *storage_array,
+                        PhraseArena *arena) const;
+  uint CountMatchablePhrase(const FuzzyProfile *profile,
+                            const CharsProxy *chars_proxy,
+                            int chars_proxy_length) const;
   const std::list<OuterMendPinyinPair *> *GetMendPinyinTable() const;
+  const FuzzyProfile *GetFuzzyProfile() const;
 
+  static bool IsPreferPhraseProxy(const PhraseProxySite *site1,
+                                  const PhraseProxy *proxy1,
+                                  const PhraseProxySite *site2,
+                                  const PhraseProxy *proxy2);
   static PhraseManager *GetInstance();
 
  private:
+  friend class PhraseLoadTask;
+
   PhraseManager();
   ~PhraseManager();
 
@@ -105,13 +333,57 @@ class PhraseManager {
                          const char **priority);
   PhraseProxySite *CreatePhraseProxySite(const char *mbfile, int priority,
                                          PhraseProxySiteType type);
+  std::vector<PhraseProxySite *> *LoadSystemPhraseProxySite(
+                                    const char *config,
+                                    const char *filename);
+  void ReplaceSystemPhraseProxySite(const char *config, const char *filename,
+                                    std::vector<PhraseProxySite *> *site_list);
+  void StartPhraseProxySiteReload(const char *config, const char *filename);
+  const PhraseProxySiteSet *AcquirePhraseProxySiteSet() const;
+  PhraseProxySite *AcquireSystemPhraseProxySite(const char *config,
+                                                const char *mbfile) const;
+  PhraseProxySite *AcquireUserPhraseProxySite() const;
+  bool IsParallelSearch(int amount, uint cost) const;
+  void RunSearchTasks(ThreadTask *const *tasks, int amount, uint cost) const;
+  void PublishFuzzyProfile(const FuzzyProfile *profile);
+  void FlushQueryCache() const;
+  void FlushQueryCache(const PhraseDatum *phrase_datum) const;
+  static void *ReloadThread(void *arg);
 
-  std::list<PhraseProxySite *> phrase_proxy_site_list_;  ///< 集合链表
+  PhraseProxySiteSet *phrase_proxy_site_set_;  ///< 当前发布的集合快照
+  mutable pthread_mutex_t site_mutex_;  ///< 快照发布锁
+  pthread_mutex_t reload_mutex_;  ///< 重载任务锁
+  pthread_cond_t reload_cond_;  ///< 重载任务条件变量
+  uint reload_ticket_;  ///< 下一个重载任务的序号
+  uint reload_serving_;  ///< 正在执行的重载任务的序号
   std::list<OuterMendPinyinPair *> mend_pair_table_;  ///< 拼音矫正表
-  int8_t **fuzzy_pair_table_;  ///< 模糊对照表
+  const FuzzyProfile *fuzzy_profile_;  ///< 默认的模糊拼音配置
+  std::vector<const FuzzyProfile *> profile_list_;  ///< 发布过的配置(已被引用)
+  bool phrase_hits_;  ///< 是否统计系统词语的命中次数
+  bool share_memory_;  ///< 是否以共享内存的方式加载系统码表
+  bool query_planner_;  ///< 是否为系统码表建立精确索引以改写查询
+  bool incremental_search_;  ///< 是否由上次查询的游标派生新游标
+  ThreadPool *search_pool_;  ///< 并行查询的线程池(未启用为NULL)
+  ThreadPool *index_pool_;  ///< 建立精确索引的线程池(未启用查询改写为NULL)
+  PhraseQueryCache *query_cache_;  ///< 查询缓存(未启用为NULL)
 
   char *user_path_;  ///< 用户码表路径
   char *backup_path_;  ///< 备份码表路径
 };
 
+/**
+ * 词语数据代理储存点的比较器.
+ * 比较两个储存点的下一个词语数据代理. \n
+ */
+class PhraseProxyStorageCmp {
+ public:
+  bool operator()(const PhraseProxyStorage *storage1,
+                  const PhraseProxyStorage *storage2) const {
+    return PhraseManager::IsPreferPhraseProxy(storage1->phrase_proxy_site_,
+                                              &storage1->phrase_proxy_,
+                                              storage2->phrase_proxy_site_,
+                                              &storage2->phrase_proxy_);
+  }
+};
+
 #endif  // PYE_ENGINE_PHRASE_MANAGER_H_
@@ -13,6 +13,51 @@
 #include <string.h>
 #include <algorithm>
 #include "dynamic_phrase.h"
+#include "pinyin_speculator.h"
+
+/* 整句转换中用户词语的得分，即量化频率的最大值 */
+#define ENGINE_USER_SCORE 255
+/* 整句转换中每多一段扣除的得分，略大于任何一个词语的得分 */
+#define ENGINE_SPAN_PENALTY 256
+/* 整句转换中每个跨度最多保留的候选词语数量，供二元组挑选 */
+#define ENGINE_SPAN_WIDTH 4
+/* 缓冲词语散列表的最小槽位数，必须为2的幂 */
+#define CACHE_SLOT_AMOUNT 64
+/* 每次查询完成后预测的下一个按键的数量 */
+#define SPECULATIVE_KEY_AMOUNT 4
+
+/**
+ * 计算词语原始数据的散列值(FNV-1a).
+ * @param data 原始数据
+ * @param length 原始数据的长度
+ * @return 散列值
+ */
+static uint HashPhraseData(const void *data, int length) {
+  uint hash = 2166136261U;
+  for (const uint8_t *ptr = (const uint8_t *)data;
+       ptr < (const uint8_t *)data + length;
+       ++ptr) {
+    hash ^= *ptr;
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+/**
+ * 将文本拷贝到新申请的内存.
+ * @param string 文本
+ * @param text 新内存，文本为空时为NULL
+ * @param len 文本长度
+ */
+static void CopyText(const std::string &string, char **text, int *len) {
+  *len = string.size();
+  if (*len == 0) {
+    *text = NULL;
+    return;
+  }
+  *text = (char *)malloc(*len);
+  memcpy(*text, string.data(), *len);
+}
 
 /**
  * 内置拼音修正表.
@@ -61,7 +106,16 @@ InnerMendPinyinPair PinyinEditor::mend_pair_table_[] = {
 PinyinEditor::PinyinEditor(const PhraseManager *phrase_manager)
     : editor_mode_(true), cursor_point_(0), chars_proxy_(NULL),
       chars_proxy_length_(0), phrase_manager_(phrase_manager),
-      phrase_storage_list_(NULL) {
+      fuzzy_profile_(NULL), phrase_storage_array_(NULL),
+      fetched_proxy_amount_(0), matched_proxy_amount_(-1), latency_budget_(0),
+      lookup_complete_(true), span_table_(NULL), span_length_(NULL),
+      span_chars_proxy_(NULL), span_chars_proxy_length_(0), span_serial_(0),
+      deferred_lookup_(false), lookup_pending_(false), arena_(NULL),
+      origin_arena_(NULL), speculator_(NULL) {
+  deadline_.tv_sec = 0;
+  deadline_.tv_usec = 0;
+  arena_ = new PhraseArena;
+  origin_arena_ = new PhraseArena;
 }
 
 /**
@@ -69,6 +123,11 @@ PinyinEditor::PinyinEditor(const PhraseManager *phrase_manager)
  */
 PinyinEditor::~PinyinEditor() {
   Clear();
+  delete speculator_;
+  if (fuzzy_profile_)
+    fuzzy_profile_->Unref();
+  delete arena_;
+  delete origin_arena_;
 }
 
 /**
@@ -126,18 +185,32 @@ int PinyinEditor::GetCursorPoint() {
  * @param ch 字符
  */
 void PinyinEditor::InsertPinyinKey(char ch) {
+  /* 累积字母转移统计 */
+  if (speculator_)
+    speculator_->LearnPinyinKey(cursor_point_ > 0 ?
+                                    pinyin_table_[cursor_point_ - 1] : '\0',
+                                ch);
   /* 将字符插入待查询拼音表 */
   pinyin_table_.insert(cursor_point_, 1, ch);
   ++cursor_point_;
-  /* 清空必要缓冲数据 */
-  ClearCharsProxy();
-  ClearAcceptedPhraseList();
-  ClearCachePhraseList();
-  ClearPhraseStorageList();
-  /* 创建汉字代理数组 */
-  CreateCharsProxy();
-  /* 查询词语代理 */
-  LookupPhraseProxy();
+  /* 更新查询 */
+  NotifyPinyinChange();
+}
+
+/**
+ * 插入一串拼音字符.
+ * 整串插入后只解析、查询一次，适用于粘贴或远程桌面等成批到达的按键. \n
+ * @param string 字符串
+ */
+void PinyinEditor::InsertPinyinString(const char *string) {
+  /* 将字符串插入待查询拼音表 */
+  size_t length = strlen(string);
+  if (length == 0)
+    return;
+  pinyin_table_.insert(cursor_point_, string, length);
+  cursor_point_ += length;
+  /* 更新查询 */
+  NotifyPinyinChange();
 }
 
 /**
@@ -149,15 +222,8 @@ void PinyinEditor::DeletePinyinKey() {
   if ((size_t)cursor_point_ == length)
     return;
   pinyin_table_.erase(cursor_point_, 1);
-  /* 清空必要缓冲数据 */
-  ClearCharsProxy();
-  ClearAcceptedPhraseList();
-  ClearCachePhraseList();
-  ClearPhraseStorageList();
-  /* 创建汉字代理数组 */
-  CreateCharsProxy();
-  /* 查询词语代理 */
-  LookupPhraseProxy();
+  /* 更新查询 */
+  NotifyPinyinChange();
 }
 
 /**
@@ -169,15 +235,8 @@ void PinyinEditor::BackspacePinyinKey() {
     return;
   --cursor_point_;
   pinyin_table_.erase(cursor_point_, 1);
-  /* 清空必要缓冲数据 */
-  ClearCharsProxy();
-  ClearAcceptedPhraseList();
-  ClearCachePhraseList();
-  ClearPhraseStorageList();
-  /* 创建汉字代理数组 */
-  CreateCharsProxy();
-  /* 查询词语代理 */
-  LookupPhraseProxy();
+  /* 更新查询 */
+  NotifyPinyinChange();
 }
 
 /**
@@ -185,16 +244,18 @@ void PinyinEditor::BackspacePinyinKey() {
  * @return 执行状况
  */
 bool PinyinEditor::RevokeSelectedPhrase() {
+  FlushPinyinQuery();
   /* 移除最后被选中的词语 */
   if (accepted_phrase_list_.empty())
     return false;
-  delete accepted_phrase_list_.back();
+  accepted_text_.resize(accepted_text_.size() -
+                        accepted_phrase_list_.back()->raw_data_length_);
   accepted_phrase_list_.pop_back();
   /* 清空必要缓冲数据 */
   ClearCachePhraseList();
-  ClearPhraseStorageList();
+  ClearPhraseStorageArray();
   /* 查询词语代理 */
-  LookupPhraseProxy();
+  LookupPhraseProxy(NULL);
 
   return true;
 }
@@ -206,15 +267,16 @@ bool PinyinEditor::RevokeSelectedPhrase() {
  * @return 执行状况
  */
 void PinyinEditor::GetRawText(char **text, int *len) {
-  if (pinyin_table_.empty()) {
-    *len = 0;
-    *text = NULL;
-    return;
-  }
+  CopyText(pinyin_table_, text, len);
+}
 
-  *len = pinyin_table_.size();
-  *text = (char *)malloc(*len);
-  memcpy(*text, pinyin_table_.c_str(), *len);
+/**
+ * 获取原始串.
+ * 写入调用者提供的缓冲区，缓冲区的空间可以反复使用. \n
+ * @param text 原始串
+ */
+void PinyinEditor::GetRawText(std::string *text) {
+  text->assign(pinyin_table_);
 }
 
 /**
@@ -223,34 +285,18 @@ void PinyinEditor::GetRawText(char **text, int *len) {
  * @param len 词语数据有效长度
  */
 void PinyinEditor::GetCommitText(char **text, int *len) {
-  if (accepted_phrase_list_.empty()) {
-    *len = 0;
-    *text = NULL;
-    return;
-  }
-
-  /* 获取数据总长度 */
-  size_t length = 0;
-  for (std::list<PhraseDatum *>::iterator iterator =
-           accepted_phrase_list_.begin();
-       iterator != accepted_phrase_list_.end();
-       ++iterator) {
-    PhraseDatum *phrase_datum = *iterator;
-    length += phrase_datum->raw_data_length_;
-  }
+  GetCommitText(&text_buffer_);
+  CopyText(text_buffer_, text, len);
+}
 
-  /* 拷贝数据 */
-  *len = 0;
-  *text = (char *)malloc(length);
-  for (std::list<PhraseDatum *>::iterator iterator =
-           accepted_phrase_list_.begin();
-       iterator != accepted_phrase_list_.end();
-       ++iterator) {
-    PhraseDatum *phrase_datum = *iterator;
-    memcpy(*text + *len, phrase_datum->raw_data_,
-           phrase_datum->raw_data_length_);
-    *len += phrase_datum->raw_data_length_;
-  }
+/**
+ * 获取提交数据.
+ * 已接受词语的原始数据随选定、取消词语逐段维护，此处只需拷贝. \n
+ * @param text 词语数据
+ */
+void PinyinEditor::GetCommitText(std::string *text) {
+  FlushPinyinQuery();
+  text->assign(accepted_text_);
 }
 
 /**
@@ -259,47 +305,24 @@ void PinyinEditor::GetCommitText(char **text, int *len) {
  * @param len 词语数据有效长度
  */
 void PinyinEditor::GetPreeditText(char **text, int *len) {
-  if (accepted_phrase_list_.empty() && cache_phrase_list_.empty()) {
-    *len = 0;
-    *text = NULL;
-    return;
-  }
-
-  /* 获取数据总长度 */
-  size_t length = 0;
-  for (std::list<PhraseDatum *>::iterator iterator =
-           accepted_phrase_list_.begin();
-       iterator != accepted_phrase_list_.end();
-       ++iterator) {
-    PhraseDatum *phrase_datum = *iterator;
-    length += phrase_datum->raw_data_length_;
-  }
-  if (!cache_phrase_list_.empty()) {
-    PhraseDatum *phrase_datum = cache_phrase_list_.front();
-    length += phrase_datum->raw_data_length_ + 1;
-  }
+  GetPreeditText(&text_buffer_);
+  CopyText(text_buffer_, text, len);
+}
 
-  /* 拷贝数据 */
-  *len = 0;
-  *text = (char *)malloc(length);
-  for (std::list<PhraseDatum *>::iterator iterator =
-           accepted_phrase_list_.begin();
-       iterator != accepted_phrase_list_.end();
-       ++iterator) {
-    PhraseDatum *phrase_datum = *iterator;
-    memcpy(*text + *len, phrase_datum->raw_data_,
-           phrase_datum->raw_data_length_);
-    *len += phrase_datum->raw_data_length_;
-  }
+/**
+ * 获取预编辑数据.
+ * 即已接受的词语之后再接排在首位的候选词语. \n
+ * @param text 词语数据
+ */
+void PinyinEditor::GetPreeditText(std::string *text) {
+  FlushPinyinQuery();
+  text->assign(accepted_text_);
   if (!cache_phrase_list_.empty()) {
-    if (*len != 0) {
-      *(*text + *len) = '\x20';
-      ++(*len);
-    }
+    if (!text->empty())
+      text->push_back('\x20');
     PhraseDatum *phrase_datum = cache_phrase_list_.front();
-    memcpy(*text + *len, phrase_datum->raw_data_,
-           phrase_datum->raw_data_length_);
-    *len += phrase_datum->raw_data_length_;
+    text->append((const char *)phrase_datum->raw_data_,
+                 phrase_datum->raw_data_length_);
   }
 }
 
@@ -309,89 +332,149 @@ void PinyinEditor::GetPreeditText(char **text, int *len) {
  * @param len 词语数据有效长度
  */
 void PinyinEditor::GetAuxiliaryText(char **text, int *len) {
-  if (accepted_phrase_list_.empty() && !chars_proxy_) {
-    *len = 0;
-    *text = NULL;
+  GetAuxiliaryText(&text_buffer_);
+  CopyText(text_buffer_, text, len);
+}
+
+/**
+ * 获取辅助数据.
+ * 即已接受的词语之后再接尚未转换部分的拼音串. \n
+ * @param text 词语数据
+ */
+void PinyinEditor::GetAuxiliaryText(std::string *text) {
+  FlushPinyinQuery();
+  text->assign(accepted_text_);
+  int chars_proxy_offset = FinishCharsOffset();
+  if (chars_proxy_offset == chars_proxy_length_)
     return;
-  }
 
-  /* 获取数据总长度 */
-  int chars_proxy_offset = 0;
-  size_t length = 0;
-  for (std::list<PhraseDatum *>::iterator iterator =
-           accepted_phrase_list_.begin();
-       iterator != accepted_phrase_list_.end();
-       ++iterator) {
-    PhraseDatum *phrase_datum = *iterator;
-    chars_proxy_offset += phrase_datum->chars_proxy_length_;
-    length += phrase_datum->raw_data_length_;
-  }
-  char *pinyin = NULL;
-  size_t pinyin_length = 0;
-  if (chars_proxy_offset != chars_proxy_length_) {
-    PinyinParser pinyin_parser;
-    pinyin = pinyin_parser.UnparsePinyin(
-                 chars_proxy_ + chars_proxy_offset,
-                 chars_proxy_length_ - chars_proxy_offset);
-    pinyin_length = strlen(pinyin);
-    length += pinyin_length + 1;
-  }
-
-  /* 拷贝数据 */
-  *len = 0;
-  *text = (char *)malloc(length);
-  for (std::list<PhraseDatum *>::iterator iterator =
-           accepted_phrase_list_.begin();
-       iterator != accepted_phrase_list_.end();
-       ++iterator) {
-    PhraseDatum *phrase_datum = *iterator;
-    memcpy(*text + *len, phrase_datum->raw_data_,
-           phrase_datum->raw_data_length_);
-    *len += phrase_datum->raw_data_length_;
-  }
-  if (pinyin) {
-    if (*len != 0) {
-      *(*text + *len) = '\x20';
-      ++(*len);
-    }
-    memcpy(*text + *len, pinyin, pinyin_length);
-    *len += pinyin_length;
-    free(pinyin);  // 必须释放
-  }
+  UpdatePinyinText();
+  if (!text->empty())
+    text->push_back('\x20');
+  /* 去掉最后一个汉字之后的分隔符 */
+  size_t offset = pinyin_offset_[chars_proxy_offset];
+  text->append(pinyin_text_, offset, pinyin_text_.size() - offset - 1);
 }
 
 /**
  * 获取一个页面的词语数据.
+ * 预算耗尽时本页可能不满，参见IsLookupComplete(). \n
  * @param pagesize 页面大小
  * @param list 词语链表
  */
 void PinyinEditor::GetPagePhrase(int pagesize,
                                  std::list<const PhraseDatum *> *list) {
+  FlushPinyinQuery();
+  ArmDeadline();
   int count = 0;
   while (count < pagesize) {
-    PhraseProxyStorage *storage = SearchPreferPhrase();
-    if (!storage)
+    if (count > 0 && IsDeadlineExpired()) {
+      lookup_complete_ = false;
       break;
-    PhraseProxy *phrase_proxy = storage->phrase_proxy_list_->front();
-    storage->phrase_proxy_list_->pop_front();
-    PhraseDatum *phrase_datum =
-        storage->phrase_proxy_site_->phrase_->AnalyzePhraseProxy(phrase_proxy);
-    if (IsExistCachePhrase(phrase_datum)) {
-      delete phrase_datum;
-    } else {
-      list->push_back(phrase_datum);
-      cache_phrase_list_.push_back(phrase_datum);
-      ++count;
     }
-    delete phrase_proxy;
+    PhraseDatum *phrase_datum = FetchCachePhrase();
+    if (!phrase_datum)
+      break;
+    list->push_back(phrase_datum);
+    ++count;
   }
 }
 
+/**
+ * 获取指定页面的词语数据.
+ * 已经取出过的页面直接由词语数据缓冲区给出，不会重新查询；
+ * 更靠后的页面则先依次取出其前面的词语，以保证去重后的分页与逐页获取时一致. \n
+ * 预算耗尽时本页可能不满甚至为空，再次调用会接着取出其余的词语. \n
+ * @param page 页码(从0开始)
+ * @param pagesize 页面大小
+ * @param list 词语链表
+ */
+void PinyinEditor::GetPagePhrase(int page, int pagesize,
+                                 std::list<const PhraseDatum *> *list) {
+  FlushPinyinQuery();
+  if (page < 0 || pagesize <= 0)
+    return;
+
+  /* 补足所需的词语，并给出本页的词语 */
+  size_t begin = (size_t)page * pagesize;
+  size_t end = begin + pagesize;
+  FillCachePhrase(end);
+  for (size_t count = begin; count < end && count < cache_phrase_list_.size();
+       ++count)
+    list->push_back(cache_phrase_list_[count]);
+}
+
+/**
+ * 获取指定页面的词语视图.
+ * 分页方式与GetPagePhrase(page, pagesize, list)相同，但不构造任何容器，
+ * 视图直接写入调用者提供的数组. \n
+ * @param page 页码(从0开始)
+ * @param pagesize 页面大小
+ * @param views 视图数组，长度不小于页面大小
+ * @return 本页的词语数量
+ */
+int PinyinEditor::GetPageView(int page, int pagesize, PhraseView *views) {
+  FlushPinyinQuery();
+  if (page < 0 || pagesize <= 0)
+    return 0;
+
+  /* 补足所需的词语，并给出本页的视图 */
+  size_t begin = (size_t)page * pagesize;
+  size_t end = begin + pagesize;
+  FillCachePhrase(end);
+  int count = 0;
+  for (size_t number = begin;
+       number < end && number < cache_phrase_list_.size();
+       ++number) {
+    const PhraseDatum *phrase_datum = cache_phrase_list_[number];
+    PhraseView *view = views + count++;
+    view->raw_data_ = phrase_datum->raw_data_;
+    view->raw_data_length_ = phrase_datum->raw_data_length_;
+    view->chars_proxy_ = phrase_datum->chars_proxy_;
+    view->chars_proxy_length_ = phrase_datum->chars_proxy_length_;
+    view->phrase_data_offset_ = phrase_datum->phrase_data_offset_;
+    view->phrase_datum_ = phrase_datum;
+  }
+  return count;
+}
+
+/**
+ * 获取候选词语的总数.
+ * 所有词语都已取出时给出的是准确数量；否则各集合只统计匹配项的数量，
+ * 不给出任何词语，尚未取出的词语中可能存在的重复项也被计算在内，
+ * 所得的估计值不会小于实际数量. \n
+ * @param exact 数量是否准确
+ * @return 词语总数
+ */
+int PinyinEditor::GetPhraseAmount(bool *exact) {
+  FlushPinyinQuery();
+  int amount = cache_phrase_list_.size();
+  if (!SearchPreferPhrase()) {
+    *exact = true;
+    return amount;
+  }
+
+  /* 统计相匹配的词语数据代理，每次查询只统计一次 */
+  if (matched_proxy_amount_ == -1) {
+    int offset = FinishCharsOffset();
+    matched_proxy_amount_ = phrase_manager_->CountMatchablePhrase(
+                                GetFuzzyProfile(), chars_proxy_ + offset,
+                                chars_proxy_length_ - offset);
+  }
+  *exact = false;
+  if (matched_proxy_amount_ > fetched_proxy_amount_)
+    amount += matched_proxy_amount_ - fetched_proxy_amount_;
+  return amount;
+}
+
 /**
  * 获取动态词语.
+ * 动态词语被复制到临时内存区，与其他缓冲词语一同失效. \n
+ * 动态词语可被选定或删除，但不占用候选词语的分页位置，也不计入候选词语总数. \n
  * @param list 词语链表
  */
 void PinyinEditor::GetDynamicPhrase(std::list<const PhraseDatum *> *list) {
+  FlushPinyinQuery();
   std::list<PhraseDatum *> phrase_datum_list;
   DynamicPhrase *dynamic_phrase = DynamicPhrase::GetInstance();
   dynamic_phrase->GetDynamicPhrase(pinyin_table_.c_str(), &phrase_datum_list);
@@ -399,97 +482,77 @@ void PinyinEditor::GetDynamicPhrase(std::list<const PhraseDatum *> *list) {
   for (std::list<PhraseDatum *>::iterator iterator = phrase_datum_list.begin();
        iterator != phrase_datum_list.end();
        ++iterator) {
-    PhraseDatum *phrase_datum = *iterator;
+    PhraseDatum *phrase_datum = AppendExtraPhrase((*iterator)->Clone(arena_));
     list->push_back(phrase_datum);
-    cache_phrase_list_.push_back(phrase_datum);
   }
+  STL_DELETE_DATA(phrase_datum_list, std::list<PhraseDatum *>);
 }
 
 /**
  * 获取引擎生成的词语.
+ * 在尚未选定的拼音上求出最佳分段，各段的最佳词语连接成一个词语；
+ * 只有一段或连接后与已有的候选词语相同时，不再给出. 预算耗尽时暂停查询
+ * 跨度，已经查得的跨度被保留，下一次调用接着查询；每次调用至少查询一个起点. \n
+ * 引擎词语与动态词语一样不参与候选词语的分页，重复调用给出同一份数据. \n
  * @return 词语数据
  */
 const PhraseDatum *PinyinEditor::GetEnginePhrase() {
-  std::list<PhraseDatum *> phrase_datum_list;
-  PhraseDatum *local_phrase_datum = NULL;
-
-  /* 获取引擎词语的各部分词语数据 */
-  /*/* 第一个词语数据 */
-  if (cache_phrase_list_.empty()) {
-    PhraseProxyStorage *storage = SearchPreferPhrase();
-    if (storage) {
-      PhraseProxy *phrase_proxy = storage->phrase_proxy_list_->front();
-      local_phrase_datum = storage->phrase_proxy_site_->phrase_
-                               ->AnalyzePhraseProxy(phrase_proxy);
-    }
-  } else {
-    local_phrase_datum = cache_phrase_list_.front();
-  }
-  if (!local_phrase_datum)
+  FlushPinyinQuery();
+  ArmDeadline();
+  int offset = FinishCharsOffset();
+  if (!chars_proxy_ || chars_proxy_length_ - offset < 2)
     return NULL;
-  phrase_datum_list.push_back(local_phrase_datum);
-  int offset = FinishCharsOffset() + local_phrase_datum->chars_proxy_length_;
-  /*/* 其余词语数据 */
-  while (offset != chars_proxy_length_) {
-    PhraseProxyStorage *storage =
-        phrase_manager_->SearchPreferPhrase(chars_proxy_ + offset,
-                                            chars_proxy_length_ - offset);
-    if (!storage)
-      break;
-    PhraseProxy *phrase_proxy = storage->phrase_proxy_list_->front();
-    local_phrase_datum =
-        storage->phrase_proxy_site_->phrase_->AnalyzePhraseProxy(phrase_proxy);
-    phrase_datum_list.push_back(local_phrase_datum);
-    offset += local_phrase_datum->chars_proxy_length_;
-    delete storage;
-  }
-  if (phrase_datum_list.size() == 1) {
-    if (cache_phrase_list_.empty())
-      delete phrase_datum_list.front();
+
+  /* 查询各起点的跨度 */
+  UpdateSpanTable(chars_proxy_ + offset, chars_proxy_length_ - offset);
+  if (!FillSpanTable()) {
+    lookup_complete_ = false;
     return NULL;
   }
 
-  /* 计算需要的空间 */
-  int chars_proxy_length = 0;
-  size_t length = 0;
-  for (std::list<PhraseDatum *>::iterator iterator = phrase_datum_list.begin();
-       iterator != phrase_datum_list.end();
-       ++iterator) {
-    local_phrase_datum = *iterator;
+  /* 求出最佳分段 */
+  int *path = arena_->NewArray<int>(span_chars_proxy_length_);
+  int amount = SearchEnginePath(path);
+  if (amount < 2)
+    return NULL;
+
+  /* 获取引擎词语的各部分词语数据，并计算需要的空间 */
+  PhraseDatum **phrase_datum_array = arena_->NewArray<PhraseDatum *>(amount);
+  int chars_proxy_length = 0, length = 0;
+  for (int count = 0; count < amount; ++count) {
+    PhraseProxyStorage *storage = span_table_ + *(path + count);
+    PhraseDatum *local_phrase_datum =
+        storage->phrase_proxy_site_->phrase_->AnalyzePhraseProxy(
+            &storage->phrase_proxy_, arena_);
+    *(phrase_datum_array + count) = local_phrase_datum;
     chars_proxy_length += local_phrase_datum->chars_proxy_length_;
     length += local_phrase_datum->raw_data_length_;
   }
 
   /* 组装词语 */
-  PhraseDatum *phrase_datum = new PhraseDatum;
-  phrase_datum->chars_proxy_ = new CharsProxy[chars_proxy_length];
-  phrase_datum->raw_data_ = malloc(length);
+  PhraseDatum *phrase_datum = PhraseDatum::Create(arena_, chars_proxy_length,
+                                                  length);
   phrase_datum->phrase_data_offset_ = EnginePhraseType;
-  for (std::list<PhraseDatum *>::iterator iterator = phrase_datum_list.begin();
-       iterator != phrase_datum_list.end();
-       ++iterator) {
-    local_phrase_datum = *iterator;
-    memcpy(phrase_datum->chars_proxy_ + phrase_datum->chars_proxy_length_,
+  chars_proxy_length = 0;
+  length = 0;
+  for (int count = 0; count < amount; ++count) {
+    PhraseDatum *local_phrase_datum = *(phrase_datum_array + count);
+    memcpy(phrase_datum->chars_proxy_ + chars_proxy_length,
            local_phrase_datum->chars_proxy_,
            sizeof(CharsProxy) * local_phrase_datum->chars_proxy_length_);
-    phrase_datum->chars_proxy_length_ +=
-        local_phrase_datum->chars_proxy_length_;
-    memcpy((char *)phrase_datum->raw_data_ + phrase_datum->raw_data_length_,
+    chars_proxy_length += local_phrase_datum->chars_proxy_length_;
+    memcpy((char *)phrase_datum->raw_data_ + length,
            local_phrase_datum->raw_data_,
            local_phrase_datum->raw_data_length_);
-    phrase_datum->raw_data_length_ += local_phrase_datum->raw_data_length_;
+    length += local_phrase_datum->raw_data_length_;
   }
 
-  /* 善后工作 */
-  if (cache_phrase_list_.empty())
-    delete phrase_datum_list.front();
-  phrase_datum_list.pop_front();
-  STL_DELETE_DATA(phrase_datum_list, std::list<PhraseDatum *>);
-
-  /* 加入缓冲链表 */
-  cache_phrase_list_.push_back(phrase_datum);
+  /* 与已有的候选词语重复则不再给出 */
+  if (IsExistCachePhrase(phrase_datum))
+    return NULL;
 
-  return phrase_datum;
+  /* 加入附加词语表 */
+  return AppendExtraPhrase(phrase_datum);
 }
 
 /**
@@ -497,19 +560,26 @@ const PhraseDatum *PinyinEditor::GetEnginePhrase() {
  * @param datum 词语数据
  */
 void PinyinEditor::SelectCachePhrase(const PhraseDatum *datum) {
-  /* 将词语数据加入已接受词语链表 */
-  std::list<PhraseDatum *>::iterator iterator =
+  FlushPinyinQuery();
+  /* 将词语数据加入已接受词语表 */
+  std::vector<PhraseDatum *>::iterator iterator =
       find(cache_phrase_list_.begin(), cache_phrase_list_.end(), datum);
-  if (iterator == cache_phrase_list_.end())
-    return;
-  accepted_phrase_list_.push_back(*iterator);
-  cache_phrase_list_.erase(iterator);
+  if (iterator == cache_phrase_list_.end()) {
+    iterator = find(extra_phrase_list_.begin(), extra_phrase_list_.end(),
+                    datum);
+    if (iterator == extra_phrase_list_.end())
+      return;
+  }
+  /* 词语数据可能引用码表，而储存点释放后码表可能随之卸载，故保留其副本 */
+  accepted_phrase_list_.push_back((*iterator)->Clone(arena_));
+  accepted_text_.append((const char *)(*iterator)->raw_data_,
+                        (*iterator)->raw_data_length_);
   /* 清空缓冲数据 */
   ClearCachePhraseList();
-  ClearPhraseStorageList();
+  ClearPhraseStorageArray();
   /* 如果需要则继续查询词语 */
   if (!IsFinishTask())
-    LookupPhraseProxy();
+    LookupPhraseProxy(NULL);
 }
 
 /**
@@ -517,19 +587,28 @@ void PinyinEditor::SelectCachePhrase(const PhraseDatum *datum) {
  * @param datum 词语数据
  */
 void PinyinEditor::DeletePhraseData(const PhraseDatum *datum) {
-  std::list<PhraseDatum *>::iterator iterator =
-      find(cache_phrase_list_.begin(), cache_phrase_list_.end(), datum);
-  if (iterator == cache_phrase_list_.end())
-    return;
+  FlushPinyinQuery();
+  std::vector<PhraseDatum *> *phrase_list = &cache_phrase_list_;
+  std::vector<PhraseDatum *>::iterator iterator =
+      find(phrase_list->begin(), phrase_list->end(), datum);
+  if (iterator == phrase_list->end()) {
+    phrase_list = &extra_phrase_list_;
+    iterator = find(phrase_list->begin(), phrase_list->end(), datum);
+    if (iterator == phrase_list->end())
+      return;
+  }
   phrase_manager_->DeletePhraseDatum(datum);
-  delete *iterator;
-  cache_phrase_list_.erase(iterator);
+  ClearSpanTable();
+  phrase_list->erase(iterator);
+  if (phrase_list == &cache_phrase_list_)
+    RebuildCacheSlot();
 }
 
 /**
  * 反馈被用户选中的词语.
  */
 void PinyinEditor::FeedbackSelectedPhrase() {
+  FlushPinyinQuery();
   /* 若没有数据则无需处理 */
   size_t size = accepted_phrase_list_.size();
   if (size == 0)
@@ -552,6 +631,7 @@ void PinyinEditor::FeedbackSelectedPhrase() {
  * @return 是否完成
  */
 bool PinyinEditor::IsFinishTask() {
+  FlushPinyinQuery();
   return FinishCharsOffset() == chars_proxy_length_;
 }
 
@@ -568,6 +648,7 @@ void PinyinEditor::StopTask() {
  * @note 请不要将此偏移量用作其他用途，它只应该被用来判断词汇所属的类型.
  */
 int PinyinEditor::GetPhraseOffset() {
+  FlushPinyinQuery();
   size_t size = accepted_phrase_list_.size();
   if (size > 1)
     return ManualPhraseType;
@@ -577,6 +658,90 @@ int PinyinEditor::GetPhraseOffset() {
     return InvalidPhraseType;
 }
 
+/**
+ * 选用模糊拼音配置.
+ * 配置只在本编辑器内生效；正在编辑的拼音会按新配置重新查询. \n
+ * @param profile 模糊拼音配置，NULL表示采用词语管理者的默认配置
+ */
+void PinyinEditor::SetFuzzyProfile(const FuzzyProfile *profile) {
+  if (profile)
+    profile->Ref();
+  if (fuzzy_profile_)
+    fuzzy_profile_->Unref();
+  fuzzy_profile_ = profile;
+
+  if (!pinyin_table_.empty() && !lookup_pending_) {
+    ClearCachePhraseList();
+    ClearPhraseStorageArray();
+    LookupPhraseProxy(NULL);
+  }
+}
+
+/**
+ * 设置获取词语的时间预算.
+ * 预算只限制取出候选词语、合成引擎词语的过程；单个词语的扫描不会被打断，
+ * 因此实际耗时可能略超预算. \n
+ * @param budget 每次调用的时间预算(微秒)，0表示不限制
+ */
+void PinyinEditor::SetLatencyBudget(int budget) {
+  latency_budget_ = budget > 0 ? budget : 0;
+}
+
+/**
+ * 设置是否推迟查询.
+ * 推迟查询时编辑拼音只修改拼音表，解析及查询推迟到需要词语、文本或
+ * 查询状态时才进行，连续的多次编辑因此只查询一次. 取消推迟时立即完成
+ * 尚未进行的查询. \n
+ * @param deferred 是否推迟
+ */
+void PinyinEditor::SetDeferredLookup(bool deferred) {
+  deferred_lookup_ = deferred;
+  if (!deferred)
+    FlushPinyinQuery();
+}
+
+/**
+ * 最近一次获取的词语是否完整.
+ * 若因预算耗尽而只给出了部分词语，则为FALSE；此时再次调用即可接着获取. \n
+ * @return BOOL
+ */
+bool PinyinEditor::IsLookupComplete() {
+  return lookup_complete_;
+}
+
+/**
+ * 设置预测查询的时间预算.
+ * 每次查询完成后，后台线程按字母转移统计预先查询最可能的几个下一个按键，
+ * 每轮耗时不超过预算；新的按键到达时本轮即被停止. 后台线程只预先查询系统
+ * 词语，须启用词语管理者的查询缓存，否则预测的结果无处保存. \n
+ * @param budget 每轮预测的时间预算(微秒)，0表示不启用
+ */
+void PinyinEditor::SetSpeculativeLookup(int budget) {
+  if (budget <= 0) {
+    delete speculator_;
+    speculator_ = NULL;
+  } else if (speculator_) {
+    speculator_->SetBudget(budget);
+  } else {
+    speculator_ = new PinyinSpeculator(phrase_manager_, budget);
+  }
+}
+
+/**
+ * 获取预测查询的统计数据.
+ * 实际查询的拼音串恰为上一轮已经预测过的拼音串即为命中. \n
+ * @param hits 命中次数
+ * @param misses 未命中次数
+ */
+void PinyinEditor::GetSpeculationStats(uint *hits, uint *misses) {
+  if (speculator_) {
+    speculator_->GetStats(hits, misses);
+  } else {
+    *hits = 0;
+    *misses = 0;
+  }
+}
+
 /**
  * 创建用户词语.
  * @return 词语数据
@@ -588,7 +753,7 @@ PhraseDatum *PinyinEditor::CreateUserPhrase() {
   /* 计算需要的内存长度 */
   int chars_proxy_length = 0;
   size_t length = 0;
-  for (std::list<PhraseDatum *>::iterator iterator =
+  for (std::vector<PhraseDatum *>::iterator iterator =
            accepted_phrase_list_.begin();
        iterator != accepted_phrase_list_.end();
        ++iterator) {
@@ -602,7 +767,7 @@ PhraseDatum *PinyinEditor::CreateUserPhrase() {
   phrase_datum->chars_proxy_ = new CharsProxy[chars_proxy_length];
   phrase_datum->raw_data_ = malloc(length);
   phrase_datum->phrase_data_offset_ = ManualPhraseType;
-  for (std::list<PhraseDatum *>::iterator iterator =
+  for (std::vector<PhraseDatum *>::iterator iterator =
            accepted_phrase_list_.begin();
        iterator != accepted_phrase_list_.end();
        ++iterator) {
@@ -626,32 +791,154 @@ PhraseDatum *PinyinEditor::CreateUserPhrase() {
  * @return 词语缓冲点
  */
 PhraseProxyStorage *PinyinEditor::SearchPreferPhrase() {
-  if (!phrase_storage_list_)
-    return NULL;
+  return phrase_storage_heap_.Top();
+}
 
-  PhraseProxyStorage *storage = NULL;
-  int chars_proxy_length = 0;
-  int priority = 0;
-  for (std::list<PhraseProxyStorage *>::iterator iterator =
-           phrase_storage_list_->begin();
-       iterator != phrase_storage_list_->end();
-       ++iterator) {
-    PhraseProxyStorage *local_storage = *iterator;
-    if (local_storage->phrase_proxy_list_->empty())
-      continue;
-    int local_chars_proxy_length =
-        local_storage->phrase_proxy_list_->front()->chars_proxy_length_;
-    int loca_priority = local_storage->phrase_proxy_site_->priority_;
-    if (!storage ||
-        chars_proxy_length < local_chars_proxy_length ||
-        (chars_proxy_length == local_chars_proxy_length &&
-         priority < loca_priority)) {
-      storage = local_storage;
-      chars_proxy_length = local_chars_proxy_length;
-      priority = loca_priority;
+/**
+ * 取走最佳词语，其所在的储存点推进到下一个词语.
+ * 各储存点在堆中的标记为其在链表中的次序，因此同等词语总是靠前的集合优先. \n
+ */
+void PinyinEditor::PopPreferPhrase() {
+  ++fetched_proxy_amount_;
+  PhraseProxyStorage *storage = phrase_storage_heap_.Top();
+  if (storage->FetchPhraseProxy())
+    phrase_storage_heap_.UpdateTop();
+  else
+    phrase_storage_heap_.Pop();
+}
+
+/**
+ * 取出下一个不重复的词语，并加入词语数据缓冲区.
+ * @return 词语数据，没有更多词语时为NULL
+ */
+PhraseDatum *PinyinEditor::FetchCachePhrase() {
+  while (true) {
+    PhraseProxyStorage *storage = SearchPreferPhrase();
+    if (!storage)
+      return NULL;
+    AbstractPhrase *phrase = storage->phrase_proxy_site_->phrase_;
+    PhraseDatum *phrase_datum =
+        phrase->AnalyzePhraseProxy(&storage->phrase_proxy_, arena_);
+    PopPreferPhrase();
+    if (!IsExistCachePhrase(phrase_datum)) {
+      AppendCachePhrase(phrase_datum);
+      return phrase_datum;
+    }
+  }
+}
+
+/**
+ * 补足词语数据缓冲区中的词语.
+ * 每次调用至少取出一个词语，预算耗尽时即停止. \n
+ * @param amount 所需的词语数量
+ */
+void PinyinEditor::FillCachePhrase(size_t amount) {
+  ArmDeadline();
+  bool fetched = false;
+  while (cache_phrase_list_.size() < amount) {
+    if (fetched && IsDeadlineExpired()) {
+      lookup_complete_ = false;
+      break;
     }
+    if (!FetchCachePhrase())
+      break;
+    fetched = true;
   }
-  return storage;
+}
+
+/**
+ * 获取本次查询所用的模糊拼音配置.
+ * @return 模糊拼音配置
+ */
+const FuzzyProfile *PinyinEditor::GetFuzzyProfile() {
+  return fuzzy_profile_ ? fuzzy_profile_ : phrase_manager_->GetFuzzyProfile();
+}
+
+/**
+ * 开始计时，依据时间预算设置本次获取词语的截止时刻.
+ */
+void PinyinEditor::ArmDeadline() {
+  lookup_complete_ = true;
+  if (latency_budget_ == 0)
+    return;
+  gettimeofday(&deadline_, NULL);
+  deadline_.tv_sec += latency_budget_ / 1000000;
+  deadline_.tv_usec += latency_budget_ % 1000000;
+  if (deadline_.tv_usec >= 1000000) {
+    ++deadline_.tv_sec;
+    deadline_.tv_usec -= 1000000;
+  }
+}
+
+/**
+ * 本次获取词语的时间预算是否已经耗尽.
+ * @return BOOL
+ */
+bool PinyinEditor::IsDeadlineExpired() {
+  if (latency_budget_ == 0)
+    return false;
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return !timercmp(&now, &deadline_, <);
+}
+
+/**
+ * 待查询拼音表改变后更新查询.
+ * 推迟查询时只做标记. \n
+ */
+void PinyinEditor::NotifyPinyinChange() {
+  if (speculator_)
+    speculator_->StopTask();
+  if (deferred_lookup_)
+    lookup_pending_ = true;
+  else
+    UpdatePinyinQuery();
+}
+
+/**
+ * 按待查询拼音表重新查询.
+ */
+void PinyinEditor::UpdatePinyinQuery() {
+  lookup_pending_ = false;
+  if (speculator_)
+    speculator_->MatchQuery(pinyin_table_);
+  /* 清空必要缓冲数据，上次查询的储存点留作增量查询的依据 */
+  ClearCharsProxy();
+  ClearAcceptedPhraseList();
+  ClearCachePhraseList();
+  PhraseProxyStorage **origin_array = TakePhraseStorageArray();
+  RewindArena();
+  /* 创建汉字代理数组 */
+  CreateCharsProxy();
+  /* 查询词语代理 */
+  LookupPhraseProxy(origin_array);
+  DeletePhraseStorageArray(origin_array);
+  /* 预测下一个按键 */
+  if (speculator_)
+    StartSpeculation();
+}
+
+/**
+ * 完成被推迟的查询.
+ */
+void PinyinEditor::FlushPinyinQuery() {
+  if (lookup_pending_)
+    UpdatePinyinQuery();
+}
+
+/**
+ * 为最可能的下一个按键开始预测查询.
+ * 只预测在拼音串末尾追加的按键；拼音串的解析及查询都在预测者的工作线程中进行. \n
+ */
+void PinyinEditor::StartSpeculation() {
+  if (!editor_mode_ || pinyin_table_.empty() ||
+      (size_t)cursor_point_ != pinyin_table_.size())
+    return;
+
+  char keys[SPECULATIVE_KEY_AMOUNT];
+  int amount = speculator_->PredictPinyinKey(*pinyin_table_.rbegin(), keys,
+                                             SPECULATIVE_KEY_AMOUNT);
+  speculator_->StartTask(GetFuzzyProfile(), pinyin_table_, keys, amount);
 }
 
 /**
@@ -663,29 +950,52 @@ void PinyinEditor::CreateCharsProxy() {
     return;
 
   /* 创建汉字代理数组 */
+  ParsePinyinString(phrase_manager_, pinyin_table_.c_str(), arena_,
+                    &chars_proxy_, &chars_proxy_length_);
+}
+
+/**
+ * 纠正并解析拼音串.
+ * @param phrase_manager 词语管理者，提供拼音修正表
+ * @param string 拼音串
+ * @param arena 临时内存区
+ * @param chars_proxy 汉字代理数组，由临时内存区分配
+ * @param length 汉字代理数组的长度
+ */
+void PinyinEditor::ParsePinyinString(const PhraseManager *phrase_manager,
+                                     const char *string, PhraseArena *arena,
+                                     CharsProxy **chars_proxy, int *length) {
   const std::list<OuterMendPinyinPair *> *mend_pair_table =
-      phrase_manager_->GetMendPinyinTable();
-  char *pinyin1 = AmendPinyinString(pinyin_table_.c_str(), mend_pair_table);
-  char *pinyin2 = AmendPinyinString(pinyin1, mend_pair_table_);
+      phrase_manager->GetMendPinyinTable();
+  char *pinyin1 = AmendPinyinString(string, mend_pair_table, arena);
+  char *pinyin2 = AmendPinyinString(pinyin1, mend_pair_table_, arena);
+  *chars_proxy = arena->NewArray<CharsProxy>(strlen(pinyin2));
   PinyinParser pinyin_parser;
-  pinyin_parser.ParsePinyin(pinyin2, &chars_proxy_, &chars_proxy_length_);
-  free(pinyin1);
-  free(pinyin2);
+  pinyin_parser.ParsePinyin(pinyin2, *chars_proxy, length);
 }
 
 /**
  * 查询词语代理.
+ * @param origin_array 上次查询的储存点数组，供增量查询参考(可为NULL)
  */
-void PinyinEditor::LookupPhraseProxy() {
+void PinyinEditor::LookupPhraseProxy(PhraseProxyStorage *const *origin_array) {
   /* 如果处于英文模式，则直接退出 */
   if (!editor_mode_)
     return;
 
   /* 查询词语代理 */
   int offset = FinishCharsOffset();
-  phrase_storage_list_ = phrase_manager_->SearchMatchablePhrase(
-                                              chars_proxy_ + offset,
-                                              chars_proxy_length_ - offset);
+  phrase_storage_array_ = phrase_manager_->SearchMatchablePhrase(
+                                               GetFuzzyProfile(),
+                                               chars_proxy_ + offset,
+                                               chars_proxy_length_ - offset,
+                                               origin_array, arena_);
+  if (!phrase_storage_array_)
+    return;
+  uint tick = 0;
+  for (PhraseProxyStorage **storage = phrase_storage_array_; *storage;
+       ++storage)
+    phrase_storage_heap_.Push(*storage, tick++);
 }
 
 /**
@@ -694,7 +1004,7 @@ void PinyinEditor::LookupPhraseProxy() {
  */
 int PinyinEditor::FinishCharsOffset() {
   int length = 0;
-  for (std::list<PhraseDatum *>::iterator iterator =
+  for (std::vector<PhraseDatum *>::iterator iterator =
            accepted_phrase_list_.begin();
        iterator != accepted_phrase_list_.end();
        ++iterator) {
@@ -706,23 +1016,282 @@ int PinyinEditor::FinishCharsOffset() {
 
 /**
  * 考察此词语是否已经存在词语数据缓冲区中.
+ * 按原始数据的散列值在散列表中查找，只有散列值相同的词语才逐字节比较. \n
  * @param datum 词语数据
  * @return 是否已经存在
  */
 bool PinyinEditor::IsExistCachePhrase(const PhraseDatum *datum) {
-  bool result = false;
-  for (std::list<PhraseDatum *>::iterator iterator = cache_phrase_list_.begin();
-       iterator != cache_phrase_list_.end();
+  if (cache_phrase_list_.empty())
+    return false;
+
+  uint hash = HashPhraseData(datum->raw_data_, datum->raw_data_length_);
+  size_t mask = cache_slot_table_.size() - 1;
+  for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+    const CachePhraseSlot *cache_slot = &cache_slot_table_[slot];
+    if (cache_slot->index == -1)
+      return false;
+    if (cache_slot->hash != hash)
+      continue;
+    const PhraseDatum *phrase_datum = cache_phrase_list_[cache_slot->index];
+    if (datum->raw_data_length_ == phrase_datum->raw_data_length_ &&
+        memcmp(datum->raw_data_, phrase_datum->raw_data_,
+               datum->raw_data_length_) == 0)
+      return true;
+  }
+}
+
+/**
+ * 将词语加入词语数据缓冲区.
+ * 散列表的负载超过一半时加倍重建. \n
+ * @param datum 词语数据
+ */
+void PinyinEditor::AppendCachePhrase(PhraseDatum *datum) {
+  cache_phrase_list_.push_back(datum);
+  if (cache_phrase_list_.size() * 2 > cache_slot_table_.size())
+    RebuildCacheSlot();
+  else
+    InsertCacheSlot(cache_phrase_list_.size() - 1);
+}
+
+/**
+ * 将动态词语或引擎词语加入附加词语表.
+ * 附加词语只供选定及删除，不参与分页；表中已有相同的词语时不再加入. \n
+ * @param datum 词语数据
+ * @return 表中的词语数据
+ */
+PhraseDatum *PinyinEditor::AppendExtraPhrase(PhraseDatum *datum) {
+  for (std::vector<PhraseDatum *>::iterator iterator =
+           extra_phrase_list_.begin();
+       iterator != extra_phrase_list_.end();
        ++iterator) {
     PhraseDatum *phrase_datum = *iterator;
-    if (datum->raw_data_length_ == phrase_datum->raw_data_length_ &&
+    if (datum->phrase_data_offset_ == phrase_datum->phrase_data_offset_ &&
+        datum->raw_data_length_ == phrase_datum->raw_data_length_ &&
         memcmp(datum->raw_data_, phrase_datum->raw_data_,
-               datum->raw_data_length_) == 0) {
-      result = true;
-      break;
+               datum->raw_data_length_) == 0)
+      return phrase_datum;
+  }
+  extra_phrase_list_.push_back(datum);
+  return datum;
+}
+
+/**
+ * 将缓冲词语表中的词语加入散列表(线性探查).
+ * @param index 词语在缓冲词语表中的下标
+ */
+void PinyinEditor::InsertCacheSlot(int index) {
+  const PhraseDatum *phrase_datum = cache_phrase_list_[index];
+  uint hash = HashPhraseData(phrase_datum->raw_data_,
+                             phrase_datum->raw_data_length_);
+  size_t mask = cache_slot_table_.size() - 1;
+  size_t slot = hash & mask;
+  while (cache_slot_table_[slot].index != -1)
+    slot = (slot + 1) & mask;
+  cache_slot_table_[slot].hash = hash;
+  cache_slot_table_[slot].index = index;
+}
+
+/**
+ * 按缓冲词语表重建散列表.
+ * 槽位数不少于词语数量的两倍. \n
+ */
+void PinyinEditor::RebuildCacheSlot() {
+  size_t amount = CACHE_SLOT_AMOUNT;
+  while (amount < cache_phrase_list_.size() * 2)
+    amount <<= 1;
+  CachePhraseSlot empty_slot = {0, -1};
+  cache_slot_table_.assign(amount, empty_slot);
+  for (size_t index = 0; index < cache_phrase_list_.size(); ++index)
+    InsertCacheSlot(index);
+}
+
+/**
+ * 让跨度表对应新的汉字代理数组.
+ * 两个数组相同的前缀之内的跨度依然有效，予以保留；其余跨度需要重新查询.
+ * 模糊拼音配置改变后，整张表都需要重新查询. \n
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的长度
+ */
+void PinyinEditor::UpdateSpanTable(const CharsProxy *chars_proxy,
+                                   int chars_proxy_length) {
+  /* 计算相同前缀的长度 */
+  uint serial = GetFuzzyProfile()->GetSerial();
+  int same_length = 0;
+  if (span_table_ && span_serial_ == serial) {
+    int length = chars_proxy_length < span_chars_proxy_length_ ?
+                     chars_proxy_length : span_chars_proxy_length_;
+    while (same_length < length &&
+           (chars_proxy + same_length)->major_index_ ==
+               (span_chars_proxy_ + same_length)->major_index_ &&
+           (chars_proxy + same_length)->minor_index_ ==
+               (span_chars_proxy_ + same_length)->minor_index_)
+      ++same_length;
+    if (same_length == chars_proxy_length &&
+        same_length == span_chars_proxy_length_)
+      return;
+  }
+
+  /* 创建新表，并移入仍然有效的跨度 */
+  PhraseProxyStorage *span_table = new PhraseProxyStorage[
+      chars_proxy_length * chars_proxy_length * ENGINE_SPAN_WIDTH];
+  int *span_length = new int[chars_proxy_length];
+  for (int start = 0; start < chars_proxy_length; ++start) {
+    PhraseProxyStorage *row =
+        span_table + start * chars_proxy_length * ENGINE_SPAN_WIDTH;
+    int valid_length = start < same_length ? same_length - start : 0;
+    if (start < same_length &&
+        *(span_length_ + start) < valid_length)
+      valid_length = *(span_length_ + start);
+    for (int count = 0; count < valid_length * ENGINE_SPAN_WIDTH; ++count)
+      (row + count)->Swap(span_table_ +
+                          start * span_chars_proxy_length_ *
+                              ENGINE_SPAN_WIDTH + count);
+    *(span_length + start) = valid_length;
+  }
+  ClearSpanTable();
+  span_table_ = span_table;
+  span_length_ = span_length;
+  span_chars_proxy_ = new CharsProxy[chars_proxy_length];
+  memcpy(span_chars_proxy_, chars_proxy,
+         sizeof(CharsProxy) * chars_proxy_length);
+  span_chars_proxy_length_ = chars_proxy_length;
+  span_serial_ = serial;
+}
+
+/**
+ * 查询跨度表中尚未查询的跨度.
+ * 每个起点一次查询即可得到全部尚缺的长度. \n
+ * @return 是否全部查询完毕，预算耗尽时为FALSE
+ */
+bool PinyinEditor::FillSpanTable() {
+  bool searched = false;
+  for (int start = 0; start < span_chars_proxy_length_; ++start) {
+    int length = span_chars_proxy_length_ - start;
+    if (*(span_length_ + start) == length)
+      continue;
+    if (searched && IsDeadlineExpired())
+      return false;
+    phrase_manager_->SearchPreferSpan(
+        GetFuzzyProfile(), span_chars_proxy_ + start, length,
+        *(span_length_ + start) + 1, ENGINE_SPAN_WIDTH,
+        span_table_ + start * span_chars_proxy_length_ * ENGINE_SPAN_WIDTH,
+        arena_);
+    *(span_length_ + start) = length;
+    searched = true;
+  }
+  return true;
+}
+
+/**
+ * 在跨度表上求出最佳分段.
+ * 量化频率与词语频率的对数成正比，各段得分之和即相当于各词语概率之积；
+ * 每多一段扣除一个满量程的得分，因此段数较少的分段优先，除非拆开后的各段
+ * 都明显更为常用. 用户词语总按满分计算. 同一码表中前后相接的两个词语
+ * 另按二元组的量化共现次数加分，常见搭配由此可抵消分段的代价，
+ * 也可让跨度中频率稍低的候选词语胜出. 因此状态是以某候选词语结尾的最佳
+ * 路径，而非某位置. 无法覆盖全部拼音时，取能够到达的最远位置. \n
+ * @param path 各段的候选词语在跨度表中的下标
+ * @return 段数
+ */
+int PinyinEditor::SearchEnginePath(int *path) {
+  int amount = span_chars_proxy_length_;
+  int size = amount * amount * ENGINE_SPAN_WIDTH;
+  /* 以各候选词语结尾的最佳路径的得分，及其前一段的下标(-1 没有,-2 不可到达) */
+  int *score = arena_->NewArray<int>(size);
+  int *prev = arena_->NewArray<int>(size);
+  int reach = 0, reach_index = -1;
+  for (int end = 1; end <= amount; ++end) {
+    for (int start = 0; start < end; ++start) {
+      int base = (start * amount + end - start - 1) * ENGINE_SPAN_WIDTH;
+      for (int index = base; index < base + ENGINE_SPAN_WIDTH; ++index) {
+        *(prev + index) = -2;
+        PhraseProxyStorage *storage = span_table_ + index;
+        if (!storage->valid_)
+          continue;
+        int local_score = storage->phrase_proxy_site_->type_ == USER_TYPE ?
+                              ENGINE_USER_SCORE :
+                              storage->phrase_proxy_.frequency_;
+        local_score -= ENGINE_SPAN_PENALTY;
+        /* 选出最佳的前一段 */
+        if (start == 0) {
+          *(score + index) = local_score;
+          *(prev + index) = -1;
+        }
+        for (int prev_start = 0; prev_start < start; ++prev_start) {
+          int prev_base = (prev_start * amount + start - prev_start - 1) *
+                          ENGINE_SPAN_WIDTH;
+          for (int prev_index = prev_base;
+               prev_index < prev_base + ENGINE_SPAN_WIDTH;
+               ++prev_index) {
+            if (*(prev + prev_index) == -2)
+              continue;
+            PhraseProxyStorage *prev_storage = span_table_ + prev_index;
+            int path_score = *(score + prev_index) + local_score;
+            if (prev_storage->phrase_proxy_site_ ==
+                storage->phrase_proxy_site_)
+              path_score += storage->phrase_proxy_site_->phrase_
+                                ->SearchBigramWeight(
+                                      &prev_storage->phrase_proxy_,
+                                      &storage->phrase_proxy_);
+            if (*(prev + index) == -2 || *(score + index) < path_score) {
+              *(score + index) = path_score;
+              *(prev + index) = prev_index;
+            }
+          }
+        }
+        /* 记录最远的终点 */
+        if (*(prev + index) == -2)
+          continue;
+        if (end > reach || *(score + reach_index) < *(score + index)) {
+          reach = end;
+          reach_index = index;
+        }
+      }
     }
   }
-  return result;
+
+  /* 由终点回溯 */
+  int count = 0;
+  for (int index = reach_index; index != -1; index = *(prev + index))
+    *(path + count++) = index;
+  std::reverse(path, path + count);
+
+  return count;
+}
+
+/**
+ * 按汉字代理数组更新还原出的拼音串.
+ * 只有与上次还原时不同的汉字才重新还原，相同的前缀直接保留. \n
+ */
+void PinyinEditor::UpdatePinyinText() {
+  /* 找出相同的前缀 */
+  int length = std::min((int)pinyin_chars_proxy_.size(), chars_proxy_length_);
+  int count = 0;
+  for (; count < length; ++count) {
+    const CharsProxy *chars_proxy1 = &pinyin_chars_proxy_[count];
+    const CharsProxy *chars_proxy2 = chars_proxy_ + count;
+    if (chars_proxy1->major_index_ != chars_proxy2->major_index_ ||
+        chars_proxy1->minor_index_ != chars_proxy2->minor_index_)
+      break;
+  }
+
+  /* 截去不同的部分，再逐个还原其余的汉字，每个汉字之后都接一个分隔符 */
+  pinyin_text_.resize(count < (int)pinyin_offset_.size() ?
+                          pinyin_offset_[count] : pinyin_text_.size());
+  pinyin_offset_.resize(count);
+  pinyin_chars_proxy_.resize(count);
+  PinyinParser pinyin_parser;
+  for (; count < chars_proxy_length_; ++count) {
+    const CharsProxy *chars_proxy = chars_proxy_ + count;
+    pinyin_chars_proxy_.push_back(*chars_proxy);
+    pinyin_offset_.push_back(pinyin_text_.size());
+    pinyin_text_.append(
+        pinyin_parser.GetPinyinUnitParts(chars_proxy->major_index_)->data);
+    if (chars_proxy->minor_index_ != -1)
+      pinyin_text_.append(
+          pinyin_parser.GetPinyinUnitParts(chars_proxy->minor_index_)->data);
+    pinyin_text_.push_back('\'');
+  }
 }
 
 /**
@@ -730,16 +1299,29 @@ bool PinyinEditor::IsExistCachePhrase(const PhraseDatum *datum) {
  * 使用(PhraseManager)类提供的拼音修正表. \n
  * @param string 原拼音串
  * @param mend_pair_table 拼音修正参考表
- * @return 新拼音串
+ * @param arena 临时内存区
+ * @return 新拼音串，由临时内存区分配
  */
 char *PinyinEditor::AmendPinyinString(
           const char *string,
-          const std::list<OuterMendPinyinPair *> *mend_pair_table) {
-  std::string mend_string;
+          const std::list<OuterMendPinyinPair *> *mend_pair_table,
+          PhraseArena *arena) {
+  /* 每个字符至多扩展为修正表中最大的倍数 */
+  size_t ratio = 1;
+  for (std::list<OuterMendPinyinPair *>::const_iterator iterator =
+           mend_pair_table->begin();
+       iterator != mend_pair_table->end();
+       ++iterator) {
+    size_t raw_length = strlen((*iterator)->raw_);
+    size_t mend_length = strlen((*iterator)->mend_);
+    if (raw_length != 0 && ratio * raw_length < mend_length)
+      ratio = (mend_length + raw_length - 1) / raw_length;
+  }
   size_t length = strlen(string);
-  mend_string.reserve(length << 1);
+  char *mend_string = (char *)arena->Alloc(length * ratio + 1);
 
   size_t count = 0;
+  char *ptr = mend_string;
   while (count < length) {
     std::list<OuterMendPinyinPair *>::const_iterator iterator =
         mend_pair_table->begin();
@@ -750,32 +1332,36 @@ char *PinyinEditor::AmendPinyinString(
         break;
     }
     if (iterator != mend_pair_table->end()) {
-      mend_string.append((*iterator)->mend_);
+      strcpy(ptr, (*iterator)->mend_);
+      ptr += strlen(ptr);
       count += strlen(raw);
     } else {
-      mend_string.append(1, *(string + count));
+      *ptr++ = *(string + count);
       ++count;
     }
   }
+  *ptr = '\0';
 
-  return strdup(mend_string.c_str());
+  return mend_string;
 }
 
 /**
  * 纠正拼音串中可能存在的错误.
- * 使用本类内置的拼音修正表. \n
+ * 使用本类内置的拼音修正表，其中每个修正串都只比原始串多出一个字符. \n
  * @param string 原拼音串
  * @param mend_pair_table 拼音修正参考表
- * @return 新拼音串
+ * @param arena 临时内存区
+ * @return 新拼音串，由临时内存区分配
  */
 char *PinyinEditor::AmendPinyinString(
           const char *string,
-          const InnerMendPinyinPair *mend_pair_table) {
-  std::string mend_string;
+          const InnerMendPinyinPair *mend_pair_table,
+          PhraseArena *arena) {
   size_t length = strlen(string);
-  mend_string.reserve(length << 1);
+  char *mend_string = (char *)arena->Alloc((length << 1) + 1);
 
   size_t count = 0;
+  char *ptr = mend_string;
   while (count < length) {
     const InnerMendPinyinPair *mend_pinyin_pair = mend_pair_table;
     for (; mend_pinyin_pair->raw; ++mend_pinyin_pair) {
@@ -784,15 +1370,17 @@ char *PinyinEditor::AmendPinyinString(
         break;
     }
     if (mend_pinyin_pair->raw) {
-      mend_string.append(mend_pinyin_pair->mend);
+      strcpy(ptr, mend_pinyin_pair->mend);
+      ptr += strlen(ptr);
       count += strlen(mend_pinyin_pair->raw);
     } else {
-      mend_string.append(1, *(string + count));
+      *ptr++ = *(string + count);
       ++count;
     }
   }
+  *ptr = '\0';
 
-  return strdup(mend_string.c_str());
+  return mend_string;
 }
 
 /**
@@ -801,18 +1389,23 @@ char *PinyinEditor::AmendPinyinString(
 void PinyinEditor::Clear() {
   cursor_point_ = 0;
   pinyin_table_.clear();
+  lookup_pending_ = false;
+  if (speculator_)
+    speculator_->CancelTask();
 
   ClearCharsProxy();
   ClearAcceptedPhraseList();
   ClearCachePhraseList();
-  ClearPhraseStorageList();
+  ClearPhraseStorageArray();
+  ClearSpanTable();
+  arena_->Reset();
+  origin_arena_->Reset();
 }
 
 /**
  * 清除汉字代理数组.
  */
 void PinyinEditor::ClearCharsProxy() {
-  delete [] chars_proxy_;
   chars_proxy_ = NULL;
   chars_proxy_length_ = 0;
 }
@@ -821,26 +1414,75 @@ void PinyinEditor::ClearCharsProxy() {
  * 清除已接受的词语数据.
  */
 void PinyinEditor::ClearAcceptedPhraseList() {
-  STL_DELETE_DATA(accepted_phrase_list_, std::list<PhraseDatum *>);
   accepted_phrase_list_.clear();
+  accepted_text_.clear();
 }
 
 /**
  * 清除缓冲的词语数据.
  */
 void PinyinEditor::ClearCachePhraseList() {
-  STL_DELETE_DATA(cache_phrase_list_, std::list<PhraseDatum *>);
+  extra_phrase_list_.clear();
+  if (cache_phrase_list_.empty())
+    return;
+  CachePhraseSlot empty_slot = {0, -1};
+  std::fill(cache_slot_table_.begin(), cache_slot_table_.end(), empty_slot);
   cache_phrase_list_.clear();
 }
 
 /**
  * 清除储存点数据.
  */
-void PinyinEditor::ClearPhraseStorageList() {
-  if (!phrase_storage_list_)
+void PinyinEditor::ClearPhraseStorageArray() {
+  DeletePhraseStorageArray(TakePhraseStorageArray());
+}
+
+/**
+ * 取走储存点数据，编辑器的查询状态随之清除.
+ * @return 储存点数组(可为NULL)，由调用者释放
+ */
+PhraseProxyStorage **PinyinEditor::TakePhraseStorageArray() {
+  fetched_proxy_amount_ = 0;
+  matched_proxy_amount_ = -1;
+  lookup_complete_ = true;
+  phrase_storage_heap_.Clear();
+
+  PhraseProxyStorage **storage_array = phrase_storage_array_;
+  phrase_storage_array_ = NULL;
+  return storage_array;
+}
+
+/**
+ * 释放储存点数组中的各储存点，数组本身随临时内存区回卷.
+ * @param storage_array 储存点数组(可为NULL)
+ */
+void PinyinEditor::DeletePhraseStorageArray(
+         PhraseProxyStorage **storage_array) {
+  if (!storage_array)
     return;
+  for (PhraseProxyStorage **storage = storage_array; *storage; ++storage)
+    (*storage)->Release();
+}
 
-  STL_DELETE_DATA(*phrase_storage_list_, std::list<PhraseProxyStorage *>);
-  delete phrase_storage_list_;
-  phrase_storage_list_ = NULL;
+/**
+ * 清除跨度表.
+ */
+void PinyinEditor::ClearSpanTable() {
+  delete [] span_table_;
+  span_table_ = NULL;
+  delete [] span_length_;
+  span_length_ = NULL;
+  delete [] span_chars_proxy_;
+  span_chars_proxy_ = NULL;
+  span_chars_proxy_length_ = 0;
+}
+
+/**
+ * 轮换临时内存区.
+ * 上次查询的临时数据移入备用内存区，在本次查询期间依然有效；
+ * 此前的备用内存区回卷后用于本次查询. 调用前须已清除此前两次查询的状态. \n
+ */
+void PinyinEditor::RewindArena() {
+  std::swap(arena_, origin_arena_);
+  arena_->Reset();
 }
@@ -13,7 +13,11 @@
 #define PYE_ENGINE_PINYIN_EDITOR_H_
 
 #include "phrase_manager.h"
+#include <sys/time.h>
 #include <string>
+#include <vector>
+
+class PinyinSpeculator;
 
 /**
  * 内部拼音纠错对.
@@ -23,8 +27,49 @@ typedef struct _InnerMendPinyinPair {
   const char *mend;  ///< 纠错串
 } InnerMendPinyinPair;
 
+/**
+ * 缓冲词语散列表的槽位.
+ */
+typedef struct _CachePhraseSlot {
+  uint hash;  ///< 词语原始数据的散列值
+  int index;  ///< 词语在缓冲词语表中的下标(-1 空槽)
+} CachePhraseSlot;
+
+/**
+ * 候选词语的只读视图.
+ * 视图不拥有任何数据，直接指向编辑器缓冲的词语数据(码表被映射时即为码表
+ * 本身)，在下一次编辑拼音或选定词语之前有效. \n
+ */
+class PhraseView {
+ public:
+  PhraseView()
+      : raw_data_(NULL), raw_data_length_(0),
+        chars_proxy_(NULL), chars_proxy_length_(0),
+        phrase_data_offset_(InvalidPhraseType), phrase_datum_(NULL) {}
+
+  const void *raw_data_;  ///< 词语的原始数据
+  int raw_data_length_;  ///< 词语的原始数据的长度
+  const CharsProxy *chars_proxy_;  ///< 词语的汉字代理数组
+  int chars_proxy_length_;  ///< 词语的汉字代理数组的长度
+  int phrase_data_offset_;  ///< 词语的来源(偏移量的特殊含义)
+  const PhraseDatum *phrase_datum_;  ///< 对应的词语数据，供选定、删除词语之用
+};
+
 /**
  * 拼音编辑器.
+ * 设置时间预算后，每次获取词语的调用在预算耗尽时即停止扫描，
+ * 只给出已经取出的、排序最靠前的词语；未完成的部分在下一次调用时接着进行. \n
+ * 引擎词语由整句转换给出：先为每个起点查出各长度下的最佳词语(跨度)，
+ * 再按频率及码表中的二元组求出覆盖全部拼音的最佳分段. 跨度按起点缓存，
+ * 拼音被编辑后只有跨过改动位置的跨度需要重新查询. \n
+ * 每次按键的临时数据(汉字代理数组、储存点及游标、候选词语等)都由临时内存区
+ * 分配，拼音被编辑时整体回卷. 两个内存区轮换使用，上次查询的储存点在增量
+ * 查询期间依然有效. 给出的词语数据在下一次编辑拼音之前有效. \n
+ * 推迟查询时，连续的编辑只在需要查询结果时才解析、查询一次. \n
+ * 启用预测查询后，每次查询完成都会在后台预先查询最可能的下一个按键，
+ * 结果由词语管理者的查询缓存保存. \n
+ * 已接受词语的文本及还原出的拼音串都随编辑逐段维护，获取文本时只需拷贝，
+ * 写入调用者提供的缓冲区时不再申请内存. \n
  */
 class PinyinEditor {
  public:
@@ -37,6 +82,7 @@ class PinyinEditor {
   void MoveCursorPoint(int offset);
   int GetCursorPoint();
   void InsertPinyinKey(char ch);
+  void InsertPinyinString(const char *string);
   void DeletePinyinKey();
   void BackspacePinyinKey();
   bool RevokeSelectedPhrase();
@@ -44,7 +90,15 @@ class PinyinEditor {
   void GetCommitText(char **text, int *len);
   void GetPreeditText(char **text, int *len);
   void GetAuxiliaryText(char **text, int *len);
+  void GetRawText(std::string *text);
+  void GetCommitText(std::string *text);
+  void GetPreeditText(std::string *text);
+  void GetAuxiliaryText(std::string *text);
   void GetPagePhrase(int pagesize, std::list<const PhraseDatum *> *list);
+  void GetPagePhrase(int page, int pagesize,
+                     std::list<const PhraseDatum *> *list);
+  int GetPageView(int page, int pagesize, PhraseView *views);
+  int GetPhraseAmount(bool *exact);
   void GetDynamicPhrase(std::list<const PhraseDatum *> *list);
   const PhraseDatum *GetEnginePhrase();
   void SelectCachePhrase(const PhraseDatum *datum);
@@ -53,38 +107,98 @@ class PinyinEditor {
   bool IsFinishTask();
   void StopTask();
   int GetPhraseOffset();
+  void SetFuzzyProfile(const FuzzyProfile *profile);
+  void SetLatencyBudget(int budget);
+  void SetDeferredLookup(bool deferred);
+  bool IsLookupComplete();
+  void SetSpeculativeLookup(int budget);
+  void GetSpeculationStats(uint *hits, uint *misses);
 
  private:
+  friend class PinyinSpeculator;
+
   PhraseDatum *CreateUserPhrase();
   PhraseProxyStorage *SearchPreferPhrase();
+  void PopPreferPhrase();
+  PhraseDatum *FetchCachePhrase();
+  void FillCachePhrase(size_t amount);
+  const FuzzyProfile *GetFuzzyProfile();
+  void ArmDeadline();
+  bool IsDeadlineExpired();
 
+  void NotifyPinyinChange();
+  void UpdatePinyinQuery();
+  void FlushPinyinQuery();
+  void StartSpeculation();
   void CreateCharsProxy();
-  void LookupPhraseProxy();
+  void LookupPhraseProxy(PhraseProxyStorage *const *origin_array);
   int FinishCharsOffset();
   bool IsExistCachePhrase(const PhraseDatum *datum);
+  void AppendCachePhrase(PhraseDatum *datum);
+  PhraseDatum *AppendExtraPhrase(PhraseDatum *datum);
+  void InsertCacheSlot(int index);
+  void RebuildCacheSlot();
+  void UpdateSpanTable(const CharsProxy *chars_proxy, int chars_proxy_length);
+  bool FillSpanTable();
+  int SearchEnginePath(int *path);
+  void UpdatePinyinText();
 
-  char *AmendPinyinString(
-            const char *string,
-            const std::list<OuterMendPinyinPair *> *mend_pair_table);
-  char *AmendPinyinString(const char *string,
-                          const InnerMendPinyinPair *mend_pair_table);
+  static void ParsePinyinString(const PhraseManager *phrase_manager,
+                                const char *string, PhraseArena *arena,
+                                CharsProxy **chars_proxy, int *length);
+  static char *AmendPinyinString(
+                   const char *string,
+                   const std::list<OuterMendPinyinPair *> *mend_pair_table,
+                   PhraseArena *arena);
+  static char *AmendPinyinString(const char *string,
+                                 const InnerMendPinyinPair *mend_pair_table,
+                                 PhraseArena *arena);
 
   void Clear();
   void ClearCharsProxy();
   void ClearAcceptedPhraseList();
   void ClearCachePhraseList();
-  void ClearPhraseStorageList();
+  void ClearPhraseStorageArray();
+  PhraseProxyStorage **TakePhraseStorageArray();
+  static void DeletePhraseStorageArray(PhraseProxyStorage **storage_array);
+  void ClearSpanTable();
+  void RewindArena();
 
   bool editor_mode_;  ///< 当前编辑模式;true 中文,false 英文
   int cursor_point_;  ///< 当前光标位置
   std::string pinyin_table_;  ///< 待查询拼音表
   CharsProxy *chars_proxy_;  ///< 汉字代理数组
   int chars_proxy_length_;  ///< 汉字代理数组长度
-  std::list<PhraseDatum *> accepted_phrase_list_;  ///< 已接受词语链表
-  std::list<PhraseDatum *> cache_phrase_list_;  ///< 缓冲词语链表
+  std::vector<PhraseDatum *> accepted_phrase_list_;  ///< 已接受词语表
+  std::string accepted_text_;  ///< 已接受词语的原始数据之和
+  std::vector<PhraseDatum *> cache_phrase_list_;  ///< 缓冲词语表
+  std::vector<CachePhraseSlot> cache_slot_table_;  ///< 缓冲词语的散列表
+  std::vector<PhraseDatum *> extra_phrase_list_;  ///< 动态词语及引擎词语表
 
   const PhraseManager *phrase_manager_;  ///< 词语管理者
-  std::list<PhraseProxyStorage *> *phrase_storage_list_;  ///< 词语储存点链表
+  const FuzzyProfile *fuzzy_profile_;  ///< 模糊拼音配置(已被引用，NULL表示默认配置)
+  PhraseProxyStorage **phrase_storage_array_;  ///< 词语储存点数组(以NULL结束)
+  MergeHeap<PhraseProxyStorage, PhraseProxyStorageCmp>
+      phrase_storage_heap_;  ///< 词语储存点的归并堆
+  int fetched_proxy_amount_;  ///< 已从归并堆取出的词语数据代理数量
+  int matched_proxy_amount_;  ///< 相匹配的词语数据代理总数(-1 尚未统计)
+  int latency_budget_;  ///< 每次获取词语的时间预算(微秒,0 不限制)
+  struct timeval deadline_;  ///< 本次获取词语的截止时刻
+  bool lookup_complete_;  ///< 最近一次获取的词语是否完整
+  PhraseProxyStorage *span_table_;  ///< 各起点各长度的候选词语(可为无效) *
+  int *span_length_;  ///< 各起点已经查询过的最大长度 *
+  CharsProxy *span_chars_proxy_;  ///< 跨度表对应的汉字代理数组 *
+  int span_chars_proxy_length_;  ///< 跨度表对应的汉字代理数组的长度
+  uint span_serial_;  ///< 跨度表对应的模糊拼音配置的序号
+  bool deferred_lookup_;  ///< 是否推迟查询，直到需要查询结果时才进行
+  bool lookup_pending_;  ///< 是否有被推迟、尚未进行的查询
+  PhraseArena *arena_;  ///< 本次查询的临时内存区 *
+  PhraseArena *origin_arena_;  ///< 上次查询的临时内存区 *
+  PinyinSpeculator *speculator_;  ///< 拼音预测者(未启用为NULL) *
+  std::string pinyin_text_;  ///< 由汉字代理数组还原出的拼音串
+  std::vector<int> pinyin_offset_;  ///< 各汉字在还原出的拼音串中的起点
+  std::vector<CharsProxy> pinyin_chars_proxy_;  ///< 还原拼音串所用的汉字代理数组
+  std::string text_buffer_;  ///< 由新申请的内存给出文本时所用的缓冲区
 
   static InnerMendPinyinPair mend_pair_table_[];  ///< 内置拼音修正表
 };
@@ -109,13 +109,25 @@ bool PinyinParser::ParsePinyin(const char *pinyin, CharsProxy **chars_proxy, int
   *chars_proxy = new CharsProxy[size];
 
   /* 分析拼音串 */
+  return ParsePinyin(pinyin, *chars_proxy, length);
+}
+
+/**
+ * 分析拼音串，结果写入调用者提供的数组.
+ * @param pinyin 原始拼音串，e.g.<yumen,yu'men>
+ * @param chars_proxy 汉字代理数组，长度不小于拼音串的长度且已被构造
+ * @param length 汉字代理数组有效长度
+ * @return 是否分析成功
+ */
+bool PinyinParser::ParsePinyin(const char *pinyin, CharsProxy *chars_proxy,
+                               int *length) {
   *length = -1;
   PinyinUnitAttribute type = ATOM_TYPE;
   const char *ptr = pinyin;
   while (*ptr != '\0') {
     int8_t index = SearchMatchablePinyinUnitParts(ptr);
     if (index != -1) {
-      AppendPinyinUnitParts(*chars_proxy, length, index, &type);
+      AppendPinyinUnitParts(chars_proxy, length, index, &type);
       ptr += strlen((parts_array_ + index)->data);
     } else {
       ++ptr;
@@ -173,6 +185,17 @@ int8_t PinyinParser::GetPinyinUnitPartsAmount() {
   return N_ARRAY_ELEMENTS(parts_array_);
 }
 
+/**
+ * 获取拼音单元部件.
+ * @param index 索引值
+ * @return 拼音单元部件，索引值越界为NULL
+ */
+const PinyinUnitParts *PinyinParser::GetPinyinUnitParts(int8_t index) {
+  if (index < 0 || index >= GetPinyinUnitPartsAmount() - 1)
+    return NULL;
+  return parts_array_ + index;
+}
+
 /**
  * 搜索拼音串所匹配的拼音单元部件的索引值.
  * @param pinyin 拼音串，e.g.<yumen,u'men,'men>
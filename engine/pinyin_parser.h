@@ -55,9 +55,11 @@ class PinyinParser {
   ~PinyinParser();
 
   bool ParsePinyin(const char *pinyin, CharsProxy **chars_proxy, int *length);
+  bool ParsePinyin(const char *pinyin, CharsProxy *chars_proxy, int *length);
   char *UnparsePinyin(const CharsProxy *chars_proxy, int length);
   int8_t GetPinyinUnitPartsIndex(const char *pinyin);
   int8_t GetPinyinUnitPartsAmount();
+  const PinyinUnitParts *GetPinyinUnitParts(int8_t index);
 
  private:
   int8_t SearchMatchablePinyinUnitParts(const char *pinyin);
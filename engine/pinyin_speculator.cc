@@ -0,0 +1,355 @@
+//
+// C++ Implementation: pinyin_speculator
+//
+// Description:
+// 请参见头文件描述.
+//
+// Author: Jally <jallyx@163.com>, (C) 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#include "pinyin_speculator.h"
+#include <sched.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+#include "pinyin_editor.h"
+#include "pinyin_parser.h"
+#include "pye_output.h"
+
+/* 每个实际按键在字母转移统计中的权重 */
+#define SPECULATIVE_LEARN_WEIGHT 4
+/* 统计值达到此值时整行减半，以便跟上用户习惯的变化 */
+#define SPECULATIVE_LETTER_LIMIT 65536
+
+/**
+ * 类构造函数.
+ * @param phrase_manager 词语管理者
+ * @param budget 每轮查询的时间预算(微秒)
+ */
+PinyinSpeculator::PinyinSpeculator(const PhraseManager *phrase_manager,
+                                   int budget)
+    : phrase_manager_(phrase_manager), profile_(NULL), finished_amount_(0),
+      budget_(budget), generation_(0), pending_(false), abort_(0),
+      quit_(false), hits_(0), misses_(0), arena_(NULL), thread_valid_(false) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&task_cond_, NULL);
+  SeedLetterTable();
+  arena_ = new PhraseArena;
+
+  int error = pthread_create(&thread_, NULL, WorkThread, this);
+  if (error == 0)
+    thread_valid_ = true;
+  else
+    pwarning("Create speculative thread failed, %s", strerror(error));
+}
+
+/**
+ * 类析构函数.
+ */
+PinyinSpeculator::~PinyinSpeculator() {
+  /* 通知并回收工作线程 */
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  ++generation_;
+  __atomic_store_n(&abort_, 1, __ATOMIC_RELAXED);
+  pthread_cond_signal(&task_cond_);
+  pthread_mutex_unlock(&mutex_);
+  if (thread_valid_)
+    pthread_join(thread_, NULL);
+
+  if (profile_)
+    profile_->Unref();
+  delete arena_;
+  pthread_mutex_destroy(&mutex_);
+  pthread_cond_destroy(&task_cond_);
+}
+
+/**
+ * 设置每轮查询的时间预算.
+ * 预算在每个查询开始前检查，单个查询不会因预算而被打断. \n
+ * @param budget 时间预算(微秒)
+ */
+void PinyinSpeculator::SetBudget(int budget) {
+  pthread_mutex_lock(&mutex_);
+  budget_ = budget;
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 将实际的按键累积到字母转移统计中.
+ * @param prev 前一个字符(拼音串的起点为'\0')
+ * @param ch 按键字符
+ */
+void PinyinSpeculator::LearnPinyinKey(char prev, char ch) {
+  int column = GetLetterIndex(ch);
+  if (column == -1)
+    return;
+  int row = GetLetterIndex(prev);
+  if (row == -1)
+    row = SPECULATIVE_LETTER_ROWS - 1;
+
+  uint *letters = letter_table_[row];
+  letters[column] += SPECULATIVE_LEARN_WEIGHT;
+  if (letters[column] >= SPECULATIVE_LETTER_LIMIT) {
+    for (int count = 0; count < SPECULATIVE_LETTER_COLUMNS; ++count)
+      letters[count] >>= 1;
+  }
+}
+
+/**
+ * 预测最可能的下一个按键.
+ * @param prev 当前的最后一个字符(拼音串的起点为'\0')
+ * @param keys 按可能性由高到低存放预测的按键
+ * @param amount keys的容量
+ * @return 预测的按键数量
+ */
+int PinyinSpeculator::PredictPinyinKey(char prev, char *keys, int amount) {
+  int row = GetLetterIndex(prev);
+  if (row == -1)
+    row = SPECULATIVE_LETTER_ROWS - 1;
+  const uint *letters = letter_table_[row];
+
+  /* 按统计值插入排序，只保留前amount个 */
+  int columns[SPECULATIVE_LETTER_COLUMNS];
+  int length = 0;
+  amount = std::min(amount, SPECULATIVE_LETTER_COLUMNS);
+  if (amount <= 0)
+    return 0;
+  for (int column = 0; column < SPECULATIVE_LETTER_COLUMNS; ++column) {
+    if (letters[column] == 0)
+      continue;
+    if (length == amount && letters[columns[length - 1]] >= letters[column])
+      continue;
+    int count = length < amount ? length++ : amount - 1;
+    for (; count > 0 && letters[columns[count - 1]] < letters[column]; --count)
+      columns[count] = columns[count - 1];
+    columns[count] = column;
+  }
+  for (int count = 0; count < length; ++count)
+    keys[count] = 'a' + columns[count];
+  return length;
+}
+
+/**
+ * 开始新一轮查询.
+ * 上一轮尚未完成的查询即被放弃. \n
+ * @param profile 模糊拼音配置
+ * @param pinyin 当前的拼音串
+ * @param keys 预测的按键，依次追加在拼音串之后查询
+ * @param amount 按键数量
+ */
+void PinyinSpeculator::StartTask(const FuzzyProfile *profile,
+                                 const std::string &pinyin, const char *keys,
+                                 int amount) {
+  if (!thread_valid_ || amount <= 0)
+    return;
+
+  profile->Ref();
+  pthread_mutex_lock(&mutex_);
+  ++generation_;
+  pinyin_.assign(pinyin);
+  keys_.assign(keys, amount);
+  finished_amount_ = 0;
+  std::swap(profile_, profile);
+  pending_ = true;
+  __atomic_store_n(&abort_, 1, __ATOMIC_RELAXED);
+  pthread_cond_signal(&task_cond_);
+  pthread_mutex_unlock(&mutex_);
+  if (profile)
+    profile->Unref();
+}
+
+/**
+ * 停止本轮查询.
+ * 立即返回，正在进行的查询在扫描下一个集合之前放弃；
+ * 已经完成的查询依然可供核对. \n
+ */
+void PinyinSpeculator::StopTask() {
+  pthread_mutex_lock(&mutex_);
+  ++generation_;
+  pending_ = false;
+  __atomic_store_n(&abort_, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 取消本轮查询.
+ * 与停止不同，已经完成的查询也不再核对. 立即返回，不等待工作线程. \n
+ */
+void PinyinSpeculator::CancelTask() {
+  pthread_mutex_lock(&mutex_);
+  ++generation_;
+  pending_ = false;
+  __atomic_store_n(&abort_, 1, __ATOMIC_RELAXED);
+  keys_.clear();
+  finished_amount_ = 0;
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 核对实际的拼音串是否已被预先查询，并记入统计.
+ * 每轮查询只核对一次，此后本轮即告结束. \n
+ * @param pinyin 实际的拼音串
+ * @return 是否命中
+ */
+bool PinyinSpeculator::MatchQuery(const std::string &pinyin) {
+  pthread_mutex_lock(&mutex_);
+  if (keys_.empty()) {
+    pthread_mutex_unlock(&mutex_);
+    return false;
+  }
+  ++generation_;
+  pending_ = false;
+  bool hit = false;
+  if (pinyin.size() == pinyin_.size() + 1 &&
+      pinyin.compare(0, pinyin_.size(), pinyin_) == 0)
+    hit = keys_.find(*pinyin.rbegin()) < (size_t)finished_amount_;
+  if (hit)
+    ++hits_;
+  else
+    ++misses_;
+  keys_.clear();
+  finished_amount_ = 0;
+  pthread_mutex_unlock(&mutex_);
+
+  return hit;
+}
+
+/**
+ * 获取预测查询的统计数据.
+ * 实际的拼音串恰为上一轮已完成的某个查询即为命中，否则为未命中. \n
+ * @param hits 命中次数
+ * @param misses 未命中次数
+ */
+void PinyinSpeculator::GetStats(uint *hits, uint *misses) {
+  pthread_mutex_lock(&mutex_);
+  *hits = hits_;
+  *misses = misses_;
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 以拼音单元部件的拼写作为字母转移统计的先验.
+ * 统计部件内部的字母转移、拼音串起点到部件的转移以及部件之间可能的衔接. \n
+ */
+void PinyinSpeculator::SeedLetterTable() {
+  memset(letter_table_, 0, sizeof(letter_table_));
+
+  PinyinParser pinyin_parser;
+  const PinyinUnitParts *parts;
+  for (int8_t index = 0;
+       (parts = pinyin_parser.GetPinyinUnitParts(index));
+       ++index) {
+    const char *data = parts->data;
+    size_t length = strlen(data);
+    for (size_t count = 1; count < length; ++count)
+      ++letter_table_[GetLetterIndex(*(data + count - 1))]
+                     [GetLetterIndex(*(data + count))];
+    if (parts->type != MINOR_TYPE)
+      ++letter_table_[SPECULATIVE_LETTER_ROWS - 1][GetLetterIndex(*data)];
+
+    /* 第一部分之后接第二部分，第二部分之后接下一个汉字的第一部分 */
+    int row = GetLetterIndex(*(data + length - 1));
+    const PinyinUnitParts *next;
+    for (int8_t next_index = 0;
+         (next = pinyin_parser.GetPinyinUnitParts(next_index));
+         ++next_index) {
+      bool follow = false;
+      if ((parts->type & MAJOR_TYPE) && (next->type & MINOR_TYPE))
+        follow = true;
+      else if (parts->type != MAJOR_TYPE && next->type != MINOR_TYPE)
+        follow = true;
+      if (follow)
+        ++letter_table_[row][GetLetterIndex(*next->data)];
+    }
+  }
+}
+
+/**
+ * 工作线程的主循环.
+ */
+void PinyinSpeculator::RunTask() {
+  pthread_mutex_lock(&mutex_);
+  while (true) {
+    while (!quit_ && !pending_)
+      pthread_cond_wait(&task_cond_, &mutex_);
+    if (quit_)
+      break;
+
+    /* 开始新一轮查询 */
+    pending_ = false;
+    __atomic_store_n(&abort_, 0, __ATOMIC_RELAXED);
+    uint generation = generation_;
+    const FuzzyProfile *profile = profile_;
+    profile->Ref();
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    std::string pinyin;
+    for (size_t count = 0; count < keys_.size(); ++count) {
+      if (generation_ != generation || IsBudgetExpired(&start))
+        break;
+      pinyin.assign(pinyin_);
+      pinyin.push_back(keys_[count]);
+      pthread_mutex_unlock(&mutex_);
+
+      /* 查询结果只加入查询缓存 */
+      CharsProxy *chars_proxy;
+      int chars_proxy_length;
+      PinyinEditor::ParsePinyinString(phrase_manager_, pinyin.c_str(), arena_,
+                                      &chars_proxy, &chars_proxy_length);
+      phrase_manager_->PrefetchSystemPhrase(profile, chars_proxy,
+                                            chars_proxy_length, &abort_,
+                                            arena_);
+      arena_->Reset();
+
+      pthread_mutex_lock(&mutex_);
+      if (generation_ == generation)
+        finished_amount_ = count + 1;
+    }
+    profile->Unref();
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 本轮查询的时间预算是否已经耗尽.
+ * @note 调用者必须持有预测者锁.
+ * @param start 本轮查询的开始时刻
+ * @return BOOL
+ */
+bool PinyinSpeculator::IsBudgetExpired(const struct timeval *start) {
+  struct timeval now, elapsed;
+  gettimeofday(&now, NULL);
+  timersub(&now, start, &elapsed);
+  return elapsed.tv_sec * 1000000LL + elapsed.tv_usec >= budget_;
+}
+
+/**
+ * 获取字母在字母转移统计中的索引.
+ * @param ch 字符
+ * @return 索引(非小写字母为-1)
+ */
+int PinyinSpeculator::GetLetterIndex(char ch) {
+  if (ch < 'a' || ch > 'z')
+    return -1;
+  return ch - 'a';
+}
+
+/**
+ * 预测工作线程.
+ * @param arg 拼音预测者
+ * @return NULL
+ */
+void *PinyinSpeculator::WorkThread(void *arg) {
+  PinyinSpeculator *speculator = (PinyinSpeculator *)arg;
+#ifdef SCHED_IDLE
+  /* 只利用空闲的处理器，不与编辑器所在的线程争抢 */
+  struct sched_param param;
+  param.sched_priority = 0;
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+  speculator->RunTask();
+  return NULL;
+}
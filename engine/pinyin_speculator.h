@@ -0,0 +1,82 @@
+//
+// C++ Interface: pinyin_speculator
+//
+// Description:
+// 拼音预测者，在两次按键的空闲期间预先查询最可能的下一个按键，
+// 查询结果由词语管理者的查询缓存保存，真正的按键到达时只需再扫描用户词语.
+// 下一个按键按字母转移统计预测：统计以拼音单元部件的拼写为先验，
+// 并随用户实际的按键不断累积.
+//
+// Author: Jally <jallyx@163.com>, (C) 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef PYE_ENGINE_PINYIN_SPECULATOR_H_
+#define PYE_ENGINE_PINYIN_SPECULATOR_H_
+
+#include <pthread.h>
+#include <string>
+#include "phrase_manager.h"
+
+/* 字母转移统计的行数，最后一行为拼音串的起点 */
+#define SPECULATIVE_LETTER_ROWS 27
+/* 字母转移统计的列数 */
+#define SPECULATIVE_LETTER_COLUMNS 26
+
+/**
+ * 拼音预测者.
+ * 每轮查询在当前拼音串之后分别追加预测的各个按键，拼音串的解析及查询都在
+ * 独立的工作线程中进行，每轮耗时不超过预算. 新的按键到达时本轮查询即被停止：
+ * 正在进行的查询在扫描下一个集合之前放弃，停止及取消都不等待工作线程. \n
+ * 工作线程只扫描系统词语集合(PhraseManager::PrefetchSystemPhrase)，
+ * 从不读取用户词语，因此任何编辑器修改用户词语时都无需与之同步. \n
+ * 字母转移统计只由编辑器所在的线程访问，无需加锁. \n
+ * @note 必须启用词语管理者的查询缓存，否则工作线程不做任何查询.
+ */
+class PinyinSpeculator {
+ public:
+  PinyinSpeculator(const PhraseManager *phrase_manager, int budget);
+  ~PinyinSpeculator();
+
+  void SetBudget(int budget);
+  void LearnPinyinKey(char prev, char ch);
+  int PredictPinyinKey(char prev, char *keys, int amount);
+  void StartTask(const FuzzyProfile *profile, const std::string &pinyin,
+                 const char *keys, int amount);
+  void StopTask();
+  void CancelTask();
+  bool MatchQuery(const std::string &pinyin);
+  void GetStats(uint *hits, uint *misses);
+
+ private:
+  void SeedLetterTable();
+  void RunTask();
+  bool IsBudgetExpired(const struct timeval *start);
+  static int GetLetterIndex(char ch);
+  static void *WorkThread(void *arg);
+
+  const PhraseManager *phrase_manager_;  ///< 词语管理者
+  uint letter_table_[SPECULATIVE_LETTER_ROWS]
+                    [SPECULATIVE_LETTER_COLUMNS];  ///< 字母转移统计
+
+  std::string pinyin_;  ///< 本轮查询的拼音串
+  std::string keys_;  ///< 本轮查询预测的按键(为空表示本轮已经结束)
+  const FuzzyProfile *profile_;  ///< 本轮所用的模糊拼音配置(已被引用，可为NULL)
+  int finished_amount_;  ///< 本轮已经完成的查询数量
+  int budget_;  ///< 每轮查询的时间预算(微秒)
+  uint generation_;  ///< 轮次，每次开始或停止都会递增
+  bool pending_;  ///< 是否有尚未开始的一轮查询
+  int abort_;  ///< 中止标志，非0时正在进行的查询尽快放弃
+  bool quit_;  ///< 工作线程是否应该退出
+  uint hits_;  ///< 命中次数
+  uint misses_;  ///< 未命中次数
+  PhraseArena *arena_;  ///< 工作线程的临时内存区 *
+
+  pthread_t thread_;  ///< 工作线程
+  bool thread_valid_;  ///< 工作线程是否已被创建
+  pthread_mutex_t mutex_;  ///< 预测者锁
+  pthread_cond_t task_cond_;  ///< 有新一轮查询或需要退出
+};
+
+#endif  // PYE_ENGINE_PINYIN_SPECULATOR_H_
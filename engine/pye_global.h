@@ -12,6 +12,16 @@
 #ifndef PYE_ENGINE_PYE_GLOBAL_H_
 #define PYE_ENGINE_PYE_GLOBAL_H_
 
+/* 系统码表文件标识("PYMB")及格式版本 */
+#define SYSTEM_MB_MAGIC 0x424d5950
+#define SYSTEM_MB_VERSION 3
+/* 码表文件热区的对齐单位 */
+#define SYSTEM_MB_PAGE 4096
+/* 二元组散列表的空槽标记及散列函数，码表创建者与引擎必须保持一致 */
+#define SYSTEM_MB_BIGRAM_EMPTY (~(uint64_t)0)
+#define SYSTEM_MB_BIGRAM_HASH(key) \
+    ((uint)(((uint64_t)(key) * 0x9e3779b97f4a7c15ULL) >> 32))
+
 #define N_ARRAY_ELEMENTS(ArrayName) \
     (sizeof(ArrayName)/sizeof((ArrayName)[0]))
 
@@ -92,6 +92,30 @@ ssize_t xread(int fd, void *buf, size_t count) {
   return offset;
 }
 
+/**
+ * 在指定位置读取数据.
+ * @param fd as in pread()
+ * @param buf as in pread()
+ * @param count as in pread()
+ * @param offset as in pread()
+ * @return 成功读取的字节数
+ */
+ssize_t xpread(int fd, void *buf, size_t count, off_t offset) {
+  ssize_t size = -1;
+  size_t length = 0;
+  while ((length != count) && (size != 0)) {
+    if ((size = pread(fd, (char *)buf + length, count - length,
+                      offset + length)) == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    length += size;
+  }
+
+  return length;
+}
+
 /**
  * 拷贝文件.
  * @param srcfile 源文件
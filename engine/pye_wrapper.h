@@ -23,6 +23,7 @@ char *strchomp(char *s);
 
 ssize_t xwrite(int fd, const void *buf, size_t count);
 ssize_t xread(int fd, void *buf, size_t count);
+ssize_t xpread(int fd, void *buf, size_t count, off_t offset);
 int xcopy(const char *srcfile, const char *dstfile);
 
 #endif  // PYE_ENGINE_PYE_WRAPPER_H_
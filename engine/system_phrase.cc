@@ -10,6 +10,10 @@
 //
 //
 #include "system_phrase.h"
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
@@ -17,223 +21,658 @@
 #include "pye_global.h"
 #include "pye_output.h"
 #include "pye_wrapper.h"
+#include "thread_pool.h"
+
+/* 文件头长度: (文件标识,格式版本,数据索引部分的偏移量,热区长度,
+ * 二元组部分的偏移量,二元组散列表的槽位数) */
+#define HEADER_LENGTH (sizeof(int) * 6)
+/* 词语数量达到此值的长度节点才建立精确索引 */
+#define EXACT_INDEX_AMOUNT 256
+
+/**
+ * 从索引数据中取出一个值.
+ * @param ptr 当前读取位置，读取后将被后移
+ * @param end 索引数据的结束位置
+ * @param value 值
+ * @param size 值的大小
+ * @return 数据是否足够
+ */
+static bool TakeIndexValue(const char **ptr, const char *end,
+                           void *value, size_t size) {
+  if ((size_t)(end - *ptr) < size)
+    return false;
+  memcpy(value, *ptr, size);
+  *ptr += size;
+  return true;
+}
+
+/**
+ * 精确索引的后台建立任务.
+ */
+class ExactIndexTask : public ThreadTask {
+ public:
+  ExactIndexTask() : length_node_(NULL), length_(0) {}
+  virtual ~ExactIndexTask() {}
+
+  /**
+   * 以最低优先级建立长度节点的精确索引，尽量不与查询者争抢处理器.
+   */
+  virtual void Run() {
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    SystemPhrase::SetupExactIndex(length_node_, length_);
+  }
+
+  SystemPhraseLengthNode *length_node_;  ///< 长度节点
+  int length_;  ///< 长度
+};
 
 /**
  * 类构造函数.
  */
 SystemPhrase::SystemPhrase()
-    : fuzzy_pair_table_(NULL), index_offset_(0), fd_(-1) {
+    : index_offset_(0), hot_length_(0), bigram_offset_(0), bigram_slots_(0),
+      bigram_key_(NULL), bigram_weight_(NULL), phrase_amount_(0),
+      phrase_hits_(NULL), exact_index_(false), index_pool_(NULL),
+      index_pending_(0),
+      index_data_(NULL), bigram_data_(NULL), map_data_(NULL), map_length_(0),
+      fd_(-1) {
+  pthread_mutex_init(&index_mutex_, NULL);
 }
 
 /**
  * 类析构函数.
  */
 SystemPhrase::~SystemPhrase() {
-  close(fd_);
+  ClearPhraseTree();
+  pthread_mutex_destroy(&index_mutex_);
+  delete [] phrase_hits_;
+  if (fd_ != -1)
+    close(fd_);
 }
 
 /**
  * 构建词语树.
+ * 码表文件的索引部分及二元组部分被一次性读入私有缓冲区. \n
  * @param mbfile 系统码表文件
+ * @return 是否成功
  */
-void SystemPhrase::BuildPhraseTree(const char *mbfile) {
+bool SystemPhrase::BuildPhraseTree(const char *mbfile) {
   /* 打开码表文件 */
   if ((fd_ = open(mbfile, O_RDONLY)) == -1) {
     pwarning("Open file \"%s\" failed, %s", mbfile, strerror(errno));
-    return;
+    return false;
+  }
+
+  /* 读取文件头及索引部分 */
+  char header[HEADER_LENGTH];
+  bool valid = xread(fd_, header, sizeof(header)) == sizeof(header) &&
+               ParsePhraseHeader(header, sizeof(header));
+  if (valid) {
+    size_t length = index_offset_ - HEADER_LENGTH;
+    index_data_ = (char *)malloc(length);
+    valid = xread(fd_, index_data_, length) == (ssize_t)length &&
+            ParsePhraseTree(index_data_, length);
+  }
+  if (valid && bigram_slots_ != 0) {
+    /* 二元组部分必须完整地位于文件之内 */
+    struct stat st;
+    size_t slot_length = sizeof(uint64_t) + sizeof(uint8_t);
+    valid = fstat(fd_, &st) != -1 && bigram_offset_ >= 0 &&
+            (off_t)bigram_offset_ <= st.st_size &&
+            bigram_slots_ <= (st.st_size - bigram_offset_) / slot_length;
+    if (valid) {
+      size_t length = slot_length * bigram_slots_;
+      if (!(bigram_data_ = (char *)malloc(length))) {
+        pwarning("Allocate bigram data of \"%s\" failed, %s", mbfile,
+                 strerror(errno));
+        valid = false;
+      } else {
+        valid = xpread(fd_, bigram_data_, length, bigram_offset_) ==
+                    (ssize_t)length &&
+                ParsePhraseBigram(bigram_data_, length);
+      }
+    }
+  }
+  if (!valid) {
+    pwarning("File \"%s\" is not a valid system mb file", mbfile);
+    ClearPhraseTree();
+    close(fd_);
+    fd_ = -1;
+    return false;
   }
 
-  /* 读取词语树 */
-  ReadPhraseTree();
+  /* 只预读热区，其余部分按随机访问处理 */
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_RANDOM);
+  if (hot_length_ != 0)
+    posix_fadvise(fd_, index_offset_, hot_length_, POSIX_FADV_WILLNEED);
+
+  return true;
 }
 
 /**
- * 设置模糊拼音单元部件对照表.
- * @param fuzzy_pair_table 对照表
- * @note 在查询词语之前必须调用本函数.
+ * 以共享内存的方式构建词语树.
+ * 码表文件被只读映射到内存，词语树直接引用映射区中的汉字代理数组等数据，
+ * 词语数据也直接从映射区获取. 映射区由系统页面缓存支撑，
+ * 因此同一主机上所有使用本码表文件的进程共享同一份物理内存，
+ * 后续进程只需建立映射和少量节点即可完成加载. \n
+ * @param mbfile 系统码表文件
+ * @return 是否成功
+ * @note 码表文件在使用期间不应被原地改写，更新时请以新文件替换(rename).
  */
-void SystemPhrase::SetFuzzyPinyinTable(const int8_t **fuzzy_pair_table) {
-  fuzzy_pair_table_ = fuzzy_pair_table;
+bool SystemPhrase::MapPhraseTree(const char *mbfile) {
+  /* 打开码表文件 */
+  if ((fd_ = open(mbfile, O_RDONLY)) == -1) {
+    pwarning("Open file \"%s\" failed, %s", mbfile, strerror(errno));
+    return false;
+  }
+
+  /* 映射码表文件 */
+  struct stat st;
+  if (fstat(fd_, &st) == -1 || st.st_size == 0 ||
+      (map_data_ = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_, 0)) ==
+          MAP_FAILED) {
+    pwarning("Map file \"%s\" failed, %s", mbfile, strerror(errno));
+    map_data_ = NULL;
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  map_length_ = st.st_size;
+
+  /* 分析文件头及索引部分 */
+  const char *data = (const char *)map_data_;
+  if (!ParsePhraseHeader(data, map_length_) ||
+      (size_t)index_offset_ > map_length_ ||
+      !ParsePhraseTree(data + HEADER_LENGTH, index_offset_ - HEADER_LENGTH) ||
+      (size_t)bigram_offset_ > map_length_ ||
+      !ParsePhraseBigram(data + bigram_offset_,
+                         map_length_ - bigram_offset_)) {
+    pwarning("File \"%s\" is not a valid system mb file", mbfile);
+    ClearPhraseTree();
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  /* 只预读热区，其余部分按随机访问处理 */
+  madvise(map_data_, map_length_, MADV_RANDOM);
+  if (hot_length_ != 0) {
+    size_t offset = index_offset_ & ~(size_t)(SYSTEM_MB_PAGE - 1);
+    madvise((char *)map_data_ + offset, index_offset_ + hot_length_ - offset,
+            MADV_WILLNEED);
+  }
+
+  return true;
 }
 
 /**
- * 查找与汉字代理数组相匹配的词语数据代理.
+ * 打开与汉字代理数组相匹配的词语游标.
+ * @param profile 模糊拼音配置
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组的有效长度
- * @return 词语数据代理链表
+ * @param arena 分配游标的临时内存区(NULL 由堆分配)
+ * @return 词语游标
  */
-std::list<PhraseProxy *> *SystemPhrase::SearchMatchablePhrase(
+PhraseCursor *SystemPhrase::OpenMatchCursor(const FuzzyProfile *profile,
                                             const CharsProxy *chars_proxy,
-                                            int chars_proxy_length) {
-  /* 查询词语 */
-  std::list<std::list<PhraseProxy *> *> multi_phrase_list;
-  for (const int8_t *index_ptr =
-           *(fuzzy_pair_table_ + chars_proxy->major_index_);
-       *index_ptr != -1;
-       ++index_ptr) {
-    std::list<PhraseProxy *> *phrase_list =
-        SearchMatchablePhrase(*index_ptr, chars_proxy, chars_proxy_length);
-    if (phrase_list)
-      multi_phrase_list.push_back(phrase_list);
+                                            int chars_proxy_length,
+                                            PhraseArena *arena) {
+  return new (arena) PhraseCursor(this, profile, chars_proxy,
+                                  chars_proxy_length, arena);
+}
+
+/**
+ * 从分支的扫描进度继续，查找下一个相匹配的词语数据代理.
+ * 同一长度下按频率由高到低扫描，长度则由长到短. \n
+ * 开始扫描某长度时，序号不小于分支所给上限的词语已知不匹配，直接跳过. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param branch 扫描分支
+ * @param phrase_proxy 词语数据代理
+ * @return 是否找到
+ */
+bool SystemPhrase::SearchNextPhrase(const FuzzyProfile *profile,
+                                    const CharsProxy *chars_proxy,
+                                    int chars_proxy_length,
+                                    PhraseCursorBranch *branch,
+                                    PhraseProxy *phrase_proxy) {
+  /* 检查条件是否满足 */
+  if (root_.max_index_ < branch->index_)
+    return false;
+  SystemPhraseIndexNode *index_node = root_.table_ + branch->index_;
+  if (index_node->max_length_ == 0)
+    return false;
+
+  /* 首次扫描 */
+  if (branch->length_ == -1) {
+    branch->length_ = chars_proxy_length <= index_node->max_length_ ?
+                          chars_proxy_length : index_node->max_length_;
+    branch->number_ = branch->LimitNumber(
+        branch->length_,
+        (index_node->table_ + branch->length_ - 1)->phrase_amount_);
   }
-  if (multi_phrase_list.empty())
-    return NULL;
 
-  /* 合并词语 */
-  std::list<PhraseProxy *> *phrase_list = new std::list<PhraseProxy *>;
-  std::list<std::list<PhraseProxy *> *>::iterator previous_iterator;
-  do {
-    /* 查找优先级最高的词语 */
-    std::list<std::list<PhraseProxy *> *>::iterator selected_iterator;
-    PhraseProxy *selected_phrase_proxy = NULL;
-    bool pass(false), priority(false);
-    for (std::list<std::list<PhraseProxy *> *>::iterator iterator =
-             multi_phrase_list.begin();
-         iterator != multi_phrase_list.end();
-         ++iterator) {
-      PhraseProxy *local_phrase_proxy = (*iterator)->front();
-      if (!selected_phrase_proxy ||
-          selected_phrase_proxy->chars_proxy_length_ <
-              local_phrase_proxy->chars_proxy_length_ ||
-          (selected_phrase_proxy->chars_proxy_length_ ==
-              local_phrase_proxy->chars_proxy_length_ &&
-           priority)) {
-        selected_iterator = iterator;
-        selected_phrase_proxy = local_phrase_proxy;
-        priority = false;
-      }
-      if (!pass)
-        pass = priority = previous_iterator == iterator;
-    }
-    /* 加入词语 */
-    phrase_list->push_back(selected_phrase_proxy);
-    (*selected_iterator)->pop_front();
-    if ((*selected_iterator)->empty()) {
-      delete *selected_iterator;
-      selected_iterator = multi_phrase_list.erase(selected_iterator);
-      --selected_iterator;
+  /* 查询数据 */
+  while (branch->length_ >= 1) {
+    int length = branch->length_;
+    SystemPhraseLengthNode *length_node = index_node->table_ + length - 1;
+    if (SearchMatchEntry(profile, chars_proxy,
+                         length_node->chars_proxy_,
+                         AcquireExactIndex(length_node, length),
+                         length_node->phrase_amount_, length,
+                         &branch->number_)) {
+      uint number = branch->number_;
+      phrase_proxy->chars_proxy_ = length_node->chars_proxy_ + length * number;
+      phrase_proxy->chars_proxy_length_ = length;
+      phrase_proxy->phrase_data_offset_ =
+          index_offset_ + length_node->index_offset_ + sizeof(int) * number;
+      phrase_proxy->frequency_ = *(length_node->frequency_ + number);
+      return true;
     }
-    /* 记录本轮被选中的迭代器 */
-    previous_iterator = selected_iterator;
-  } while (!multi_phrase_list.empty());
+    if (--branch->length_ >= 1)
+      branch->number_ = branch->LimitNumber(branch->length_,
+                                            (length_node - 1)->phrase_amount_);
+  }
 
-  return phrase_list;
+  return false;
 }
 
 /**
  * 查找与汉字代理数组最相匹配的词语数据代理.
+ * @param profile 模糊拼音配置
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组的有效长度
  * @return 词语数据代理
  */
-PhraseProxy *SystemPhrase::SearchPreferPhrase(const CharsProxy *chars_proxy,
+PhraseProxy *SystemPhrase::SearchPreferPhrase(const FuzzyProfile *profile,
+                                              const CharsProxy *chars_proxy,
                                               int chars_proxy_length) {
-  /* 查询词语 */
-  std::list<PhraseProxy *> phrase_list;
-  for (const int8_t *index_ptr =
-           *(fuzzy_pair_table_ + chars_proxy->major_index_);
-       *index_ptr != -1;
-       ++index_ptr) {
-    PhraseProxy *phrase_proxy =
-        SearchPreferPhrase(*index_ptr, chars_proxy, chars_proxy_length);
-    if (phrase_proxy)
-      phrase_list.push_back(phrase_proxy);
-  }
-  if (phrase_list.empty())
-    return NULL;
-
-  /* 查找优先级最高的词语 */
-  std::list<PhraseProxy *>::iterator selected_iterator;
+  /* 查询各索引值下的词语，只保留优先级最高者 */
   PhraseProxy *selected_phrase_proxy = NULL;
-  for (std::list<PhraseProxy *>::iterator iterator = phrase_list.begin();
-       iterator != phrase_list.end();
-       ++iterator) {
-    PhraseProxy *local_phrase_proxy = *iterator;
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr) {
+    PhraseProxy *phrase_proxy = SearchPreferPhrase(profile, *index_ptr,
+                                                   chars_proxy,
+                                                   chars_proxy_length);
+    if (!phrase_proxy)
+      continue;
     if (!selected_phrase_proxy ||
         selected_phrase_proxy->chars_proxy_length_ <
-            local_phrase_proxy->chars_proxy_length_) {
-      selected_iterator = iterator;
-      selected_phrase_proxy = local_phrase_proxy;
+            phrase_proxy->chars_proxy_length_ ||
+        (selected_phrase_proxy->chars_proxy_length_ ==
+             phrase_proxy->chars_proxy_length_ &&
+         selected_phrase_proxy->frequency_ < phrase_proxy->frequency_)) {
+      delete selected_phrase_proxy;
+      selected_phrase_proxy = phrase_proxy;
+    } else {
+      delete phrase_proxy;
     }
   }
-  /* 删除词语 */
-  phrase_list.erase(selected_iterator);
-  STL_DELETE_DATA(phrase_list, std::list<PhraseProxy *>);
 
   return selected_phrase_proxy;
 }
 
+/**
+ * 查找以汉字代理数组开头的各长度下的最佳词语数据代理.
+ * 供整句转换一次性取得某一起点的全部候选跨度. 每个长度下按频率保留若干个
+ * 词语，数组中已有的词语只会被频率更高的词语挤出. 本码表没有二元组时，
+ * 其余词语无从胜出，每个长度下只查找频率最高的一个. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param min_length 需要查找的最小长度
+ * @param width 每个长度下最多保留的词语数量
+ * @param span_array 各长度的候选词语(长度n的候选始于下标(n-1)*width，
+ * 按频率降序排列，长度为0表示空位)
+ */
+void SystemPhrase::SearchPreferSpan(const FuzzyProfile *profile,
+                                    const CharsProxy *chars_proxy,
+                                    int chars_proxy_length, int min_length,
+                                    int width, PhraseProxy *span_array) {
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr)
+    SearchPreferSpan(profile, *index_ptr, chars_proxy, chars_proxy_length,
+                     min_length, width, span_array);
+}
+
+/**
+ * 查找两个词语前后相接的量化共现次数.
+ * 词语的编号即其在数据索引部分中的序号；散列表按线性探查查找，
+ * 装载率不超过一半，平均一两次探查即可确定. \n
+ * @param phrase_proxy1 前一词语的数据代理
+ * @param phrase_proxy2 后一词语的数据代理
+ * @return 量化共现次数，没有记录为0
+ */
+uint SystemPhrase::SearchBigramWeight(const PhraseProxy *phrase_proxy1,
+                                      const PhraseProxy *phrase_proxy2) {
+  if (bigram_slots_ == 0)
+    return 0;
+  uint64_t key =
+      (uint64_t)((phrase_proxy1->phrase_data_offset_ - index_offset_) /
+                 sizeof(int)) << 32 |
+      (phrase_proxy2->phrase_data_offset_ - index_offset_) / sizeof(int);
+  /* 探查次数以槽位数为限，损坏或已满的表也不会陷入死循环 */
+  uint slot = SYSTEM_MB_BIGRAM_HASH(key) & (bigram_slots_ - 1);
+  for (uint count = 0; count < bigram_slots_; ++count) {
+    if (*(bigram_key_ + slot) == SYSTEM_MB_BIGRAM_EMPTY)
+      break;
+    if (*(bigram_key_ + slot) == key)
+      return *(bigram_weight_ + slot);
+    slot = (slot + 1) & (bigram_slots_ - 1);
+  }
+  return 0;
+}
+
+/**
+ * 估计查询汉字代理数组所需的代价.
+ * 代价为各(模糊)索引值下可能被扫描的词语数量之和，是实际扫描量的上限. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @return 代价
+ */
+uint SystemPhrase::EstimateSearchCost(const FuzzyProfile *profile,
+                                      const CharsProxy *chars_proxy,
+                                      int chars_proxy_length) {
+  uint cost = 0;
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr) {
+    if (root_.max_index_ < *index_ptr)
+      continue;
+    SystemPhraseIndexNode *index_node = root_.table_ + *index_ptr;
+    int length = chars_proxy_length <= index_node->max_length_ ?
+                     chars_proxy_length : index_node->max_length_;
+    for (; length >= 1; --length)
+      cost += (index_node->table_ + length - 1)->phrase_amount_;
+  }
+  return cost;
+}
+
+/**
+ * 统计与汉字代理数组相匹配的词语数量.
+ * 只统计各长度节点中的匹配项，不给出任何词语数据代理. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @return 词语数量
+ */
+uint SystemPhrase::CountMatchPhrase(const FuzzyProfile *profile,
+                                    const CharsProxy *chars_proxy,
+                                    int chars_proxy_length) {
+  uint amount = 0;
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr) {
+    if (root_.max_index_ < *index_ptr)
+      continue;
+    SystemPhraseIndexNode *index_node = root_.table_ + *index_ptr;
+    int length = chars_proxy_length <= index_node->max_length_ ?
+                     chars_proxy_length : index_node->max_length_;
+    for (; length >= 1; --length) {
+      SystemPhraseLengthNode *length_node = index_node->table_ + length - 1;
+      amount += CountMatchEntry(profile, chars_proxy,
+                                length_node->chars_proxy_, AcquireExactIndex(length_node, length),
+                                length_node->phrase_amount_, length);
+    }
+  }
+  return amount;
+}
+
 /**
  * 解析词语数据代理所表示的词语数据.
+ * 码表文件被映射时，由临时内存区分配的词语数据不再复制，直接引用码表中的
+ * 汉字代理数组及原始数据，在本集合被引用期间有效. \n
  * @param phrase_proxy 词语数据代理
+ * @param arena 分配词语数据的临时内存区(NULL 由堆分配)
  * @return 词语数据
  */
-PhraseDatum *SystemPhrase::AnalyzePhraseProxy(const PhraseProxy *phrase_proxy) {
-  PhraseDatum *phrase_datum = new PhraseDatum;
-  phrase_datum->chars_proxy_ =
-      new CharsProxy[phrase_proxy->chars_proxy_length_];
+PhraseDatum *SystemPhrase::AnalyzePhraseProxy(const PhraseProxy *phrase_proxy,
+                                              PhraseArena *arena) {
+  if (phrase_hits_)
+    ++*(phrase_hits_ + (phrase_proxy->phrase_data_offset_ - index_offset_) /
+                           sizeof(int));
+
+  int offset = 0, raw_data_length = 0;
+  ReadPhraseData(phrase_proxy->phrase_data_offset_, &offset, sizeof(offset));
+  ReadPhraseData(offset, &raw_data_length, sizeof(raw_data_length));
+  size_t data_offset = offset + sizeof(raw_data_length);
+  if (arena && map_data_ && raw_data_length >= 0 &&
+      data_offset <= map_length_ &&
+      (size_t)raw_data_length <= map_length_ - data_offset) {
+    PhraseDatum *phrase_datum = new (arena) PhraseDatum;
+    phrase_datum->chars_proxy_ = (CharsProxy *)phrase_proxy->chars_proxy_;
+    phrase_datum->chars_proxy_length_ = phrase_proxy->chars_proxy_length_;
+    phrase_datum->raw_data_ = (char *)map_data_ + data_offset;
+    phrase_datum->raw_data_length_ = raw_data_length;
+    phrase_datum->phrase_data_offset_ = SystemPhraseType;
+    return phrase_datum;
+  }
+
+  PhraseDatum *phrase_datum = PhraseDatum::Create(
+                                  arena, phrase_proxy->chars_proxy_length_,
+                                  raw_data_length);
   memcpy(phrase_datum->chars_proxy_, phrase_proxy->chars_proxy_,
          sizeof(CharsProxy) * phrase_proxy->chars_proxy_length_);
-  phrase_datum->chars_proxy_length_ = phrase_proxy->chars_proxy_length_;
-  lseek(fd_, phrase_proxy->phrase_data_offset_, SEEK_SET);
-  xread(fd_, &phrase_datum->phrase_data_offset_,
-        sizeof(phrase_datum->phrase_data_offset_));
-  lseek(fd_, phrase_datum->phrase_data_offset_, SEEK_SET);
-  xread(fd_, &phrase_datum->raw_data_length_,
-        sizeof(phrase_datum->raw_data_length_));
-  phrase_datum->raw_data_ = malloc(phrase_datum->raw_data_length_);
-  xread(fd_, phrase_datum->raw_data_, phrase_datum->raw_data_length_);
+  ReadPhraseData(offset + sizeof(raw_data_length), phrase_datum->raw_data_,
+                 raw_data_length);
   phrase_datum->phrase_data_offset_ = SystemPhraseType;
   return phrase_datum;
 }
 
 /**
- * 读取系统码表文件的索引部分，并构建词语树.
+ * 启用词语命中统计.
+ * 此后每次解析词语数据代理都会累计该词语的命中次数. \n
+ */
+void SystemPhrase::EnablePhraseHits() {
+  if (phrase_hits_ || phrase_amount_ == 0)
+    return;
+  phrase_hits_ = new uint[phrase_amount_];
+  memset(phrase_hits_, 0, sizeof(uint) * phrase_amount_);
+}
+
+/**
+ * 启用精确索引.
+ * 词语数量较多的长度节点在首次被查询时建立精确索引，
+ * 此后模糊查询可被改写为直接定位. \n
+ * @param index_pool 建立索引的后台线程池，由各集合共用
+ */
+void SystemPhrase::EnableExactIndex(ThreadPool *index_pool) {
+  index_pool_ = index_pool;
+  exact_index_ = true;
+}
+
+/**
+ * 导出词语命中次数.
+ * 输出格式与词语文件相同: 词语 拼音 命中次数，可直接交给pye-create-mb使用. \n
+ * @param stream 输出流
+ */
+void SystemPhrase::ExportPhraseHits(FILE *stream) {
+  if (!phrase_hits_)
+    return;
+
+  PinyinParser pinyin_parser;
+  for (int8_t index = 0; index <= root_.max_index_; ++index) {
+    SystemPhraseIndexNode *index_node = root_.table_ + index;
+    for (int length = 1; length <= index_node->max_length_; ++length) {
+      SystemPhraseLengthNode *length_node = index_node->table_ + length - 1;
+      for (uint number = 0; number < length_node->phrase_amount_; ++number) {
+        int offset = length_node->index_offset_ + sizeof(int) * number;
+        uint hits = *(phrase_hits_ + offset / sizeof(int));
+        if (hits == 0)
+          continue;
+        /* 读取词语数据 */
+        int data_offset(0), data_length(0);
+        ReadPhraseData(index_offset_ + offset, &data_offset,
+                       sizeof(data_offset));
+        ReadPhraseData(data_offset, &data_length, sizeof(data_length));
+        char *data = (char *)malloc(data_length);
+        ReadPhraseData(data_offset + sizeof(data_length), data, data_length);
+        /* 写出词语命中次数 */
+        char *pinyin = pinyin_parser.UnparsePinyin(
+                           length_node->chars_proxy_ + length * number, length);
+        fwrite(data, 1, data_length, stream);
+        fprintf(stream, " %s %u\n", pinyin, hits);
+        free(pinyin);
+        free(data);
+      }
+    }
+  }
+}
+
+/**
+ * 分析并检查系统码表文件的文件头.
+ * @param data 文件头数据
+ * @param length 数据长度
+ * @return 文件头是否合法
  */
-void SystemPhrase::ReadPhraseTree() {
+bool SystemPhrase::ParsePhraseHeader(const char *data, size_t length) {
+  const char *end = data + length;
+  int magic(0), version(0);
+  if (!TakeIndexValue(&data, end, &magic, sizeof(magic)) ||
+      !TakeIndexValue(&data, end, &version, sizeof(version)) ||
+      magic != SYSTEM_MB_MAGIC || version != SYSTEM_MB_VERSION ||
+      !TakeIndexValue(&data, end, &index_offset_, sizeof(index_offset_)) ||
+      !TakeIndexValue(&data, end, &hot_length_, sizeof(hot_length_)) ||
+      !TakeIndexValue(&data, end, &bigram_offset_, sizeof(bigram_offset_)) ||
+      !TakeIndexValue(&data, end, &bigram_slots_, sizeof(bigram_slots_)))
+    return false;
+  return (size_t)index_offset_ >= HEADER_LENGTH &&
+         (bigram_slots_ == 0 || bigram_offset_ >= index_offset_);
+}
+
+/**
+ * 分析系统码表文件的索引部分，并构建词语树.
+ * 长度节点直接引用索引数据，因此索引数据必须在词语树的生命期内有效. \n
+ * @param data 索引数据
+ * @param length 索引数据的长度
+ * @return 索引数据是否合法
+ */
+bool SystemPhrase::ParsePhraseTree(const char *data, size_t length) {
+  const char *ptr = data, *end = data + length;
   int offset = 0;  // 相对偏移量
 
   /* 构建根节点 */
   SystemPhraseRootNode *root_node = &root_;
-  xread(fd_, &root_node->max_index_, sizeof(root_node->max_index_));
-  root_node->table_ = new SystemPhraseIndexNode[root_node->max_index_ + 1];
+  int8_t max_index = -1;
+  if (!TakeIndexValue(&ptr, end, &max_index, sizeof(max_index)) ||
+      max_index < 0)
+    return false;
+  root_node->table_ = new SystemPhraseIndexNode[max_index + 1];
+  root_node->max_index_ = max_index;
   int8_t index = -1;  // 当前索引值
   do {
-    xread(fd_, &index, sizeof(index));
+    if (!TakeIndexValue(&ptr, end, &index, sizeof(index)) ||
+        index < 0 || index > max_index)
+      return false;
     /* 构建索引节点 */
     SystemPhraseIndexNode *index_node = root_node->table_ + index;
-    xread(fd_, &index_node->max_length_, sizeof(index_node->max_length_));
-    index_node->table_ = new SystemPhraseLengthNode[index_node->max_length_];
+    int max_length = 0;
+    if (!TakeIndexValue(&ptr, end, &max_length, sizeof(max_length)) ||
+        max_length <= 0 || index_node->table_)
+      return false;
+    index_node->table_ = new SystemPhraseLengthNode[max_length];
+    index_node->max_length_ = max_length;
     int length = 0;  // 当前长度
     do {
-      xread(fd_, &length, sizeof(length));
+      if (!TakeIndexValue(&ptr, end, &length, sizeof(length)) ||
+          length <= 0 || length > max_length)
+        return false;
       /* 构建长度节点 */
       SystemPhraseLengthNode *length_node = index_node->table_ + length - 1;
-      xread(fd_, &length_node->phrase_amount_,
-            sizeof(length_node->phrase_amount_));
-      size_t number = length * length_node->phrase_amount_;
-      length_node->chars_proxy_ = new CharsProxy[number];
-      xread(fd_, length_node->chars_proxy_, sizeof(CharsProxy) * number);
+      uint amount = 0;
+      if (!TakeIndexValue(&ptr, end, &amount, sizeof(amount)))
+        return false;
+      size_t size = (sizeof(CharsProxy) * length + sizeof(uint8_t)) * amount;
+      if ((size_t)(end - ptr) < size)
+        return false;
+      length_node->phrase_amount_ = amount;
+      length_node->chars_proxy_ = (const CharsProxy *)ptr;
+      ptr += sizeof(CharsProxy) * length * amount;
+      length_node->frequency_ = (const uint8_t *)ptr;
+      ptr += sizeof(uint8_t) * amount;
       length_node->index_offset_ = offset;
-      offset += sizeof(int) * length_node->phrase_amount_;
+      offset += sizeof(int) * amount;
+      phrase_amount_ += amount;
     } while (length < index_node->max_length_);
   } while (index < root_node->max_index_);
 
-  /* 获取绝对偏移量 */
-  index_offset_ = lseek(fd_, 0, SEEK_CUR);
+  return true;
+}
+
+/**
+ * 分析系统码表文件的二元组部分.
+ * 散列表直接引用二元组数据，因此二元组数据必须在词语树的生命期内有效. \n
+ * @param data 二元组数据
+ * @param length 二元组数据的长度(可多于散列表的长度)
+ * @return 二元组数据是否合法
+ */
+bool SystemPhrase::ParsePhraseBigram(const char *data, size_t length) {
+  if (bigram_slots_ == 0)
+    return true;
+  if ((bigram_slots_ & (bigram_slots_ - 1)) != 0 ||
+      length / (sizeof(uint64_t) + sizeof(uint8_t)) < bigram_slots_)
+    return false;
+  bigram_key_ = (const uint64_t *)data;
+  bigram_weight_ = (const uint8_t *)(data + sizeof(uint64_t) * bigram_slots_);
+  return true;
+}
+
+/**
+ * 清除词语树及其索引数据.
+ */
+void SystemPhrase::ClearPhraseTree() {
+  CancelExactIndexTask();
+  delete [] root_.table_;
+  root_.table_ = NULL;
+  root_.max_index_ = -1;
+  phrase_amount_ = 0;
+  free(index_data_);
+  index_data_ = NULL;
+  free(bigram_data_);
+  bigram_data_ = NULL;
+  bigram_key_ = NULL;
+  bigram_weight_ = NULL;
+  bigram_slots_ = 0;
+  if (map_data_) {
+    munmap(map_data_, map_length_);
+    map_data_ = NULL;
+    map_length_ = 0;
+  }
+}
+
+/**
+ * 读取码表文件中的数据.
+ * @param offset 数据的偏移量
+ * @param buf 缓冲区
+ * @param count 数据长度
+ */
+void SystemPhrase::ReadPhraseData(int offset, void *buf, size_t count) {
+  if (map_data_) {
+    if ((size_t)offset <= map_length_ && count <= map_length_ - offset)
+      memcpy(buf, (const char *)map_data_ + offset, count);
+    else
+      memset(buf, 0, count);
+  } else if (xpread(fd_, buf, count, offset) != (ssize_t)count) {
+    memset(buf, 0, count);
+  }
 }
 
 /**
- * 查找位于本索引值下与汉字代理数组相匹配的词语数据代理.
+ * 查找位于本索引值下与汉字代理数组最相匹配的词语数据代理.
+ * @param profile 模糊拼音配置
  * @param chars_proxy_index 索引值
  * @param chars_proxy 汉字代理数组
- * @param chars_proxy_length 汉字代理数组的有效长度
- * @return 词语数据代理链表
+ * @param chars_proxy_length 汉字代理数组有效长度
+ * @return 词语数据代理
  */
-std::list<PhraseProxy *> *SystemPhrase::SearchMatchablePhrase(
-                                            int8_t chars_proxy_index,
-                                            const CharsProxy *chars_proxy,
-                                            int chars_proxy_length) {
+PhraseProxy *SystemPhrase::SearchPreferPhrase(const FuzzyProfile *profile,
+                                              int8_t chars_proxy_index,
+                                              const CharsProxy *chars_proxy,
+                                              int chars_proxy_length) {
   /* 检查条件是否满足 */
   if (root_.max_index_ < chars_proxy_index)
     return NULL;
@@ -242,80 +681,129 @@ std::list<PhraseProxy *> *SystemPhrase::SearchMatchablePhrase(
     return NULL;
 
   /* 查询数据 */
-  std::list<PhraseProxy *> *phrase_list = new std::list<PhraseProxy *>;
+  PhraseProxy *phrase_proxy = NULL;
   int length = chars_proxy_length <= index_node->max_length_ ?
                    chars_proxy_length : index_node->max_length_;
   for (; length >= 1; --length) {
     SystemPhraseLengthNode *length_node = index_node->table_ + length - 1;
     uint number = length_node->phrase_amount_;
-    while (number >= 1) {
-      --number;
-      if (CharsProxyCmp(fuzzy_pair_table_,
-                        chars_proxy,
-                        length_node->chars_proxy_ + length * number,
-                        length)) {
-        PhraseProxy *phrase_proxy = new PhraseProxy;
-        phrase_list->push_back(phrase_proxy);
-        phrase_proxy->chars_proxy_ =
-            length_node->chars_proxy_ + length * number;
-        phrase_proxy->chars_proxy_length_ = length;
-        phrase_proxy->phrase_data_offset_ =
-            index_offset_ + length_node->index_offset_ + sizeof(int) * number;
-      }
+    if (SearchMatchEntry(profile, chars_proxy,
+                         length_node->chars_proxy_,
+                         AcquireExactIndex(length_node, length),
+                         length_node->phrase_amount_, length, &number)) {
+      phrase_proxy = new PhraseProxy;
+      phrase_proxy->chars_proxy_ = length_node->chars_proxy_ + length * number;
+      phrase_proxy->chars_proxy_length_ = length;
+      phrase_proxy->phrase_data_offset_ =
+          index_offset_ + length_node->index_offset_ + sizeof(int) * number;
+      phrase_proxy->frequency_ = *(length_node->frequency_ + number);
+      break;
     }
   }
 
-  /* 检查返回值 */
-  if (phrase_list->empty()) {
-    delete phrase_list;
-    phrase_list = NULL;
-  }
-
-  return phrase_list;
+  return phrase_proxy;
 }
 
 /**
- * 查找位于本索引值下与汉字代理数组最相匹配的词语数据代理.
+ * 查找位于本索引值下以汉字代理数组开头的各长度下的最佳词语数据代理.
+ * @param profile 模糊拼音配置
  * @param chars_proxy_index 索引值
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组有效长度
- * @return 词语数据代理
+ * @param min_length 需要查找的最小长度
+ * @param width 每个长度下最多保留的词语数量
+ * @param span_array 各长度的候选词语
  */
-PhraseProxy *SystemPhrase::SearchPreferPhrase(int8_t chars_proxy_index,
-                                              const CharsProxy *chars_proxy,
-                                              int chars_proxy_length) {
+void SystemPhrase::SearchPreferSpan(const FuzzyProfile *profile,
+                                    int8_t chars_proxy_index,
+                                    const CharsProxy *chars_proxy,
+                                    int chars_proxy_length, int min_length,
+                                    int width, PhraseProxy *span_array) {
   /* 检查条件是否满足 */
   if (root_.max_index_ < chars_proxy_index)
-    return NULL;
+    return;
   SystemPhraseIndexNode *index_node = root_.table_ + chars_proxy_index;
   if (index_node->max_length_ == 0)
-    return NULL;
+    return;
 
-  /* 查询数据 */
-  PhraseProxy *phrase_proxy = NULL;
+  /* 查询数据，同一长度下由高频到低频接着扫描 */
+  int amount = bigram_slots_ != 0 ? width : 1;
   int length = chars_proxy_length <= index_node->max_length_ ?
                    chars_proxy_length : index_node->max_length_;
-  for (; length >= 1; --length) {
+  for (; length >= min_length; --length) {
     SystemPhraseLengthNode *length_node = index_node->table_ + length - 1;
+    const uint *exact_index = AcquireExactIndex(length_node, length);
     uint number = length_node->phrase_amount_;
-    while (number >= 1) {
-      --number;
-      if (CharsProxyCmp(fuzzy_pair_table_,
-                        chars_proxy,
-                        length_node->chars_proxy_ + length * number,
-                        length)) {
-        phrase_proxy = new PhraseProxy;
-        phrase_proxy->chars_proxy_ =
-            length_node->chars_proxy_ + length * number;
-        phrase_proxy->chars_proxy_length_ = length;
-        phrase_proxy->phrase_data_offset_ =
-            index_offset_ + length_node->index_offset_ + sizeof(int) * number;
+    for (int count = 0; count < amount; ++count) {
+      if (!SearchMatchEntry(profile, chars_proxy, length_node->chars_proxy_,
+                            exact_index, length_node->phrase_amount_, length,
+                            &number))
+        break;
+      PhraseProxy phrase_proxy;
+      phrase_proxy.chars_proxy_ = length_node->chars_proxy_ + length * number;
+      phrase_proxy.chars_proxy_length_ = length;
+      phrase_proxy.phrase_data_offset_ =
+          index_offset_ + length_node->index_offset_ + sizeof(int) * number;
+      phrase_proxy.frequency_ = *(length_node->frequency_ + number);
+      if (!InsertPreferSpan(span_array + (length - 1) * width, amount,
+                            &phrase_proxy))
         break;
-      }
     }
-    if (phrase_proxy)
-      break;
   }
+}
 
-  return phrase_proxy;
+/**
+ * 获取长度节点的精确索引.
+ * 索引尚未建立时交给后台线程建立，本次查询则退回扫描(结果完全相同)，
+ * 因此查询者不会因首次建立索引而被阻塞. \n
+ * @param length_node 长度节点
+ * @param length 长度
+ * @return 精确索引，未启用、节点词语较少或尚未建立时为NULL
+ */
+const uint *SystemPhrase::AcquireExactIndex(
+                              SystemPhraseLengthNode *length_node,
+                              int length) {
+  if (!exact_index_ || length_node->phrase_amount_ < EXACT_INDEX_AMOUNT)
+    return NULL;
+  uint *exact_index =
+      __atomic_load_n(&length_node->exact_index_, __ATOMIC_ACQUIRE);
+  if (exact_index)
+    return exact_index;
+
+  /* 每个节点只提交一次建立任务 */
+  if (__sync_bool_compare_and_swap(&length_node->index_building_, 0, 1)) {
+    ExactIndexTask *task = new ExactIndexTask;
+    task->length_node_ = length_node;
+    task->length_ = length;
+    pthread_mutex_lock(&index_mutex_);
+    index_task_list_.push_back(task);
+    index_pool_->PushTask(task, &index_pending_);
+    pthread_mutex_unlock(&index_mutex_);
+  }
+  return NULL;
+}
+
+/**
+ * 撤销尚未执行的索引任务，等待正在执行的完成，并释放它们.
+ * 线程池由各集合共用，此处只涉及本集合提交的任务. \n
+ */
+void SystemPhrase::CancelExactIndexTask() {
+  pthread_mutex_lock(&index_mutex_);
+  if (index_pool_)
+    index_pool_->CancelTask(&index_pending_);
+  STL_DELETE_DATA(index_task_list_, std::list<ThreadTask *>);
+  index_task_list_.clear();
+  pthread_mutex_unlock(&index_mutex_);
+}
+
+/**
+ * 建立长度节点的精确索引，并发布给查询者.
+ * @param length_node 长度节点
+ * @param length 长度
+ */
+void SystemPhrase::SetupExactIndex(SystemPhraseLengthNode *length_node,
+                                   int length) {
+  uint *exact_index = BuildExactIndex(length_node->chars_proxy_,
+                                      length_node->phrase_amount_, length);
+  __atomic_store_n(&length_node->exact_index_, exact_index, __ATOMIC_RELEASE);
 }
@@ -12,22 +12,32 @@
 #ifndef PYE_ENGINE_SYSTEM_PHRASE_H_
 #define PYE_ENGINE_SYSTEM_PHRASE_H_
 
+#include <pthread.h>
+#include <stdio.h>
 #include "abstract_phrase.h"
 
+class ThreadTask;
+
 /**
  * 词语树长度节点.
+ * 汉字代理数组及量化频率数组都直接指向索引数据(读入的缓冲区或映射的文件)，
+ * 本节点并不拥有它们；精确索引则由本节点拥有，并在后台建立. \n
  */
 class SystemPhraseLengthNode {
  public:
   SystemPhraseLengthNode()
-      : phrase_amount_(0), index_offset_(0), chars_proxy_(NULL) {}
+      : phrase_amount_(0), index_offset_(0), chars_proxy_(NULL),
+        frequency_(NULL), exact_index_(NULL), index_building_(0) {}
   ~SystemPhraseLengthNode() {
-    delete [] chars_proxy_;
+    delete [] exact_index_;
   }
 
   uint phrase_amount_;  ///< 词语总数
   int index_offset_;  ///< 相对偏移量
-  CharsProxy *chars_proxy_;  ///< 汉字代理数组
+  const CharsProxy *chars_proxy_;  ///< 汉字代理数组
+  const uint8_t *frequency_;  ///< 量化频率数组
+  uint *exact_index_;  ///< 精确索引(尚未建立为NULL) *
+  int index_building_;  ///< 精确索引是否已交给后台建立
 };
 
 /**
@@ -66,27 +76,77 @@ class SystemPhrase : public AbstractPhrase {
   SystemPhrase();
   virtual ~SystemPhrase();
 
-  virtual void BuildPhraseTree(const char *mbfile);
-  virtual void SetFuzzyPinyinTable(const int8_t **fuzzy_pair_table);
-  virtual std::list<PhraseProxy *> *SearchMatchablePhrase(
+  virtual bool BuildPhraseTree(const char *mbfile);
+  bool MapPhraseTree(const char *mbfile);
+  virtual PhraseCursor *OpenMatchCursor(const FuzzyProfile *profile,
                                         const CharsProxy *chars_proxy,
-                                        int chars_proxy_length);
-  virtual PhraseProxy *SearchPreferPhrase(const CharsProxy *chars_proxy,
+                                        int chars_proxy_length,
+                                        PhraseArena *arena);
+  virtual bool SearchNextPhrase(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length,
+                                PhraseCursorBranch *branch,
+                                PhraseProxy *phrase_proxy);
+  virtual PhraseProxy *SearchPreferPhrase(const FuzzyProfile *profile,
+                                          const CharsProxy *chars_proxy,
                                           int chars_proxy_length);
-  virtual PhraseDatum *AnalyzePhraseProxy(const PhraseProxy *phrase_proxy);
+  virtual void SearchPreferSpan(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length, int min_length,
+                                int width, PhraseProxy *span_array);
+  virtual uint SearchBigramWeight(const PhraseProxy *phrase_proxy1,
+                                  const PhraseProxy *phrase_proxy2);
+  virtual uint EstimateSearchCost(const FuzzyProfile *profile,
+                                  const CharsProxy *chars_proxy,
+                                  int chars_proxy_length);
+  virtual uint CountMatchPhrase(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length);
+  virtual PhraseDatum *AnalyzePhraseProxy(const PhraseProxy *phrase_proxy,
+                                          PhraseArena *arena);
+
+  void EnablePhraseHits();
+  void ExportPhraseHits(FILE *stream);
+  void EnableExactIndex(ThreadPool *index_pool);
 
  private:
-  void ReadPhraseTree();
-  std::list<PhraseProxy *> *SearchMatchablePhrase(int8_t chars_proxy_index,
-                                                  const CharsProxy *chars_proxy,
-                                                  int chars_proxy_length);
-  PhraseProxy *SearchPreferPhrase(int8_t chars_proxy_index,
+  friend class ExactIndexTask;
+
+  bool ParsePhraseHeader(const char *data, size_t length);
+  bool ParsePhraseTree(const char *data, size_t length);
+  bool ParsePhraseBigram(const char *data, size_t length);
+  void ClearPhraseTree();
+  void ReadPhraseData(int offset, void *buf, size_t count);
+  PhraseProxy *SearchPreferPhrase(const FuzzyProfile *profile,
+                                  int8_t chars_proxy_index,
                                   const CharsProxy *chars_proxy,
                                   int chars_proxy_length);
+  void SearchPreferSpan(const FuzzyProfile *profile, int8_t chars_proxy_index,
+                        const CharsProxy *chars_proxy, int chars_proxy_length,
+                        int min_length, int width, PhraseProxy *span_array);
+  const uint *AcquireExactIndex(SystemPhraseLengthNode *length_node,
+                                int length);
+  void CancelExactIndexTask();
+  static void SetupExactIndex(SystemPhraseLengthNode *length_node, int length);
 
-  const int8_t **fuzzy_pair_table_;  ///< 模模糊拼音单元对照表
   SystemPhraseRootNode root_;  ///< 词语树的根索引点
   int index_offset_;  ///< 绝对偏移量
+  int hot_length_;  ///< 热区长度
+  int bigram_offset_;  ///< 二元组部分的偏移量
+  uint bigram_slots_;  ///< 二元组散列表的槽位数(0 没有二元组)
+  const uint64_t *bigram_key_;  ///< 二元组散列表的键值数组
+  const uint8_t *bigram_weight_;  ///< 二元组散列表的量化次数数组
+  uint phrase_amount_;  ///< 词语总数
+  uint *phrase_hits_;  ///< 词语命中次数数组
+  bool exact_index_;  ///< 是否使用精确索引
+  ThreadPool *index_pool_;  ///< 建立精确索引的后台线程池(由词语管理者拥有)
+  int index_pending_;  ///< 尚未完成的索引任务数量(由线程池锁保护)
+  std::list<ThreadTask *> index_task_list_;  ///< 已提交的索引任务 *
+  pthread_mutex_t index_mutex_;  ///< 索引任务锁
+  char *index_data_;  ///< 读入的索引数据
+  char *bigram_data_;  ///< 读入的二元组数据
+  void *map_data_;  ///< 映射的码表文件
+  size_t map_length_;  ///< 映射的码表文件的长度
   int fd_;  ///< 词语数据文件描述符
 };
 
@@ -0,0 +1,255 @@
+//
+// C++ Implementation: thread_pool
+//
+// Description:
+// 请参见头文件描述.
+//
+// Author: Jally <jallyx@163.com>, (C) 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#include "thread_pool.h"
+#include <string.h>
+#include <unistd.h>
+#include "pye_output.h"
+
+/**
+ * 类构造函数.
+ * @param max_thread 工作线程数量上限
+ */
+ThreadPool::ThreadPool(int max_thread)
+    : max_thread_(max_thread > 0 ? max_thread : 1), idle_thread_(0),
+      running_task_(0), quit_(false) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&task_cond_, NULL);
+  pthread_cond_init(&finish_cond_, NULL);
+}
+
+/**
+ * 类析构函数.
+ * 尚未执行的任务会先被执行完毕. \n
+ */
+ThreadPool::~ThreadPool() {
+  WaitTask();
+
+  /* 通知并回收工作线程 */
+  pthread_mutex_lock(&mutex_);
+  quit_ = true;
+  pthread_cond_broadcast(&task_cond_);
+  pthread_mutex_unlock(&mutex_);
+  for (std::list<pthread_t>::iterator iterator = thread_list_.begin();
+       iterator != thread_list_.end();
+       ++iterator)
+    pthread_join(*iterator, NULL);
+
+  pthread_mutex_destroy(&mutex_);
+  pthread_cond_destroy(&task_cond_);
+  pthread_cond_destroy(&finish_cond_);
+}
+
+/**
+ * 提交任务.
+ * 若空闲线程不足且未达上限，则创建新的工作线程. \n
+ * @param task 任务
+ */
+void ThreadPool::PushTask(ThreadTask *task) {
+  pthread_mutex_lock(&mutex_);
+  task_list_.push_back(task);
+  if (task_list_.size() > (size_t)idle_thread_ &&
+      thread_list_.size() < (size_t)max_thread_) {
+    pthread_t thread;
+    int error = pthread_create(&thread, NULL, WorkThread, this);
+    if (error == 0) {
+      thread_list_.push_back(thread);
+    } else {
+      pwarning("Create work thread failed, %s", strerror(error));
+      /* 没有任何工作线程可用，只好就地执行 */
+      if (thread_list_.empty()) {
+        task_list_.pop_back();
+        ++running_task_;
+        pthread_mutex_unlock(&mutex_);
+        task->Run();
+        pthread_mutex_lock(&mutex_);
+        FinishTask(task);
+        pthread_mutex_unlock(&mutex_);
+        return;
+      }
+    }
+  }
+  pthread_cond_signal(&task_cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 提交属于某批次的任务.
+ * 同一线程池可由多个提交者共用，各提交者以自己的批次计数区分各自的任务. \n
+ * @param task 任务
+ * @param pending 批次尚未完成的任务数量，由线程池锁保护
+ */
+void ThreadPool::PushTask(ThreadTask *task, int *pending) {
+  pthread_mutex_lock(&mutex_);
+  ++*pending;
+  task->pending_ = pending;
+  pthread_mutex_unlock(&mutex_);
+  PushTask(task);
+}
+
+/**
+ * 撤销某批次尚未执行的任务，并等待其正在执行的任务完成.
+ * 返回后线程池不再访问本批次的任何任务. \n
+ * @param pending 批次尚未完成的任务数量
+ */
+void ThreadPool::CancelTask(int *pending) {
+  pthread_mutex_lock(&mutex_);
+  std::list<ThreadTask *>::iterator iterator = task_list_.begin();
+  while (iterator != task_list_.end()) {
+    if ((*iterator)->pending_ == pending) {
+      (*iterator)->pending_ = NULL;
+      --*pending;
+      iterator = task_list_.erase(iterator);
+    } else {
+      ++iterator;
+    }
+  }
+  if (task_list_.empty() && running_task_ == 0)
+    pthread_cond_broadcast(&finish_cond_);
+  while (*pending != 0)
+    pthread_cond_wait(&finish_cond_, &mutex_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 等待已提交的所有任务执行完毕.
+ */
+void ThreadPool::WaitTask() {
+  pthread_mutex_lock(&mutex_);
+  while (!task_list_.empty() || running_task_ != 0)
+    pthread_cond_wait(&finish_cond_, &mutex_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 执行一批任务并等待它们全部完成.
+ * 第一个任务在调用线程中执行，其余任务交给工作线程；等待期间，
+ * 调用线程还会执行本批中尚未被工作线程取走的任务，
+ * 因此即使工作线程全忙(或在工作线程中调用本函数)也不会长时间等待. \n
+ * @param tasks 任务数组
+ * @param amount 任务数量
+ */
+void ThreadPool::RunTasks(ThreadTask *const *tasks, int amount) {
+  if (amount <= 0)
+    return;
+
+  /* 其余任务交给工作线程 */
+  int pending = amount - 1;
+  for (int count = 1; count < amount; ++count) {
+    (*(tasks + count))->pending_ = &pending;
+    PushTask(*(tasks + count));
+  }
+
+  /* 第一个任务就地执行 */
+  (*tasks)->Run();
+
+  /* 等待本批任务完成 */
+  pthread_mutex_lock(&mutex_);
+  while (pending != 0) {
+    ThreadTask *task = TakeBatchTask(&pending);
+    if (!task) {
+      pthread_cond_wait(&finish_cond_, &mutex_);
+      continue;
+    }
+    ++running_task_;
+    pthread_mutex_unlock(&mutex_);
+    task->Run();
+    pthread_mutex_lock(&mutex_);
+    FinishTask(task);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+/**
+ * 获取工作线程数量上限.
+ * @return 线程数量
+ */
+int ThreadPool::GetMaxThread() const {
+  return max_thread_;
+}
+
+/**
+ * 获取在线处理器的数量.
+ * @return 处理器数量
+ */
+int ThreadPool::GetProcessorAmount() {
+  long amount = sysconf(_SC_NPROCESSORS_ONLN);
+  return amount > 0 ? amount : 1;
+}
+
+/**
+ * 从等待链表中取出属于某批次的任务.
+ * @note 调用者必须持有线程池锁.
+ * @param pending 批次
+ * @return 任务，没有则返回NULL
+ */
+ThreadTask *ThreadPool::TakeBatchTask(const int *pending) {
+  for (std::list<ThreadTask *>::iterator iterator = task_list_.begin();
+       iterator != task_list_.end();
+       ++iterator) {
+    ThreadTask *task = *iterator;
+    if (task->pending_ == pending) {
+      task_list_.erase(iterator);
+      return task;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * 记录任务已执行完毕，并唤醒等待者.
+ * 任务所属的批次在计数归零后可能立即失效，因此此后不能再访问任务对象. \n
+ * @note 调用者必须持有线程池锁.
+ * @param task 任务
+ */
+void ThreadPool::FinishTask(ThreadTask *task) {
+  --running_task_;
+  bool batch = task->pending_ != NULL;
+  if (batch) {
+    int *pending = task->pending_;
+    task->pending_ = NULL;
+    --*pending;
+  }
+  if (batch || (task_list_.empty() && running_task_ == 0))
+    pthread_cond_broadcast(&finish_cond_);
+}
+
+/**
+ * 工作线程.
+ * @param arg 线程池
+ * @return NULL
+ */
+void *ThreadPool::WorkThread(void *arg) {
+  ThreadPool *pool = (ThreadPool *)arg;
+
+  pthread_mutex_lock(&pool->mutex_);
+  while (true) {
+    /* 等待任务 */
+    ++pool->idle_thread_;
+    while (pool->task_list_.empty() && !pool->quit_)
+      pthread_cond_wait(&pool->task_cond_, &pool->mutex_);
+    --pool->idle_thread_;
+    if (pool->task_list_.empty())
+      break;
+
+    /* 执行任务 */
+    ThreadTask *task = pool->task_list_.front();
+    pool->task_list_.pop_front();
+    ++pool->running_task_;
+    pthread_mutex_unlock(&pool->mutex_);
+    task->Run();
+    pthread_mutex_lock(&pool->mutex_);
+    pool->FinishTask(task);
+  }
+  pthread_mutex_unlock(&pool->mutex_);
+
+  return NULL;
+}
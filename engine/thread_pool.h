@@ -0,0 +1,70 @@
+//
+// C++ Interface: thread_pool
+//
+// Description:
+// 线程池，以有限数量的工作线程执行任务.
+// 工作线程在有任务时按需创建，数量不超过池的上限.
+//
+// Author: Jally <jallyx@163.com>, (C) 2010
+//
+// Copyright: See COPYING file that comes with this distribution
+//
+//
+#ifndef PYE_ENGINE_THREAD_POOL_H_
+#define PYE_ENGINE_THREAD_POOL_H_
+
+#include <pthread.h>
+#include <list>
+
+/**
+ * 线程任务.
+ * 任务对象由提交者拥有，线程池只负责执行. \n
+ */
+class ThreadTask {
+ public:
+  ThreadTask() : pending_(NULL) {}
+  virtual ~ThreadTask() {}
+
+  virtual void Run() = 0;
+
+ private:
+  friend class ThreadPool;
+
+  int *pending_;  ///< 所属批次尚未完成的任务数量(不属于任何批次为NULL)
+};
+
+/**
+ * 线程池.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int max_thread);
+  ~ThreadPool();
+
+  void PushTask(ThreadTask *task);
+  void PushTask(ThreadTask *task, int *pending);
+  void WaitTask();
+  void CancelTask(int *pending);
+  void RunTasks(ThreadTask *const *tasks, int amount);
+  int GetMaxThread() const;
+
+  static int GetProcessorAmount();
+
+ private:
+  ThreadTask *TakeBatchTask(const int *pending);
+  void FinishTask(ThreadTask *task);
+  static void *WorkThread(void *arg);
+
+  std::list<ThreadTask *> task_list_;  ///< 等待执行的任务链表
+  std::list<pthread_t> thread_list_;  ///< 工作线程链表
+  int max_thread_;  ///< 工作线程数量上限
+  int idle_thread_;  ///< 空闲的工作线程数量
+  int running_task_;  ///< 正在执行的任务数量
+  bool quit_;  ///< 工作线程是否应该退出
+
+  pthread_mutex_t mutex_;  ///< 线程池锁
+  pthread_cond_t task_cond_;  ///< 有新任务或需要退出
+  pthread_cond_t finish_cond_;  ///< 所有任务都已完成
+};
+
+#endif  // PYE_ENGINE_THREAD_POOL_H_
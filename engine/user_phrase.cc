@@ -21,7 +21,7 @@
 /**
  * 类构造函数.
  */
-UserPhrase::UserPhrase() : fuzzy_pair_table_(NULL), index_offset_(0), fd_(-1) {
+UserPhrase::UserPhrase() : index_offset_(0), fd_(-1) {
 }
 
 /**
@@ -34,8 +34,9 @@ UserPhrase::~UserPhrase() {
 /**
  * 构建词语树.
  * @param mbfile 用户码表文件
+ * @return 是否成功
  */
-void UserPhrase::BuildPhraseTree(const char *mbfile) {
+bool UserPhrase::BuildPhraseTree(const char *mbfile) {
   /* 打开码表文件 */
   if (access(mbfile, F_OK) == 0) {
     if ((fd_ = open(mbfile, O_RDWR)) == -1)
@@ -48,150 +49,224 @@ void UserPhrase::BuildPhraseTree(const char *mbfile) {
 
   /* 读取词语树 */
   ReadPhraseTree();
+
+  return true;
 }
 
 /**
- * 设置模糊拼音单元部件对照表.
- * @param fuzzy_pair_table 对照表
- * @note 在查询词语之前必须调用本函数.
+ * 打开与汉字代理数组相匹配的词语游标.
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param arena 分配游标的临时内存区(NULL 由堆分配)
+ * @return 词语游标
  */
-void UserPhrase::SetFuzzyPinyinTable(const int8_t **fuzzy_pair_table) {
-  fuzzy_pair_table_ = fuzzy_pair_table;
+PhraseCursor *UserPhrase::OpenMatchCursor(const FuzzyProfile *profile,
+                                          const CharsProxy *chars_proxy,
+                                          int chars_proxy_length,
+                                          PhraseArena *arena) {
+  return new (arena) PhraseCursor(this, profile, chars_proxy,
+                                  chars_proxy_length, arena);
 }
 
 /**
- * 查找与汉字代理数组相匹配的词语数据代理.
+ * 从分支的扫描进度继续，查找下一个相匹配的词语数据代理.
+ * 用户词语树在游标的生命期内可能被修改，因此每次都需重新校正扫描进度；
+ * 同理，分支所给的各长度的上限(由此前的查询得出)也不被采用. \n
+ * @param profile 模糊拼音配置
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组的有效长度
- * @return 词语数据代理链表
+ * @param branch 扫描分支
+ * @param phrase_proxy 词语数据代理
+ * @return 是否找到
  */
-std::list<PhraseProxy *> *UserPhrase::SearchMatchablePhrase(
-                                          const CharsProxy *chars_proxy,
-                                          int chars_proxy_length) {
-  /* 查询词语 */
-  std::list<std::list<PhraseProxy *> *> multi_phrase_list;
-  for (const int8_t *index_ptr =
-           *(fuzzy_pair_table_ + chars_proxy->major_index_);
-       *index_ptr != -1;
-       ++index_ptr) {
-    std::list<PhraseProxy *> *phrase_list =
-        SearchMatchablePhrase(*index_ptr, chars_proxy, chars_proxy_length);
-    if (phrase_list)
-      multi_phrase_list.push_back(phrase_list);
+bool UserPhrase::SearchNextPhrase(const FuzzyProfile *profile,
+                                  const CharsProxy *chars_proxy,
+                                  int chars_proxy_length,
+                                  PhraseCursorBranch *branch,
+                                  PhraseProxy *phrase_proxy) {
+  /* 检查条件是否满足 */
+  if (root_.max_index_ < branch->index_)
+    return false;
+  UserPhraseIndexNode *index_node = root_.table_ + branch->index_;
+  if (index_node->max_length_ == 0)
+    return false;
+
+  /* 首次扫描 */
+  if (branch->length_ == -1) {
+    branch->length_ = chars_proxy_length <= index_node->max_length_ ?
+                          chars_proxy_length : index_node->max_length_;
+    branch->number_ =
+        (index_node->table_ + branch->length_ - 1)->phrase_amount_;
   }
-  if (multi_phrase_list.empty())
-    return NULL;
+  if (branch->length_ > index_node->max_length_)
+    branch->length_ = index_node->max_length_;
 
-  /* 合并词语 */
-  std::list<PhraseProxy *> *phrase_list = new std::list<PhraseProxy *>;
-  std::list<std::list<PhraseProxy *> *>::iterator previous_iterator;
-  do {
-    /* 查找优先级最高的词语 */
-    std::list<std::list<PhraseProxy *> *>::iterator selected_iterator;
-    PhraseProxy *selected_phrase_proxy = NULL;
-    bool pass(false), priority(false);
-    for (std::list<std::list<PhraseProxy *> *>::iterator iterator =
-             multi_phrase_list.begin();
-         iterator != multi_phrase_list.end();
-         ++iterator) {
-      PhraseProxy *local_phrase_proxy = (*iterator)->front();
-      if (!selected_phrase_proxy ||
-          selected_phrase_proxy->chars_proxy_length_ <
-              local_phrase_proxy->chars_proxy_length_ ||
-          (selected_phrase_proxy->chars_proxy_length_ ==
-               local_phrase_proxy->chars_proxy_length_ &&
-           (selected_phrase_proxy->frequency_ <
-                local_phrase_proxy->frequency_ ||
-            (selected_phrase_proxy->frequency_ ==
-                 local_phrase_proxy->frequency_ &&
-             priority)))) {
-        selected_iterator = iterator;
-        selected_phrase_proxy = local_phrase_proxy;
-        priority = false;
-      }
-      if (!pass)
-        pass = priority = previous_iterator == iterator;
-    }
-    /* 加入词语 */
-    phrase_list->push_back(selected_phrase_proxy);
-    (*selected_iterator)->pop_front();
-    if ((*selected_iterator)->empty()) {
-      delete *selected_iterator;
-      selected_iterator = multi_phrase_list.erase(selected_iterator);
-      --selected_iterator;
+  /* 查询数据 */
+  while (branch->length_ >= 1) {
+    int length = branch->length_;
+    UserPhraseLengthNode *length_node = index_node->table_ + length - 1;
+    if (branch->number_ > length_node->phrase_amount_)
+      branch->number_ = length_node->phrase_amount_;
+    if (SearchMatchEntry(profile, chars_proxy,
+                         length_node->chars_proxy_, length,
+                         &branch->number_)) {
+      uint number = branch->number_;
+      phrase_proxy->chars_proxy_ = length_node->chars_proxy_ + length * number;
+      phrase_proxy->chars_proxy_length_ = length;
+      UserPhraseAttribute *attribute = length_node->phrase_attribute_ + number;
+      phrase_proxy->phrase_data_offset_ = attribute->datum_offset_;
+      phrase_proxy->frequency_ = attribute->frequency_;
+      return true;
     }
-    /* 记录本轮被选中的迭代器 */
-    previous_iterator = selected_iterator;
-  } while (!multi_phrase_list.empty());
+    if (--branch->length_ >= 1)
+      branch->number_ = (length_node - 1)->phrase_amount_;
+  }
 
-  return phrase_list;
+  return false;
 }
 
 /**
  * 查找与汉字代理数组最相匹配的词语数据代理.
+ * @param profile 模糊拼音配置
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组的有效长度
  * @return 词语数据代理
  */
-PhraseProxy *UserPhrase::SearchPreferPhrase(const CharsProxy *chars_proxy,
+PhraseProxy *UserPhrase::SearchPreferPhrase(const FuzzyProfile *profile,
+                                            const CharsProxy *chars_proxy,
                                             int chars_proxy_length) {
-  /* 查询词语 */
-  std::list<PhraseProxy *> phrase_list;
-  for (const int8_t *index_ptr =
-           *(fuzzy_pair_table_ + chars_proxy->major_index_);
-       *index_ptr != -1;
-       ++index_ptr) {
-    PhraseProxy *phrase_proxy =
-        SearchPreferPhrase(*index_ptr, chars_proxy, chars_proxy_length);
-    if (phrase_proxy)
-      phrase_list.push_back(phrase_proxy);
-  }
-  if (phrase_list.empty())
-    return NULL;
-
-  /* 查找优先级最高的词语 */
-  std::list<PhraseProxy *>::iterator selected_iterator;
+  /* 查询各索引值下的词语，只保留优先级最高者 */
   PhraseProxy *selected_phrase_proxy = NULL;
-  for (std::list<PhraseProxy *>::iterator iterator = phrase_list.begin();
-       iterator != phrase_list.end();
-       ++iterator) {
-    PhraseProxy *local_phrase_proxy = *iterator;
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr) {
+    PhraseProxy *phrase_proxy = SearchPreferPhrase(profile, *index_ptr,
+                                                   chars_proxy,
+                                                   chars_proxy_length);
+    if (!phrase_proxy)
+      continue;
     if (!selected_phrase_proxy ||
         selected_phrase_proxy->chars_proxy_length_ <
-            local_phrase_proxy->chars_proxy_length_ ||
+            phrase_proxy->chars_proxy_length_ ||
         (selected_phrase_proxy->chars_proxy_length_ ==
-             local_phrase_proxy->chars_proxy_length_ &&
-         selected_phrase_proxy->frequency_ <
-             local_phrase_proxy->frequency_)) {
-      selected_iterator = iterator;
-      selected_phrase_proxy = local_phrase_proxy;
+             phrase_proxy->chars_proxy_length_ &&
+         selected_phrase_proxy->frequency_ < phrase_proxy->frequency_)) {
+      delete selected_phrase_proxy;
+      selected_phrase_proxy = phrase_proxy;
+    } else {
+      delete phrase_proxy;
     }
   }
-  /* 删除词语 */
-  phrase_list.erase(selected_iterator);
-  STL_DELETE_DATA(phrase_list, std::list<PhraseProxy *>);
 
   return selected_phrase_proxy;
 }
 
+/**
+ * 查找以汉字代理数组开头的各长度下的最佳词语数据代理.
+ * 用户码表没有二元组，每个长度下只查找频率最高的一个. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @param min_length 需要查找的最小长度
+ * @param width 每个长度下最多保留的词语数量
+ * @param span_array 各长度的候选词语(长度n的候选始于下标(n-1)*width)
+ */
+void UserPhrase::SearchPreferSpan(const FuzzyProfile *profile,
+                                  const CharsProxy *chars_proxy,
+                                  int chars_proxy_length, int min_length,
+                                  int width, PhraseProxy *span_array) {
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr)
+    SearchPreferSpan(profile, *index_ptr, chars_proxy, chars_proxy_length,
+                     min_length, width, span_array);
+}
+
+/**
+ * 查找两个词语前后相接的量化共现次数.
+ * 用户码表不记录二元组. \n
+ * @return 0
+ */
+uint UserPhrase::SearchBigramWeight(const PhraseProxy *,
+                                    const PhraseProxy *) {
+  return 0;
+}
+
+/**
+ * 估计查询汉字代理数组所需的代价.
+ * 代价为各(模糊)索引值下可能被扫描的词语数量之和，是实际扫描量的上限. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @return 代价
+ */
+uint UserPhrase::EstimateSearchCost(const FuzzyProfile *profile,
+                                    const CharsProxy *chars_proxy,
+                                    int chars_proxy_length) {
+  uint cost = 0;
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr) {
+    if (root_.max_index_ < *index_ptr)
+      continue;
+    UserPhraseIndexNode *index_node = root_.table_ + *index_ptr;
+    int length = chars_proxy_length <= index_node->max_length_ ?
+                     chars_proxy_length : index_node->max_length_;
+    for (; length >= 1; --length)
+      cost += (index_node->table_ + length - 1)->phrase_amount_;
+  }
+  return cost;
+}
+
+/**
+ * 统计与汉字代理数组相匹配的词语数量.
+ * 只统计各长度节点中的匹配项，不给出任何词语数据代理. \n
+ * @param profile 模糊拼音配置
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的有效长度
+ * @return 词语数量
+ */
+uint UserPhrase::CountMatchPhrase(const FuzzyProfile *profile,
+                                  const CharsProxy *chars_proxy,
+                                  int chars_proxy_length) {
+  uint amount = 0;
+  int8_t index_list[MAX_PINYIN_PARTS + 1];
+  profile->GetFuzzyIndex(chars_proxy->major_index_, index_list);
+  for (const int8_t *index_ptr = index_list; *index_ptr != -1; ++index_ptr) {
+    if (root_.max_index_ < *index_ptr)
+      continue;
+    UserPhraseIndexNode *index_node = root_.table_ + *index_ptr;
+    int length = chars_proxy_length <= index_node->max_length_ ?
+                     chars_proxy_length : index_node->max_length_;
+    for (; length >= 1; --length) {
+      UserPhraseLengthNode *length_node = index_node->table_ + length - 1;
+      amount += CountMatchEntry(profile, chars_proxy,
+                                length_node->chars_proxy_, NULL,
+                                length_node->phrase_amount_, length);
+    }
+  }
+  return amount;
+}
+
 /**
  * 解析词语数据代理所表示的词语数据.
  * @param phrase_proxy 词语数据代理
+ * @param arena 分配词语数据的临时内存区(NULL 由堆分配)
  * @return 词语数据
  */
-PhraseDatum *UserPhrase::AnalyzePhraseProxy(const PhraseProxy *phrase_proxy) {
-  PhraseDatum *phrase_datum = new PhraseDatum;
-  phrase_datum->chars_proxy_ =
-      new CharsProxy[phrase_proxy->chars_proxy_length_];
+PhraseDatum *UserPhrase::AnalyzePhraseProxy(const PhraseProxy *phrase_proxy,
+                                            PhraseArena *arena) {
+  int raw_data_length = 0;
+  lseek(fd_, phrase_proxy->phrase_data_offset_, SEEK_SET);
+  xread(fd_, &raw_data_length, sizeof(raw_data_length));
+  PhraseDatum *phrase_datum = PhraseDatum::Create(
+                                  arena, phrase_proxy->chars_proxy_length_,
+                                  raw_data_length);
   memcpy(phrase_datum->chars_proxy_, phrase_proxy->chars_proxy_,
          sizeof(CharsProxy) * phrase_proxy->chars_proxy_length_);
-  phrase_datum->chars_proxy_length_ = phrase_proxy->chars_proxy_length_;
   phrase_datum->phrase_data_offset_ = phrase_proxy->phrase_data_offset_;
-  lseek(fd_, phrase_datum->phrase_data_offset_, SEEK_SET);
-  xread(fd_, &phrase_datum->raw_data_length_,
-        sizeof(phrase_datum->raw_data_length_));
-  phrase_datum->raw_data_ = malloc(phrase_datum->raw_data_length_);
-  xread(fd_, phrase_datum->raw_data_, phrase_datum->raw_data_length_);
+  xread(fd_, phrase_datum->raw_data_, raw_data_length);
 
   return phrase_datum;
 }
@@ -463,16 +538,17 @@ void UserPhrase::ReadPhraseTree() {
 }
 
 /**
- * 查找位于本索引值下与汉字代理数组相匹配的词语数据代理.
+ * 查找位于本索引值下与汉字代理数组最相匹配的词语数据代理.
+ * @param profile 模糊拼音配置
  * @param chars_proxy_index 索引值
  * @param chars_proxy 汉字代理数组
- * @param chars_proxy_length 汉字代理数组的有效长度
- * @return 词语数据代理链表
+ * @param chars_proxy_length 汉字代理数组有效长度
+ * @return 词语数据代理
  */
-std::list<PhraseProxy *> *UserPhrase::SearchMatchablePhrase(
-                                          int8_t chars_proxy_index,
-                                          const CharsProxy *chars_proxy,
-                                          int chars_proxy_length) {
+PhraseProxy *UserPhrase::SearchPreferPhrase(const FuzzyProfile *profile,
+                                            int8_t chars_proxy_index,
+                                            const CharsProxy *chars_proxy,
+                                            int chars_proxy_length) {
   /* 检查条件是否满足 */
   if (root_.max_index_ < chars_proxy_index)
     return NULL;
@@ -481,84 +557,64 @@ std::list<PhraseProxy *> *UserPhrase::SearchMatchablePhrase(
     return NULL;
 
   /* 查询数据 */
-  std::list<PhraseProxy *> *phrase_list = new std::list<PhraseProxy *>;
+  PhraseProxy *phrase_proxy = NULL;
   int length = chars_proxy_length <= index_node->max_length_ ?
                    chars_proxy_length : index_node->max_length_;
   for (; length >= 1; --length) {
     UserPhraseLengthNode *length_node = index_node->table_ + length - 1;
     uint number = length_node->phrase_amount_;
-    while (number >= 1) {
-      --number;
-      if (CharsProxyCmp(fuzzy_pair_table_,
-                        chars_proxy,
-                        length_node->chars_proxy_ + length * number,
-                        length)) {
-        PhraseProxy *phrase_proxy = new PhraseProxy;
-        phrase_list->push_back(phrase_proxy);
-        phrase_proxy->chars_proxy_ =
-            length_node->chars_proxy_ + length * number;
-        phrase_proxy->chars_proxy_length_ = length;
-        UserPhraseAttribute *attribute =
-            length_node->phrase_attribute_ + number;
-        phrase_proxy->phrase_data_offset_ = attribute->datum_offset_;
-        phrase_proxy->frequency_ = attribute->frequency_;
-      }
+    if (SearchMatchEntry(profile, chars_proxy,
+                         length_node->chars_proxy_, length, &number)) {
+      phrase_proxy = new PhraseProxy;
+      phrase_proxy->chars_proxy_ = length_node->chars_proxy_ + length * number;
+      phrase_proxy->chars_proxy_length_ = length;
+      UserPhraseAttribute *attribute = length_node->phrase_attribute_ + number;
+      phrase_proxy->phrase_data_offset_ = attribute->datum_offset_;
+      phrase_proxy->frequency_ = attribute->frequency_;
+      break;
     }
   }
 
-  /* 检查返回值 */
-  if (phrase_list->empty()) {
-    delete phrase_list;
-    phrase_list = NULL;
-  }
-
-  return phrase_list;
+  return phrase_proxy;
 }
 
 /**
- * 查找位于本索引值下与汉字代理数组最相匹配的词语数据代理.
+ * 查找位于本索引值下以汉字代理数组开头的各长度下的最佳词语数据代理.
+ * @param profile 模糊拼音配置
  * @param chars_proxy_index 索引值
  * @param chars_proxy 汉字代理数组
  * @param chars_proxy_length 汉字代理数组有效长度
- * @return 词语数据代理
+ * @param min_length 需要查找的最小长度
+ * @param width 每个长度下最多保留的词语数量
+ * @param span_array 各长度的候选词语
  */
-PhraseProxy *UserPhrase::SearchPreferPhrase(int8_t chars_proxy_index,
-                                            const CharsProxy *chars_proxy,
-                                            int chars_proxy_length) {
+void UserPhrase::SearchPreferSpan(const FuzzyProfile *profile,
+                                  int8_t chars_proxy_index,
+                                  const CharsProxy *chars_proxy,
+                                  int chars_proxy_length, int min_length,
+                                  int width, PhraseProxy *span_array) {
   /* 检查条件是否满足 */
   if (root_.max_index_ < chars_proxy_index)
-    return NULL;
+    return;
   UserPhraseIndexNode *index_node = root_.table_ + chars_proxy_index;
   if (index_node->max_length_ == 0)
-    return NULL;
+    return;
 
   /* 查询数据 */
-  PhraseProxy *phrase_proxy = NULL;
   int length = chars_proxy_length <= index_node->max_length_ ?
                    chars_proxy_length : index_node->max_length_;
-  for (; length >= 1; --length) {
+  for (; length >= min_length; --length) {
     UserPhraseLengthNode *length_node = index_node->table_ + length - 1;
     uint number = length_node->phrase_amount_;
-    while (number >= 1) {
-      --number;
-      if (CharsProxyCmp(fuzzy_pair_table_,
-                        chars_proxy,
-                        length_node->chars_proxy_ + length * number,
-                        length)) {
-        phrase_proxy = new PhraseProxy;
-        phrase_proxy->chars_proxy_ =
-            length_node->chars_proxy_ + length * number;
-        phrase_proxy->chars_proxy_length_ = length;
-        UserPhraseAttribute *attribute =
-            length_node->phrase_attribute_ + number;
-        phrase_proxy->phrase_data_offset_ = attribute->datum_offset_;
-        phrase_proxy->frequency_ = attribute->frequency_;
-        break;
-      }
+    if (SearchMatchEntry(profile, chars_proxy,
+                         length_node->chars_proxy_, length, &number)) {
+      PhraseProxy phrase_proxy;
+      phrase_proxy.chars_proxy_ = length_node->chars_proxy_ + length * number;
+      phrase_proxy.chars_proxy_length_ = length;
+      UserPhraseAttribute *attribute = length_node->phrase_attribute_ + number;
+      phrase_proxy.phrase_data_offset_ = attribute->datum_offset_;
+      phrase_proxy.frequency_ = attribute->frequency_;
+      InsertPreferSpan(span_array + (length - 1) * width, 1, &phrase_proxy);
     }
-    if (phrase_proxy)
-      break;
   }
-
-  return phrase_proxy;
 }
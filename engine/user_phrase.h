@@ -79,14 +79,33 @@ class UserPhrase : public AbstractPhrase {
   UserPhrase();
   virtual ~UserPhrase();
 
-  virtual void BuildPhraseTree(const char *mbfile);
-  virtual void SetFuzzyPinyinTable(const int8_t **fuzzy_pair_table);
-  virtual std::list<PhraseProxy *> *SearchMatchablePhrase(
+  virtual bool BuildPhraseTree(const char *mbfile);
+  virtual PhraseCursor *OpenMatchCursor(const FuzzyProfile *profile,
                                         const CharsProxy *chars_proxy,
-                                        int chars_proxy_length);
-  virtual PhraseProxy *SearchPreferPhrase(const CharsProxy *chars_proxy,
+                                        int chars_proxy_length,
+                                        PhraseArena *arena);
+  virtual bool SearchNextPhrase(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length,
+                                PhraseCursorBranch *branch,
+                                PhraseProxy *phrase_proxy);
+  virtual PhraseProxy *SearchPreferPhrase(const FuzzyProfile *profile,
+                                          const CharsProxy *chars_proxy,
                                           int chars_proxy_length);
-  virtual PhraseDatum *AnalyzePhraseProxy(const PhraseProxy *phrase_proxy);
+  virtual void SearchPreferSpan(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length, int min_length,
+                                int width, PhraseProxy *span_array);
+  virtual uint SearchBigramWeight(const PhraseProxy *phrase_proxy1,
+                                  const PhraseProxy *phrase_proxy2);
+  virtual uint EstimateSearchCost(const FuzzyProfile *profile,
+                                  const CharsProxy *chars_proxy,
+                                  int chars_proxy_length);
+  virtual uint CountMatchPhrase(const FuzzyProfile *profile,
+                                const CharsProxy *chars_proxy,
+                                int chars_proxy_length);
+  virtual PhraseDatum *AnalyzePhraseProxy(const PhraseProxy *phrase_proxy,
+                                          PhraseArena *arena);
 
   void InsertPhraseToTree(const PhraseDatum *phrase_datum);
   void DeletePhraseFromTree(const PhraseDatum *phrase_datum);
@@ -97,14 +116,14 @@ private:
   void WriteEmptyPhraseTree();
 
   void ReadPhraseTree();
-  std::list<PhraseProxy *> *SearchMatchablePhrase(int8_t chars_proxy_index,
-                                                  const CharsProxy *chars_proxy,
-                                                  int chars_proxy_length);
-  PhraseProxy *SearchPreferPhrase(int8_t chars_proxy_index,
+  PhraseProxy *SearchPreferPhrase(const FuzzyProfile *profile,
+                                  int8_t chars_proxy_index,
                                   const CharsProxy *chars_proxy,
                                   int chars_proxy_length);
+  void SearchPreferSpan(const FuzzyProfile *profile, int8_t chars_proxy_index,
+                        const CharsProxy *chars_proxy, int chars_proxy_length,
+                        int min_length, int width, PhraseProxy *span_array);
 
-  const int8_t **fuzzy_pair_table_;  ///< 模模糊拼音单元对照表
   UserPhraseRootNode root_;  ///< 词语树的根索引点
   int index_offset_;  ///< 绝对偏移量
   int fd_;  ///< 词语数据文件描述符
@@ -30,42 +30,54 @@ void PrintData(void *data, int len) {
   printf("%s", buffer);
 }
 
+bool PrintPagePhrase(PinyinEditor *pinyin_editor, int page, int pagesize,
+                     std::list<const PhraseDatum *> *page_list) {
+  std::list<const PhraseDatum *> list;
+  pinyin_editor->GetPagePhrase(page, pagesize, &list);
+  if (list.empty())
+    return false;
+  page_list->swap(list);
+
+  int number = 1;
+  for (std::list<const PhraseDatum *>::iterator iterator = page_list->begin();
+       iterator != page_list->end();
+       ++iterator) {
+    const PhraseDatum *datum = *iterator;
+    printf("%d.", number);
+    PrintData(datum->raw_data_, datum->raw_data_length_);
+    printf("\x20");
+    ++number;
+  }
+  printf("\n");
+
+  bool complete = pinyin_editor->IsLookupComplete();
+  bool exact = false;
+  int amount = pinyin_editor->GetPhraseAmount(&exact);
+  printf("Page: %d/%s%d%s\n", page + 1, exact ? "" : "~",
+         (amount + pagesize - 1) / pagesize, complete ? "" : " (partial)");
+  return true;
+}
+
 int main(int argc, char *argv[]) {
   PhraseManager *phrase_manager = PhraseManager::GetInstance();
   phrase_manager->CreateSystemPhraseProxySite("config.txt");
   phrase_manager->CreateUserPhraseProxySite("user.mb");
+  phrase_manager->EnableQueryCache();
+  phrase_manager->EnableIncrementalSearch();
 
   PinyinEditor pinyin_editor(phrase_manager);
-  std::list<const PhraseDatum *> global_list;
+  std::list<const PhraseDatum *> page_list;
   const int pagesize = 5;
-  int pages(0), page(0);
+  int page = 0;
 
   char ch = '\0';
   while ((ch = getchar()) != '`') {
     if (ch >= 'a' && ch <= 'z') {
       pinyin_editor.InsertPinyinKey(ch);
 mark1:
-      global_list.clear();
-      pages = page = 0;
-
-      std::list<const PhraseDatum *> list;
-      pinyin_editor.GetPagePhrase(pagesize, &list);
-      int number = 1;
-      for (std::list<const PhraseDatum *>::iterator iterator = list.begin();
-           iterator != list.end();
-           ++iterator) {
-        const PhraseDatum *datum = *iterator;
-        printf("%d.", number);
-        PrintData(datum->raw_data_, datum->raw_data_length_);
-        printf("\x20");
-        ++number;
-
-        global_list.push_back(datum);
-      }
-      if (!list.empty()) {
-        pages = page = 1;
-        printf("\n");
-      }
+      page_list.clear();
+      page = 0;
+      PrintPagePhrase(&pinyin_editor, page, pagesize, &page_list);
 
       char *data = NULL;
       int len = 0;
@@ -98,10 +110,10 @@ mark1:
         printf("\n");
       }
     } else if (ch >= '1' && ch <= '5') {
-      int index = pagesize * (page - 1) + (ch - '1');
-      if ((size_t)index >= global_list.size())
+      int index = ch - '1';
+      if ((size_t)index >= page_list.size())
         continue;
-      std::list<const PhraseDatum *>::iterator iterator = global_list.begin();
+      std::list<const PhraseDatum *>::iterator iterator = page_list.begin();
       advance(iterator, index);
       const PhraseDatum *datum = *iterator;
       printf("SelectedPhrase: ");
@@ -122,56 +134,27 @@ mark1:
         phrase_manager->BackupUserPhrase();
 
         pinyin_editor.StopTask();
-        global_list.clear();
-        pages = page = 0;
+        page_list.clear();
+        page = 0;
       } else {
         goto mark1;
       }
     } else if (ch == '=') {
-      if (pages == page) {
-        std::list<const PhraseDatum *> list;
-        pinyin_editor.GetPagePhrase(pagesize, &list);
-        int number = 1;
-        for (std::list<const PhraseDatum *>::iterator iterator = list.begin();
-             iterator != list.end();
-             ++iterator) {
-          const PhraseDatum *datum = *iterator;
-          printf("%d.", number);
-          PrintData(datum->raw_data_, datum->raw_data_length_);
-          printf("\x20");
-          ++number;
-
-          global_list.push_back(datum);
-        }
-        if (!list.empty()) {
-          ++pages;
-          ++page;
-          printf("\n");
-        }
-      } else {
+      if (PrintPagePhrase(&pinyin_editor, page + 1, pagesize, &page_list))
         ++page;
-mark2:
-        int index = pagesize * (page - 1);
-        std::list<const PhraseDatum *>::iterator iterator = global_list.begin();
-        advance(iterator, index);
-        for (int number = 1; number <= pagesize; ++number) {
-          if (iterator == global_list.end())
-            break;
-          const PhraseDatum *datum = *iterator;
-          printf("%d.", number);
-          PrintData(datum->raw_data_, datum->raw_data_length_);
-          printf("\x20");
-          ++iterator;
-        }
-        printf("\n");
-      }
     } else if (ch == '-') {
-      if (page <= 1)
+      if (page <= 0)
         continue;
-      --page;
-      goto mark2;
+      if (PrintPagePhrase(&pinyin_editor, page - 1, pagesize, &page_list))
+        --page;
+    } else if (ch == '!') {
+      phrase_manager->ReloadSystemPhraseProxySite("config.txt");
     }
   }
 
+  uint hits = 0, misses = 0;
+  phrase_manager->GetQueryCacheStats(&hits, &misses);
+  printf("QueryCache: %u hits, %u misses\n", hits, misses);
+
   return 0;
 }
@@ -12,15 +12,40 @@
 #include "mb_creater.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <string.h>
 #include <unistd.h>
+#include <algorithm>
 #include "engine/pye_output.h"
 #include "engine/pye_wrapper.h"
 
+/**
+ * 按命中次数降序比较词语数据资料.
+ * @param datum1 词语数据资料
+ * @param datum2 词语数据资料
+ * @return 前者的命中次数是否多于后者
+ */
+static bool CompareDatumHits(const PhraseDatum *datum1,
+                             const PhraseDatum *datum2) {
+  return datum1->hits_ > datum2->hits_;
+}
+
+/**
+ * 按频率升序比较词语数据资料.
+ * @param datum1 词语数据资料
+ * @param datum2 词语数据资料
+ * @return 前者的频率是否低于后者
+ */
+static bool CompareDatumFrequency(const PhraseDatum *datum1,
+                                  const PhraseDatum *datum2) {
+  return datum1->frequency_ < datum2->frequency_;
+}
+
 /**
  * 类构造函数.
  */
-MBCreater::MBCreater() {
+MBCreater::MBCreater()
+    : max_frequency_(0), hot_layout_(false), max_bigram_count_(0) {
 }
 
 /**
@@ -61,6 +86,118 @@ void MBCreater::BuildPhraseTree(const char *data_file) {
   fclose(stream);
 }
 
+/**
+ * 读取词语命中文件，并启用热区布局.
+ * @param hits_file 词语命中文件，NULL表示直接以词语频率作为命中次数
+ */
+void MBCreater::LoadPhraseHits(const char *hits_file) {
+  hot_layout_ = true;
+  if (!hits_file)
+    return;
+
+  /* 打开命中文件 */
+  FILE *stream = fopen(hits_file, "r");
+  if (!stream)
+    errx(1, "Fopen file \"%s\" failed, %s", hits_file, strerror(errno));
+
+  /* 读取文件数据，累计命中次数 */
+  uint phrases = 0;
+  char *lineptr = NULL;
+  size_t n = 0;
+  while (getline(&lineptr, &n, stream) != -1) {
+    const char *phrase(NULL), *pinyin(NULL), *hits(NULL);
+    if (!BreakPhraseString(lineptr, &phrase, &pinyin, &hits))
+      continue;
+    CharsProxy *chars_proxy = NULL;
+    int chars_proxy_length = 0;
+    PinyinParser pinyin_parser;
+    pinyin_parser.ParsePinyin(pinyin, &chars_proxy, &chars_proxy_length);
+    if (chars_proxy_length != 0) {
+      std::string key = CreatePhraseKey(phrase, strlen(phrase),
+                                        chars_proxy, chars_proxy_length);
+      phrase_hits_[key] += atoi(hits);
+      ++phrases;
+    }
+    delete [] chars_proxy;
+  }
+  pmessage("%u Phrase Hits Loaded!\n", phrases);
+  free(lineptr);
+
+  /* 关闭命中文件 */
+  fclose(stream);
+}
+
+/**
+ * 读取二元组文件.
+ * 词语以(词语,拼音)确定，其编号即为在数据索引部分中的序号，
+ * 因此必须在词语树建立完毕之后调用. 不在词语树中的词语被忽略. \n
+ * @param bigram_file 二元组文件
+ */
+void MBCreater::LoadPhraseBigram(const char *bigram_file) {
+  /* 为词语编号 */
+  std::vector<PhraseDatum *> data;
+  CollectPhraseDatum(&data);
+  std::map<std::string, uint> phrase_number;
+  for (uint number = data.size(); number > 0; --number) {
+    PhraseDatum *datum = data[number - 1];
+    phrase_number[CreatePhraseKey(datum->raw_data_, datum->raw_data_length_,
+                                  datum->chars_proxy_,
+                                  datum->chars_proxy_length_)] = number - 1;
+  }
+
+  /* 打开二元组文件 */
+  FILE *stream = fopen(bigram_file, "r");
+  if (!stream)
+    errx(1, "Fopen file \"%s\" failed, %s", bigram_file, strerror(errno));
+
+  /* 读取文件数据，累计共现次数 */
+  uint bigrams(0), converts(0);
+  char *lineptr = NULL;
+  size_t n = 0;
+  while (getline(&lineptr, &n, stream) != -1) {
+    ++bigrams;
+    const char *phrase1(NULL), *pinyin1(NULL), *rest(NULL);
+    const char *phrase2(NULL), *pinyin2(NULL), *count(NULL);
+    if (!BreakPhraseString(lineptr, &phrase1, &pinyin1, &rest) ||
+        !BreakPhraseString((char *)rest, &phrase2, &pinyin2, &count) ||
+        atoi(count) <= 0)
+      continue;
+    uint number[2];
+    const char *phrase[2] = {phrase1, phrase2};
+    const char *pinyin[2] = {pinyin1, pinyin2};
+    int found = 0;
+    for (; found < 2; ++found) {
+      CharsProxy *chars_proxy = NULL;
+      int chars_proxy_length = 0;
+      PinyinParser pinyin_parser;
+      pinyin_parser.ParsePinyin(pinyin[found], &chars_proxy,
+                                &chars_proxy_length);
+      std::map<std::string, uint>::iterator iterator =
+          phrase_number.find(CreatePhraseKey(phrase[found],
+                                             strlen(phrase[found]),
+                                             chars_proxy,
+                                             chars_proxy_length));
+      delete [] chars_proxy;
+      if (iterator == phrase_number.end())
+        break;
+      number[found] = iterator->second;
+    }
+    if (found != 2)
+      continue;
+    uint &bigram_count =
+        phrase_bigram_[(uint64_t)number[0] << 32 | number[1]];
+    bigram_count += atoi(count);
+    if (bigram_count > max_bigram_count_)
+      max_bigram_count_ = bigram_count;
+    ++converts;
+  }
+  pmessage("%u Bigrams, %u Converted!\n", bigrams, converts);
+  free(lineptr);
+
+  /* 关闭二元组文件 */
+  fclose(stream);
+}
+
 /**
  * 写出词语树，即生成码表文件.
  * @param mb_file 码表文件
@@ -71,14 +208,30 @@ void MBCreater::WritePhraseTree(const char *mb_file) {
   if (fd == -1)
     errx(1, "Open file \"%s\" failed, %s", mb_file, strerror(errno));
 
-  /* 写出纯索引&数据索引&词语数据 */
+  /* 写出文件头&纯索引&数据索引&词语数据&二元组 */
+  WriteHeaderPart(fd, 0, 0, 0, 0);
   pmessage("Writing pure index part ...\n");
   int offset = 0;
   uint amount = WritePureIndexPart(fd, &offset);
+  offset = (offset + SYSTEM_MB_PAGE - 1) / SYSTEM_MB_PAGE * SYSTEM_MB_PAGE;
+  int hot_offset = LayoutPhraseDatum(offset + sizeof(int) * amount);
   pmessage("Writing datum index part ...\n");
-  WriteDatumIndexPart(fd, offset + sizeof(int) * amount);
+  lseek(fd, offset, SEEK_SET);
+  WriteDatumIndexPart(fd);
   pmessage("Writing phrase datum part ...\n");
   WritePhraseDatumPart(fd);
+  int bigram_offset = 0;
+  uint bigram_slots = 0;
+  if (!phrase_bigram_.empty()) {
+    pmessage("Writing phrase bigram part ...\n");
+    bigram_offset = lseek(fd, 0, SEEK_END);
+    bigram_offset = (bigram_offset + SYSTEM_MB_PAGE - 1) / SYSTEM_MB_PAGE *
+                    SYSTEM_MB_PAGE;
+    bigram_slots = WriteBigramPart(fd, bigram_offset);
+  }
+  lseek(fd, 0, SEEK_SET);
+  WriteHeaderPart(fd, offset, hot_offset != 0 ? hot_offset - offset : 0,
+                  bigram_offset, bigram_slots);
   pmessage("Finished!\n");
 
   /* 关闭码表文件 */
@@ -143,6 +296,8 @@ PhraseDatum *MBCreater::CreatePhraseDatum(const char *phrase,
   datum->raw_data_ = malloc(datum->raw_data_length_);
   memcpy(datum->raw_data_, phrase, datum->raw_data_length_);
   datum->frequency_ = atoi(frequency);
+  if (datum->frequency_ > max_frequency_)
+    max_frequency_ = datum->frequency_;
   return datum;
 }
 
@@ -151,36 +306,34 @@ PhraseDatum *MBCreater::CreatePhraseDatum(const char *phrase,
  * @param datum 词语数据资料
  */
 void MBCreater::InsertDatumToTree(PhraseDatum *datum) {
-  std::list<PhraseLengthNode *> *length_list =
+  std::vector<PhraseLengthNode *> *length_list =
     SearchChildByIndex(&root_.data_, datum->chars_proxy_->major_index_);
-  std::list<PhraseDatum *> *datum_list =
+  std::vector<PhraseDatum *> *datum_list =
     SearchChildByLength(length_list, datum->chars_proxy_length_);
 
-  std::list<PhraseDatum *>::iterator iterator = datum_list->begin();
-  for (; iterator != datum_list->end(); ++iterator) {
-    if ((*iterator)->frequency_ >= datum->frequency_)
-      break;
-  }
-  datum_list->insert(iterator, datum);
+  /* 同长度的词语按频率升序排列，二分查找插入位置 */
+  datum_list->insert(std::lower_bound(datum_list->begin(), datum_list->end(),
+                                      datum, CompareDatumFrequency),
+                     datum);
 }
 
 /**
  * 按汉字代理数组的索引值搜索孩子.
- * @param data_list 数据链表
+ * @param data_list 数据表
  * @param index 索引值
- * @return 孩子链表
+ * @return 孩子表
  */
-std::list<PhraseLengthNode *> *MBCreater::SearchChildByIndex(
-    std::list<PhraseIndexNode *> *data_list, int index) {
+std::vector<PhraseLengthNode *> *MBCreater::SearchChildByIndex(
+    std::vector<PhraseIndexNode *> *data_list, int index) {
   /* 确定孩子节点的位置 */
-  std::list<PhraseIndexNode *>::iterator iterator = data_list->begin();
+  std::vector<PhraseIndexNode *>::iterator iterator = data_list->begin();
   for (; iterator != data_list->end(); ++iterator) {
     if ((*iterator)->chars_proxy_index_ >= index)
       break;
   }
 
-  /* 获取孩子链表 */
-  std::list<PhraseLengthNode *> *length_list = NULL;
+  /* 获取孩子表 */
+  std::vector<PhraseLengthNode *> *length_list = NULL;
   if (iterator == data_list->end() || (*iterator)->chars_proxy_index_ > index) {
     PhraseIndexNode *node = new PhraseIndexNode;
     node->chars_proxy_index_ = index;
@@ -195,21 +348,21 @@ std::list<PhraseLengthNode *> *MBCreater::SearchChildByIndex(
 
 /**
  * 按汉字代理数组的长度搜索孩子.
- * @param data_list 数据链表
+ * @param data_list 数据表
  * @param length 长度
- * @return 孩子链表
+ * @return 孩子表
  */
-std::list<PhraseDatum *> *MBCreater::SearchChildByLength(
-    std::list<PhraseLengthNode *> *data_list, int length) {
+std::vector<PhraseDatum *> *MBCreater::SearchChildByLength(
+    std::vector<PhraseLengthNode *> *data_list, int length) {
   /* 确定孩子节点的位置 */
-  std::list<PhraseLengthNode *>::iterator iterator = data_list->begin();
+  std::vector<PhraseLengthNode *>::iterator iterator = data_list->begin();
   for (; iterator != data_list->end(); ++iterator) {
     if ((*iterator)->chars_proxy_length_ >= length)
       break;
   }
 
-  /* 获取孩子链表 */
-  std::list<PhraseDatum *> *datum_list = NULL;
+  /* 获取孩子表 */
+  std::vector<PhraseDatum *> *datum_list = NULL;
   if (iterator == data_list->end() ||
       (*iterator)->chars_proxy_length_ > length) {
     PhraseLengthNode *node = new PhraseLengthNode;
@@ -223,9 +376,164 @@ std::list<PhraseDatum *> *MBCreater::SearchChildByLength(
   return datum_list;
 }
 
+/**
+ * 创建词语的查询键.
+ * @param data 词语数据
+ * @param length 词语数据的长度
+ * @param chars_proxy 汉字代理数组
+ * @param chars_proxy_length 汉字代理数组的长度
+ * @return 查询键
+ */
+std::string MBCreater::CreatePhraseKey(const void *data, int length,
+                                       const CharsProxy *chars_proxy,
+                                       int chars_proxy_length) {
+  std::string key((const char *)data, length);
+  key.append(1, '\0');
+  key.append((const char *)chars_proxy,
+             sizeof(CharsProxy) * chars_proxy_length);
+  return key;
+}
+
+/**
+ * 量化词语频率.
+ * 按对数比例将频率映射到(1~255)，非正数频率映射为0.
+ * @param frequency 词语频率
+ * @return 量化频率
+ */
+uint8_t MBCreater::QuantizeFrequency(int frequency) {
+  if (frequency <= 0 || max_frequency_ <= 0)
+    return 0;
+  return 1 + (uint8_t)(254.0 * log(1.0 + frequency) /
+                       log(1.0 + max_frequency_));
+}
+
+/**
+ * 量化二元组的共现次数.
+ * 与词语频率一样按对数比例映射到(1~255). \n
+ * @param count 共现次数
+ * @return 量化次数
+ */
+uint8_t MBCreater::QuantizeBigramCount(uint count) {
+  if (count == 0 || max_bigram_count_ == 0)
+    return 0;
+  return 1 + (uint8_t)(254.0 * log(1.0 + count) /
+                       log(1.0 + max_bigram_count_));
+}
+
+/**
+ * 按树的次序收集所有词语数据资料.
+ * @param data 词语数据资料数组
+ */
+void MBCreater::CollectPhraseDatum(std::vector<PhraseDatum *> *data) {
+  std::vector<PhraseIndexNode *> *index_list = &root_.data_;
+  for (std::vector<PhraseIndexNode *>::iterator iterator = index_list->begin();
+       iterator != index_list->end();
+       ++iterator) {
+    std::vector<PhraseLengthNode *> *length_list = &(*iterator)->data_;
+    for (std::vector<PhraseLengthNode *>::iterator iterator = length_list->begin();
+         iterator != length_list->end();
+         ++iterator) {
+      std::vector<PhraseDatum *> *datum_list = &(*iterator)->data_;
+      data->insert(data->end(), datum_list->begin(), datum_list->end());
+    }
+  }
+}
+
+/**
+ * 安排各词语数据在码表文件中的位置.
+ * 若启用了热区布局，覆盖95%命中的词语数据将按命中次数降序率先排列，
+ * 其余词语数据则从下一个页面边界开始按树的次序排列. \n
+ * @param offset 词语数据部分的偏移量
+ * @return 热区的结束偏移量，0表示没有热区
+ */
+int MBCreater::LayoutPhraseDatum(int offset) {
+  std::vector<PhraseDatum *> data;
+  CollectPhraseDatum(&data);
+
+  /* 获取词语的命中次数 */
+  uint64_t total_hits = 0;
+  for (std::vector<PhraseDatum *>::iterator iterator = data.begin();
+       iterator != data.end();
+       ++iterator) {
+    PhraseDatum *datum = *iterator;
+    if (phrase_hits_.empty()) {
+      datum->hits_ = datum->frequency_ > 0 ? datum->frequency_ : 0;
+    } else {
+      std::map<std::string, uint>::iterator hits_iterator =
+          phrase_hits_.find(CreatePhraseKey(datum->raw_data_,
+                                            datum->raw_data_length_,
+                                            datum->chars_proxy_,
+                                            datum->chars_proxy_length_));
+      datum->hits_ = hits_iterator != phrase_hits_.end() ?
+                         hits_iterator->second : 0;
+    }
+    total_hits += datum->hits_;
+  }
+
+  /* 排列热区 */
+  int hot_offset = 0;
+  if (hot_layout_ && total_hits != 0) {
+    std::vector<PhraseDatum *> hot_data(data);
+    std::stable_sort(hot_data.begin(), hot_data.end(), CompareDatumHits);
+    uint64_t hits = 0;
+    uint phrases = 0;
+    for (std::vector<PhraseDatum *>::iterator iterator = hot_data.begin();
+         iterator != hot_data.end();
+         ++iterator) {
+      PhraseDatum *datum = *iterator;
+      if (hits * 100 >= total_hits * 95 || datum->hits_ == 0)
+        break;
+      hits += datum->hits_;
+      datum->offset_ = offset;
+      offset += sizeof(datum->raw_data_length_) + datum->raw_data_length_;
+      ++phrases;
+    }
+    offset = (offset + SYSTEM_MB_PAGE - 1) / SYSTEM_MB_PAGE * SYSTEM_MB_PAGE;
+    hot_offset = offset;
+    pmessage("%u Hot Phrases Cover %u%% Hits!\n", phrases,
+             (uint)(hits * 100 / total_hits));
+  }
+
+  /* 排列冷区 */
+  for (std::vector<PhraseDatum *>::iterator iterator = data.begin();
+       iterator != data.end();
+       ++iterator) {
+    PhraseDatum *datum = *iterator;
+    if (datum->offset_ != 0)
+      continue;
+    datum->offset_ = offset;
+    offset += sizeof(datum->raw_data_length_) + datum->raw_data_length_;
+  }
+
+  return hot_offset;
+}
+
+/**
+ * 写出文件头部分.
+ * (文件标识,格式版本,数据索引部分的偏移量,热区长度,二元组部分的偏移量,
+ * 二元组散列表的槽位数).
+ * @param fd 文件描述字
+ * @param offset 数据索引部分的偏移量
+ * @param hot_length 从数据索引部分起算的热区长度
+ * @param bigram_offset 二元组部分的偏移量(0 没有二元组)
+ * @param bigram_slots 二元组散列表的槽位数
+ */
+void MBCreater::WriteHeaderPart(int fd, int offset, int hot_length,
+                                int bigram_offset, uint bigram_slots) {
+  int magic = SYSTEM_MB_MAGIC;
+  int version = SYSTEM_MB_VERSION;
+  xwrite(fd, &magic, sizeof(magic));
+  xwrite(fd, &version, sizeof(version));
+  xwrite(fd, &offset, sizeof(offset));
+  xwrite(fd, &hot_length, sizeof(hot_length));
+  xwrite(fd, &bigram_offset, sizeof(bigram_offset));
+  xwrite(fd, &bigram_slots, sizeof(bigram_slots));
+}
+
 /**
  * 写出纯索引部分.
- * (最大索引值)-->(索引值,最大长度)-->(长度,总孩子数)-->(汉字代理数组).
+ * (最大索引值)-->(索引值,最大长度)-->(长度,总孩子数)-->
+ * (汉字代理数组,量化频率数组).
  * @param fd 文件描述字
  * @param offset 数据索引部分的偏移量
  * @return 总词语数
@@ -233,32 +541,38 @@ std::list<PhraseDatum *> *MBCreater::SearchChildByLength(
 uint MBCreater::WritePureIndexPart(int fd, int *offset) {
   uint phrase_datum_amount = 0;
 
-  std::list<PhraseIndexNode *> *index_list = &root_.data_;
+  std::vector<PhraseIndexNode *> *index_list = &root_.data_;
   int8_t max_chars_proxy_index = index_list->back()->chars_proxy_index_;
   xwrite(fd, &max_chars_proxy_index, sizeof(max_chars_proxy_index));
-  for (std::list<PhraseIndexNode *>::iterator iterator = index_list->begin();
+  for (std::vector<PhraseIndexNode *>::iterator iterator = index_list->begin();
        iterator != index_list->end();
        ++iterator) {
     int8_t chars_proxy_index = (*iterator)->chars_proxy_index_;
     xwrite(fd, &chars_proxy_index, sizeof(chars_proxy_index));
-    std::list<PhraseLengthNode *> *length_list = &(*iterator)->data_;
+    std::vector<PhraseLengthNode *> *length_list = &(*iterator)->data_;
     int max_chars_proxy_length = length_list->back()->chars_proxy_length_;
     xwrite(fd, &max_chars_proxy_length, sizeof(max_chars_proxy_length));
-    for (std::list<PhraseLengthNode *>::iterator iterator = length_list->begin();
+    for (std::vector<PhraseLengthNode *>::iterator iterator = length_list->begin();
          iterator != length_list->end();
          ++iterator) {
       int chars_proxy_length = (*iterator)->chars_proxy_length_;
       xwrite(fd, &chars_proxy_length, sizeof(chars_proxy_length));
-      std::list<PhraseDatum *> *datum_list = &(*iterator)->data_;
+      std::vector<PhraseDatum *> *datum_list = &(*iterator)->data_;
       uint phrase_datum_count = 0/*datum_list->size()*/;
       int data_offset = lseek(fd, sizeof(phrase_datum_count), SEEK_CUR);
-      for (std::list<PhraseDatum *>::iterator iterator = datum_list->begin();
+      for (std::vector<PhraseDatum *>::iterator iterator = datum_list->begin();
            iterator != datum_list->end();
            ++iterator) {
         xwrite(fd, (*iterator)->chars_proxy_,
                sizeof(CharsProxy) * chars_proxy_length);
         ++phrase_datum_count;
       }
+      for (std::vector<PhraseDatum *>::iterator iterator = datum_list->begin();
+           iterator != datum_list->end();
+           ++iterator) {
+        uint8_t frequency = QuantizeFrequency((*iterator)->frequency_);
+        xwrite(fd, &frequency, sizeof(frequency));
+      }
       lseek(fd, data_offset - sizeof(phrase_datum_count), SEEK_SET);
       xwrite(fd, &phrase_datum_count, sizeof(phrase_datum_count));
       phrase_datum_amount += phrase_datum_count;
@@ -273,24 +587,22 @@ uint MBCreater::WritePureIndexPart(int fd, int *offset) {
  * 写出数据索引部分.
  * ()-->()-->()-->(偏移量)
  * @param fd 文件描述字
- * @param offset 词语数据部分的偏移量
  */
-void MBCreater::WriteDatumIndexPart(int fd, int offset) {
-  std::list<PhraseIndexNode *> *index_list = &root_.data_;
-  for (std::list<PhraseIndexNode *>::iterator iterator = index_list->begin();
+void MBCreater::WriteDatumIndexPart(int fd) {
+  std::vector<PhraseIndexNode *> *index_list = &root_.data_;
+  for (std::vector<PhraseIndexNode *>::iterator iterator = index_list->begin();
        iterator != index_list->end();
        ++iterator) {
-    std::list<PhraseLengthNode *> *length_list = &(*iterator)->data_;
-    for (std::list<PhraseLengthNode *>::iterator iterator = length_list->begin();
+    std::vector<PhraseLengthNode *> *length_list = &(*iterator)->data_;
+    for (std::vector<PhraseLengthNode *>::iterator iterator = length_list->begin();
          iterator != length_list->end();
          ++iterator) {
-      std::list<PhraseDatum *> *datum_list = &(*iterator)->data_;
-      for (std::list<PhraseDatum *>::iterator iterator = datum_list->begin();
+      std::vector<PhraseDatum *> *datum_list = &(*iterator)->data_;
+      for (std::vector<PhraseDatum *>::iterator iterator = datum_list->begin();
            iterator != datum_list->end();
            ++iterator) {
         PhraseDatum *datum = *iterator;
-        xwrite(fd, &offset, sizeof(offset));
-        offset += sizeof(datum->raw_data_length_) + datum->raw_data_length_;
+        xwrite(fd, &datum->offset_, sizeof(datum->offset_));
       }
     }
   }
@@ -302,22 +614,57 @@ void MBCreater::WriteDatumIndexPart(int fd, int offset) {
  * @param fd 文件描述字
  */
 void MBCreater::WritePhraseDatumPart(int fd) {
-  std::list<PhraseIndexNode *> *index_list = &root_.data_;
-  for (std::list<PhraseIndexNode *>::iterator iterator = index_list->begin();
+  std::vector<PhraseIndexNode *> *index_list = &root_.data_;
+  for (std::vector<PhraseIndexNode *>::iterator iterator = index_list->begin();
        iterator != index_list->end();
        ++iterator) {
-    std::list<PhraseLengthNode *> *length_list = &(*iterator)->data_;
-    for (std::list<PhraseLengthNode *>::iterator iterator = length_list->begin();
+    std::vector<PhraseLengthNode *> *length_list = &(*iterator)->data_;
+    for (std::vector<PhraseLengthNode *>::iterator iterator = length_list->begin();
          iterator != length_list->end();
          ++iterator) {
-      std::list<PhraseDatum *> *datum_list = &(*iterator)->data_;
-      for (std::list<PhraseDatum *>::iterator iterator = datum_list->begin();
+      std::vector<PhraseDatum *> *datum_list = &(*iterator)->data_;
+      for (std::vector<PhraseDatum *>::iterator iterator = datum_list->begin();
            iterator != datum_list->end();
            ++iterator) {
         PhraseDatum *datum = *iterator;
+        lseek(fd, datum->offset_, SEEK_SET);
         xwrite(fd, &datum->raw_data_length_, sizeof(datum->raw_data_length_));
         xwrite(fd, datum->raw_data_, datum->raw_data_length_);
       }
     }
   }
 }
+
+/**
+ * 写出二元组部分.
+ * (键值数组,量化次数数组)，键值为(前一词语的编号<<32|后一词语的编号).
+ * 散列表的槽位数为2的幂且至少是二元组数量的两倍，按线性探查解决冲突，
+ * 引擎可直接在映射区中查找. \n
+ * @param fd 文件描述字
+ * @param offset 二元组部分的偏移量
+ * @return 散列表的槽位数
+ */
+uint MBCreater::WriteBigramPart(int fd, int offset) {
+  /* 构建散列表 */
+  uint slots = 2;
+  while (slots < phrase_bigram_.size() * 2)
+    slots <<= 1;
+  std::vector<uint64_t> keys(slots, SYSTEM_MB_BIGRAM_EMPTY);
+  std::vector<uint8_t> counts(slots, 0);
+  for (std::map<uint64_t, uint>::iterator iterator = phrase_bigram_.begin();
+       iterator != phrase_bigram_.end();
+       ++iterator) {
+    uint slot = SYSTEM_MB_BIGRAM_HASH(iterator->first) & (slots - 1);
+    while (keys[slot] != SYSTEM_MB_BIGRAM_EMPTY)
+      slot = (slot + 1) & (slots - 1);
+    keys[slot] = iterator->first;
+    counts[slot] = QuantizeBigramCount(iterator->second);
+  }
+
+  /* 写出散列表 */
+  lseek(fd, offset, SEEK_SET);
+  xwrite(fd, &keys[0], sizeof(uint64_t) * slots);
+  xwrite(fd, &counts[0], sizeof(uint8_t) * slots);
+
+  return slots;
+}
@@ -5,6 +5,11 @@
 // 分析词语文件，并生成一份二进制的系统码表文件.
 // 词语文件格式: 词语 拼音 频率
 // e.g.: 郁闷 yu'men 1234
+// 词语频率将被量化为(1~255)后写入码表文件，以便引擎在多个码表间按频率排序.
+// 若提供词语命中文件(格式同词语文件，频率即命中次数)，覆盖95%命中的词语数据
+// 将被集中写到一个按页对齐的热区中，以减少冷启动时需要读入的页面.
+// 若提供二元组文件(格式: 词语1 拼音1 词语2 拼音2 次数)，两个词语前后相接的
+// 共现次数将被量化后写入码表末尾的散列表，供整句转换为相邻的词语加分.
 //
 // Author: Jally <jallyx@163.com>, (C) 2009, 2010
 //
@@ -16,7 +21,9 @@
 
 #include <sys/types.h>
 #include <stdlib.h>
-#include <list>
+#include <map>
+#include <string>
+#include <vector>
 #include "engine/pinyin_parser.h"
 #include "engine/pye_global.h"
 
@@ -28,7 +35,7 @@ class PhraseDatum {
   PhraseDatum()
       : chars_proxy_(NULL), chars_proxy_length_(0),
         raw_data_(NULL), raw_data_length_(0),
-        frequency_(0) {}
+        frequency_(0), hits_(0), offset_(0) {}
   ~PhraseDatum() {
     delete [] chars_proxy_;
     free(raw_data_);
@@ -39,6 +46,8 @@ class PhraseDatum {
   void *raw_data_;  ///< 词语的原始数据 *
   int raw_data_length_;  ///< 词语的原始数据的长度
   int frequency_;  ///< 词语的使用频率
+  uint hits_;  ///< 词语的命中次数
+  int offset_;  ///< 词语数据在码表文件中的偏移量
 };
 
 /**
@@ -48,11 +57,11 @@ class PhraseLengthNode {
  public:
   PhraseLengthNode() : chars_proxy_length_(0) {}
   ~PhraseLengthNode() {
-    STL_DELETE_DATA(data_, std::list<PhraseDatum *>);
+    STL_DELETE_DATA(data_, std::vector<PhraseDatum *>);
   }
 
   int chars_proxy_length_;  ///< 词语的汉字代理数组的长度
-  std::list<PhraseDatum *> data_;  ///< 数据
+  std::vector<PhraseDatum *> data_;  ///< 数据
 };
 
 /**
@@ -62,11 +71,11 @@ class PhraseIndexNode {
  public:
   PhraseIndexNode() : chars_proxy_index_(-1) {}
   ~PhraseIndexNode() {
-    STL_DELETE_DATA(data_, std::list<PhraseLengthNode *>);
+    STL_DELETE_DATA(data_, std::vector<PhraseLengthNode *>);
   }
 
   int8_t chars_proxy_index_;  ///< 词语的汉字代理数组的索引
-  std::list<PhraseLengthNode *> data_;  ///< 数据
+  std::vector<PhraseLengthNode *> data_;  ///< 数据
 };
 
 /**
@@ -76,10 +85,10 @@ class PhraseRootNode {
  public:
   PhraseRootNode() {}
   ~PhraseRootNode() {
-    STL_DELETE_DATA(data_, std::list<PhraseIndexNode *>);
+    STL_DELETE_DATA(data_, std::vector<PhraseIndexNode *>);
   }
 
-  std::list<PhraseIndexNode *> data_;  ///< 数据
+  std::vector<PhraseIndexNode *> data_;  ///< 数据
 };
 
 /**
@@ -91,6 +100,8 @@ class MBCreater {
   ~MBCreater();
 
   void BuildPhraseTree(const char *data_file);
+  void LoadPhraseHits(const char *hits_file);
+  void LoadPhraseBigram(const char *bigram_file);
   void WritePhraseTree(const char *mb_file);
 
  private:
@@ -99,16 +110,32 @@ class MBCreater {
   PhraseDatum *CreatePhraseDatum(const char *phrase, const char *pinyin,
                                  const char *frequency);
   void InsertDatumToTree(PhraseDatum *datum);
-  std::list<PhraseLengthNode *> *SearchChildByIndex(
-      std::list<PhraseIndexNode *> *data_list, int index);
-  std::list<PhraseDatum *> *SearchChildByLength(
-      std::list<PhraseLengthNode *> *data_list, int length);
+  std::vector<PhraseLengthNode *> *SearchChildByIndex(
+      std::vector<PhraseIndexNode *> *data_list, int index);
+  std::vector<PhraseDatum *> *SearchChildByLength(
+      std::vector<PhraseLengthNode *> *data_list, int length);
 
+  std::string CreatePhraseKey(const void *data, int length,
+                              const CharsProxy *chars_proxy,
+                              int chars_proxy_length);
+  uint8_t QuantizeFrequency(int frequency);
+  uint8_t QuantizeBigramCount(uint count);
+  void CollectPhraseDatum(std::vector<PhraseDatum *> *data);
+  int LayoutPhraseDatum(int offset);
+
+  void WriteHeaderPart(int fd, int offset, int hot_length, int bigram_offset,
+                       uint bigram_slots);
   uint WritePureIndexPart(int fd, int *offset);
-  void WriteDatumIndexPart(int fd, int offset);
+  void WriteDatumIndexPart(int fd);
   void WritePhraseDatumPart(int fd);
+  uint WriteBigramPart(int fd, int offset);
 
   PhraseRootNode root_;  ///< 词语树的根节点
+  int max_frequency_;  ///< 最大词语频率
+  bool hot_layout_;  ///< 是否启用热区布局
+  std::map<std::string, uint> phrase_hits_;  ///< 词语命中次数表
+  std::map<uint64_t, uint> phrase_bigram_;  ///< 二元组共现次数表(键值为前后两个词语的编号)
+  uint max_bigram_count_;  ///< 最大共现次数
 };
 
 #endif  // PYE_TOOLS_MB_CREATER_H_
@@ -23,15 +23,24 @@
 #include "mb_creater.h"
 
 const struct option options[] = {
+  {"bigram", 1, NULL, 'b'},
   {"help", 0, NULL, 'h'},
+  {"hot", 2, NULL, 'H'},
   {"output", 1, NULL, 'o'},
   {"version", 0, NULL, 'v'},
   {NULL, 0, NULL, 0}
 };
 
 void PrintUsage() {
-  printf("Usage: pye-create-mb inputfile [-o outputfile]\n"
+  printf("Usage: pye-create-mb inputfile [-o outputfile] [-H[hitsfile]] "
+         "[-b bigramfile]\n"
          "\t-o <file> --output=<file>\n\t\tplace the output into <file>\n"
+         "\t-H[<file>] --hot[=<file>]\n\t\tplace the phrases covering 95%% "
+         "of the hits in <file>\n\t\t(default: the phrase frequencies) "
+         "into a page-aligned region first\n"
+         "\t-b <file> --bigram=<file>\n\t\tstore the phrase pair counts "
+         "in <file>\n\t\t(phrase1 pinyin1 phrase2 pinyin2 count) "
+         "for sentence conversion\n"
          "\t-h --help\n\t\tdisplay this help and exit\n"
          "\t-v --version\n\t\toutput version information and exit\n");
 }
@@ -41,14 +50,22 @@ void PrintVersion() {
 }
 
 int main(int argc, char *argv[]) {
-  const char *src(NULL), *dst(NULL);
+  const char *src(NULL), *dst(NULL), *hits(NULL), *bigram(NULL);
+  bool hot = false;
   int opt = -1;
   opterr = 0;
-  while ((opt = getopt_long(argc, argv, "ho:v", options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "b:hH::o:v", options, NULL)) != -1) {
     switch (opt) {
+      case 'b':
+        bigram = optarg;
+        break;
       case 'o':
         dst = optarg;
         break;
+      case 'H':
+        hot = true;
+        hits = optarg;
+        break;
       case 'h':
         PrintUsage();
         exit(0);
@@ -70,6 +87,10 @@ int main(int argc, char *argv[]) {
 
   MBCreater mb_creater;
   mb_creater.BuildPhraseTree(src);
+  if (hot)
+    mb_creater.LoadPhraseHits(hits);
+  if (bigram)
+    mb_creater.LoadPhraseBigram(bigram);
   mb_creater.WritePhraseTree(dst);
 
   return 0;
@@ -14,9 +14,21 @@
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
+#include <algorithm>
 #include "engine/pye_output.h"
 #include "engine/pye_wrapper.h"
 
+/**
+ * 按频率升序比较词语数据资料.
+ * @param datum1 词语数据资料
+ * @param datum2 词语数据资料
+ * @return 前者的频率是否低于后者
+ */
+static bool CompareDatumFrequency(const PhraseDatum *datum1,
+                                  const PhraseDatum *datum2) {
+  return datum1->frequency_ < datum2->frequency_;
+}
+
 /**
  * 类构造函数.
  */
@@ -146,36 +158,34 @@ PhraseDatum *UMBCreater::CreatePhraseDatum(const char *phrase,
  * @param datum 词语数据资料
  */
 void UMBCreater::InsertDatumToTree(PhraseDatum *datum) {
-  std::list<PhraseLengthNode *> *length_list =
+  std::vector<PhraseLengthNode *> *length_list =
     SearchChildByIndex(&root_.data_, datum->chars_proxy_->major_index_);
-  std::list<PhraseDatum *> *datum_list =
+  std::vector<PhraseDatum *> *datum_list =
     SearchChildByLength(length_list, datum->chars_proxy_length_);
 
-  std::list<PhraseDatum *>::iterator iterator = datum_list->begin();
-  for (; iterator != datum_list->end(); ++iterator) {
-    if ((*iterator)->frequency_ >= datum->frequency_)
-      break;
-  }
-  datum_list->insert(iterator, datum);
+  /* 同长度的词语按频率升序排列，二分查找插入位置 */
+  datum_list->insert(std::lower_bound(datum_list->begin(), datum_list->end(),
+                                      datum, CompareDatumFrequency),
+                     datum);
 }
 
 /**
  * 按汉字代理数组的索引值搜索孩子.
- * @param data_list 数据链表
+ * @param data_list 数据表
  * @param index 索引值
- * @return 孩子链表
+ * @return 孩子表
  */
-std::list<PhraseLengthNode *> *UMBCreater::SearchChildByIndex(
-    std::list<PhraseIndexNode *> *data_list, int index) {
+std::vector<PhraseLengthNode *> *UMBCreater::SearchChildByIndex(
+    std::vector<PhraseIndexNode *> *data_list, int index) {
   /* 确定孩子节点的位置 */
-  std::list<PhraseIndexNode *>::iterator iterator = data_list->begin();
+  std::vector<PhraseIndexNode *>::iterator iterator = data_list->begin();
   for (; iterator != data_list->end(); ++iterator) {
     if ((*iterator)->chars_proxy_index_ >= index)
       break;
   }
 
-  /* 获取孩子链表 */
-  std::list<PhraseLengthNode *> *length_list = NULL;
+  /* 获取孩子表 */
+  std::vector<PhraseLengthNode *> *length_list = NULL;
   if (iterator == data_list->end() || (*iterator)->chars_proxy_index_ > index) {
     PhraseIndexNode *node = new PhraseIndexNode;
     node->chars_proxy_index_ = index;
@@ -190,21 +200,21 @@ std::list<PhraseLengthNode *> *UMBCreater::SearchChildByIndex(
 
 /**
  * 按汉字代理数组的长度搜索孩子.
- * @param data_list 数据链表
+ * @param data_list 数据表
  * @param length 长度
- * @return 孩子链表
+ * @return 孩子表
  */
-std::list<PhraseDatum *> *UMBCreater::SearchChildByLength(
-    std::list<PhraseLengthNode *> *data_list, int length) {
+std::vector<PhraseDatum *> *UMBCreater::SearchChildByLength(
+    std::vector<PhraseLengthNode *> *data_list, int length) {
   /* 确定孩子节点的位置 */
-  std::list<PhraseLengthNode *>::iterator iterator = data_list->begin();
+  std::vector<PhraseLengthNode *>::iterator iterator = data_list->begin();
   for (; iterator != data_list->end(); ++iterator) {
     if ((*iterator)->chars_proxy_length_ >= length)
       break;
   }
 
-  /* 获取孩子链表 */
-  std::list<PhraseDatum *> *datum_list = NULL;
+  /* 获取孩子表 */
+  std::vector<PhraseDatum *> *datum_list = NULL;
   if (iterator == data_list->end() ||
       (*iterator)->chars_proxy_length_ > length) {
     PhraseLengthNode *node = new PhraseLengthNode;
@@ -229,33 +239,33 @@ int UMBCreater::RebuildPhraseTree(int fd) {
   lseek(fd, sizeof(offset), SEEK_SET);
 
   /* 构建根节点 */
-  std::list<PhraseIndexNode *> *index_list = &root_.data_;
+  std::vector<PhraseIndexNode *> *index_list = &root_.data_;
   user_root_.max_index_ = index_list->back()->chars_proxy_index_;
   user_root_.table_ = new UserPhraseIndexNode[user_root_.max_index_ + 1];
-  for (std::list<PhraseIndexNode *>::iterator iterator = index_list->begin();
+  for (std::vector<PhraseIndexNode *>::iterator iterator = index_list->begin();
        iterator != index_list->end();
        ++iterator) {
     int8_t chars_proxy_index = (*iterator)->chars_proxy_index_;
     /* 构建索引节点 */
     UserPhraseIndexNode *index_node = user_root_.table_ + chars_proxy_index;
-    std::list<PhraseLengthNode *> *length_list = &(*iterator)->data_;
+    std::vector<PhraseLengthNode *> *length_list = &(*iterator)->data_;
     index_node->max_length_ = length_list->back()->chars_proxy_length_;
     index_node->table_ = new UserPhraseLengthNode[index_node->max_length_];
-    for (std::list<PhraseLengthNode *>::iterator iterator = length_list->begin();
+    for (std::vector<PhraseLengthNode *>::iterator iterator = length_list->begin();
          iterator != length_list->end();
          ++iterator) {
       int chars_proxy_length = (*iterator)->chars_proxy_length_;
       /* 构建长度节点 */
       UserPhraseLengthNode *length_node =
           index_node->table_ + chars_proxy_length - 1;
-      std::list<PhraseDatum *> *datum_list = &(*iterator)->data_;
+      std::vector<PhraseDatum *> *datum_list = &(*iterator)->data_;
       length_node->phrase_amount_ = datum_list->size();
       length_node->chars_proxy_ =
           new CharsProxy[chars_proxy_length * length_node->phrase_amount_];
       length_node->phrase_attribute_ =
           new UserPhraseAttribute[length_node->phrase_amount_];
       uint number = 0;  // 初始化编号
-      for (std::list<PhraseDatum *>::iterator iterator = datum_list->begin();
+      for (std::vector<PhraseDatum *>::iterator iterator = datum_list->begin();
            iterator != datum_list->end();
            ++iterator) {
         PhraseDatum *datum = *iterator;
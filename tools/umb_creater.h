@@ -16,7 +16,7 @@
 
 #include <sys/types.h>
 #include <stdlib.h>
-#include <list>
+#include <vector>
 #include "engine/pinyin_parser.h"
 #include "engine/pye_global.h"
 
@@ -48,11 +48,11 @@ class PhraseLengthNode {
  public:
   PhraseLengthNode() : chars_proxy_length_(0) {}
   ~PhraseLengthNode() {
-    STL_DELETE_DATA(data_, std::list<PhraseDatum *>);
+    STL_DELETE_DATA(data_, std::vector<PhraseDatum *>);
   }
 
   int chars_proxy_length_;  ///< 词语的汉字代理数组的长度
-  std::list<PhraseDatum *> data_;  ///< 数据
+  std::vector<PhraseDatum *> data_;  ///< 数据
 };
 
 /**
@@ -62,11 +62,11 @@ class PhraseIndexNode {
  public:
   PhraseIndexNode() : chars_proxy_index_(-1) {}
   ~PhraseIndexNode() {
-    STL_DELETE_DATA(data_, std::list<PhraseLengthNode *>);
+    STL_DELETE_DATA(data_, std::vector<PhraseLengthNode *>);
   }
 
   int8_t chars_proxy_index_;  ///< 词语的汉字代理数组的索引
-  std::list<PhraseLengthNode *> data_;  ///< 数据
+  std::vector<PhraseLengthNode *> data_;  ///< 数据
 };
 
 /**
@@ -76,10 +76,10 @@ class PhraseRootNode {
  public:
   PhraseRootNode() {}
   ~PhraseRootNode() {
-    STL_DELETE_DATA(data_, std::list<PhraseIndexNode *>);
+    STL_DELETE_DATA(data_, std::vector<PhraseIndexNode *>);
   }
 
-  std::list<PhraseIndexNode *> data_;  ///< 数据
+  std::vector<PhraseIndexNode *> data_;  ///< 数据
 };
 
 /**
@@ -156,10 +156,10 @@ class UMBCreater {
   PhraseDatum *CreatePhraseDatum(const char *phrase, const char *pinyin,
                                  const char *frequency);
   void InsertDatumToTree(PhraseDatum *datum);
-  std::list<PhraseLengthNode *> *SearchChildByIndex(
-      std::list<PhraseIndexNode *> *data_list, int index);
-  std::list<PhraseDatum *> *SearchChildByLength(
-      std::list<PhraseLengthNode *> *data_list, int length);
+  std::vector<PhraseLengthNode *> *SearchChildByIndex(
+      std::vector<PhraseIndexNode *> *data_list, int index);
+  std::vector<PhraseDatum *> *SearchChildByLength(
+      std::vector<PhraseLengthNode *> *data_list, int length);
 
   int RebuildPhraseTree(int fd);
   void WritePhraseTree(int fd, int offset);